@@ -0,0 +1,66 @@
+#ifndef DELETION_QUEUE_H
+#define DELETION_QUEUE_H
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+
+// --------------
+// DELETION QUEUE
+// --------------
+// an object a submitted frame still uses can't be destroyed right away, and
+// waiting for the device to go idle first stalls everything. instead push
+// hands over a function that destroys it, together with the last submission
+// that may use it, and collect runs the functions once that submission has
+// finished
+//
+// submissions are the values of the GpuTimeline: numbered from 1 in
+// submission order, and n being finished means every submission up to n is.
+// functions run in the order they were pushed, which must be in order of
+// last_use
+
+
+class DeletionQueue {
+public:
+  DeletionQueue() = default;
+  DeletionQueue(const DeletionQueue&) = delete;
+  DeletionQueue& operator=(const DeletionQueue&) = delete;
+
+
+  void push(uint64_t last_use, std::function<void()> destroy) {
+    entries.push_back(Entry{last_use, std::move(destroy)});
+  }
+
+
+  // runs everything the GPU is done with once submission completed has
+  // finished
+  void collect(uint64_t completed) {
+    while (!entries.empty() && entries.front().last_use <= completed) {
+      std::function<void()> destroy = std::move(entries.front().destroy);
+      entries.pop_front();
+      destroy();
+    }
+  }
+
+
+  // runs everything, the device must be idle
+  void flush() {
+    collect(UINT64_MAX);
+  }
+
+
+  size_t size() const {
+    return entries.size();
+  }
+
+
+private:
+  struct Entry {
+    uint64_t last_use;
+    std::function<void()> destroy;
+  };
+
+  std::deque<Entry> entries;
+};
+
+#endif
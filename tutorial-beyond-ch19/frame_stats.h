@@ -0,0 +1,240 @@
+#ifndef FRAME_STATS_H
+#define FRAME_STATS_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// ---------------
+// CPU FRAME STATS
+// ---------------
+// per phase CPU timings of draw_frame:
+//   -WAIT:    waiting for the frame's previous submission (how far ahead the
+//             CPU is)
+//   -ACQUIRE: vkAcquireNextImageKHR (blocks when no image is free)
+//   -RECORD:  uniforms + command recording
+//   -SUBMIT:  vkQueueSubmit
+//   -PRESENT: vkQueuePresentKHR
+// plus the time between the start of two frames, which is what the user
+// actually sees
+//
+// samples go into a fixed size ring that only the render thread writes to,
+// without ever taking a lock or waiting for a reader. every slot has a
+// sequence number that is odd while the writer is copying into it (a
+// seqlock), so any thread can take a snapshot at any time: a slot is only
+// kept if its sequence was even and didn't change while it was being read
+
+
+enum FramePhase {
+  FRAME_PHASE_WAIT,
+  FRAME_PHASE_ACQUIRE,
+  FRAME_PHASE_RECORD,
+  FRAME_PHASE_SUBMIT,
+  FRAME_PHASE_PRESENT,
+  FRAME_PHASE_COUNT
+};
+
+
+struct FrameSample {
+  uint64_t frame = 0;
+  float phase_ms[FRAME_PHASE_COUNT] = {};
+  // start of this frame to start of the previous one, 0 for the first frame
+  float frame_ms = 0.0f;
+};
+
+
+// must be a power of two
+const size_t FRAME_STATS_CAPACITY = 4096;
+
+// a slot holds a sample as 32 bit words, so readers racing the writer copy
+// atomics instead of plain memory
+static_assert(std::is_trivially_copyable<FrameSample>::value && sizeof(FrameSample) % 4 == 0,
+    "FrameSample is copied word by word");
+const size_t FRAME_SAMPLE_WORDS = sizeof(FrameSample) / 4;
+
+
+class FrameStats {
+public:
+  FrameStats() : samples(FRAME_STATS_CAPACITY) {}
+
+
+  // render thread only, wait-free
+  void push(const FrameSample& sample) {
+    uint64_t index = write_index.load(std::memory_order_relaxed);
+    FrameSample numbered = sample;
+    numbered.frame = index;
+    uint32_t words[FRAME_SAMPLE_WORDS];
+    memcpy(words, &numbered, sizeof(numbered));
+
+    Slot& slot = samples[index & (FRAME_STATS_CAPACITY - 1)];
+    uint64_t sequence = slot.sequence.load(std::memory_order_relaxed);
+    slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+    // the odd sequence has to be visible before any of the new words
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < FRAME_SAMPLE_WORDS; i++) {
+      slot.words[i].store(words[i], std::memory_order_relaxed);
+    }
+    slot.sequence.store(sequence + 2, std::memory_order_release);
+    write_index.store(index + 1, std::memory_order_release);
+  }
+
+
+  uint64_t frame_count() const {
+    return write_index.load(std::memory_order_acquire);
+  }
+
+
+  // the last FRAME_STATS_CAPACITY samples (or fewer), oldest first. samples
+  // the writer is overwriting while they're copied are left out, so with a
+  // running render thread the oldest few may be missing
+  std::vector<FrameSample> snapshot() const {
+    uint64_t end   = write_index.load(std::memory_order_acquire);
+    uint64_t begin = end > FRAME_STATS_CAPACITY ? end - FRAME_STATS_CAPACITY : 0;
+
+    std::vector<FrameSample> result;
+    result.reserve(static_cast<size_t>(end - begin));
+    for (uint64_t i = begin; i < end; i++) {
+      FrameSample sample;
+      if (read_slot(samples[i & (FRAME_STATS_CAPACITY - 1)], sample) && sample.frame == i) {
+        result.push_back(sample);
+      }
+    }
+    return result;
+  }
+
+
+  // percentiles per phase plus a histogram of the frame times
+  void print_summary(std::ostream& out, const std::string& configuration) const {
+    std::vector<FrameSample> frames = snapshot();
+    if (frames.size() < 2) return;
+
+    out << "frame stats (" << configuration << ", last " << frames.size() << " frames):" << std::endl;
+    out << "  phase        p50      p90      p99      max  (ms)" << std::endl;
+    for (int phase = 0; phase < FRAME_PHASE_COUNT; phase++) {
+      std::vector<float> values;
+      for (auto& frame : frames) values.push_back(frame.phase_ms[phase]);
+      print_percentiles(out, phase_name(phase), values);
+    }
+
+    // the first frame has no predecessor
+    std::vector<float> frame_times;
+    for (size_t i = 1; i < frames.size(); i++) frame_times.push_back(frames[i].frame_ms);
+    print_percentiles(out, "frame", frame_times);
+
+    // bucket edges around the common refresh intervals (240/144/120/60/30 Hz)
+    const float edges[] = {4.2f, 6.9f, 8.3f, 16.7f, 33.3f, 50.0f};
+    const int bucket_count = sizeof(edges) / sizeof(edges[0]) + 1;
+    uint32_t buckets[bucket_count] = {};
+    for (float ms : frame_times) {
+      int bucket = 0;
+      while (bucket < bucket_count - 1 && ms > edges[bucket]) bucket++;
+      buckets[bucket]++;
+    }
+
+    out << "  frame time histogram:" << std::endl;
+    for (int i = 0; i < bucket_count; i++) {
+      std::string label = i == 0 ? "<= " + format_ms(edges[0]) :
+          i == bucket_count - 1 ? " > " + format_ms(edges[i - 1]) :
+          format_ms(edges[i - 1]) + "-" + format_ms(edges[i]);
+      int bar = static_cast<int>(50.0f * buckets[i] / frame_times.size() + 0.5f);
+
+      out << "    " << std::setw(11) << label << " ms " << std::setw(6) << buckets[i] << " "
+          << std::string(bar, '#') << std::endl;
+    }
+  }
+
+
+  // one row per frame. the configuration columns are the same on every row so
+  // the files of several runs can simply be concatenated and grouped
+  void write_csv(const std::string& path, const std::string& present_mode, uint32_t frames_in_flight) const {
+    std::ofstream file(path);
+    if (!file.is_open()) {
+      throw std::runtime_error("failed to open " + path + " for writing!");
+    }
+
+    file << "frame,present_mode,frames_in_flight";
+    for (int phase = 0; phase < FRAME_PHASE_COUNT; phase++) {
+      file << "," << phase_name(phase) << "_ms";
+    }
+    file << ",frame_ms\n";
+
+    file << std::fixed << std::setprecision(4);
+    for (auto& frame : snapshot()) {
+      file << frame.frame << "," << present_mode << "," << frames_in_flight;
+      for (int phase = 0; phase < FRAME_PHASE_COUNT; phase++) {
+        file << "," << frame.phase_ms[phase];
+      }
+      file << "," << frame.frame_ms << "\n";
+    }
+  }
+
+
+private:
+  struct Slot {
+    // odd while push is writing the words
+    std::atomic<uint64_t> sequence{0};
+    std::atomic<uint32_t> words[FRAME_SAMPLE_WORDS];
+  };
+
+  std::vector<Slot> samples;
+  std::atomic<uint64_t> write_index{0};
+
+
+  // false if the writer was in the slot at any point during the copy
+  static bool read_slot(const Slot& slot, FrameSample& sample) {
+    uint64_t before = slot.sequence.load(std::memory_order_acquire);
+    if (before & 1) return false;
+
+    uint32_t words[FRAME_SAMPLE_WORDS];
+    for (size_t i = 0; i < FRAME_SAMPLE_WORDS; i++) {
+      words[i] = slot.words[i].load(std::memory_order_relaxed);
+    }
+    // the words have to be read before the sequence is checked again
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.sequence.load(std::memory_order_relaxed) != before) return false;
+
+    memcpy(&sample, words, sizeof(sample));
+    return true;
+  }
+
+
+  static const char* phase_name(int phase) {
+    static const char* const names[FRAME_PHASE_COUNT] = {
+      "wait", "acquire", "record", "submit", "present"
+    };
+    return names[phase];
+  }
+
+
+  static std::string format_ms(float ms) {
+    std::ostringstream stream;
+    stream << std::fixed << std::setprecision(1) << ms;
+    return stream.str();
+  }
+
+
+  static void print_percentiles(std::ostream& out, const char* name, std::vector<float> values) {
+    if (values.empty()) return;
+    std::sort(values.begin(), values.end());
+
+    auto percentile = [&values](float p) {
+      return values[static_cast<size_t>(p * (values.size() - 1) + 0.5f)];
+    };
+
+    out << "  " << std::left << std::setw(8) << name << std::right << std::fixed << std::setprecision(3)
+        << std::setw(9) << percentile(0.50f) << std::setw(9) << percentile(0.90f)
+        << std::setw(9) << percentile(0.99f) << std::setw(9) << values.back()
+        << std::defaultfloat << std::endl;
+  }
+};
+
+#endif
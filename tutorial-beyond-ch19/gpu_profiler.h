@@ -0,0 +1,256 @@
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// ----------------------
+// GPU TIMESTAMP PROFILER
+// ----------------------
+// named scopes around regions of a command buffer, each scope writes a
+// timestamp query at its start (TOP_OF_PIPE) and end (BOTTOM_OF_PIPE)
+//
+// the query pool has one range per frame in flight. the results of a frame
+// are only read once the frame has finished (collect), which is
+// MAX_FRAMES_IN_FLIGHT frames after they were recorded, so reading them back
+// never stalls. VK_QUERY_RESULT_WITH_AVAILABILITY_BIT makes sure a query that
+// still isn't done is skipped rather than waited for
+//
+// timestamps count in ticks of timestampPeriod nanoseconds and only the low
+// timestampValidBits bits are meaningful. a queue family with 0 valid bits
+// doesn't support timestamps at all, the profiler then does nothing
+
+
+struct GpuScopeStats {
+  uint32_t samples = 0;
+  double min_ms = 0.0;
+  double avg_ms = 0.0;
+  double p99_ms = 0.0;
+};
+
+
+// number of samples per scope the rolling statistics are computed over
+const size_t GPU_PROFILER_WINDOW = 256;
+
+
+class GpuProfiler {
+public:
+  void init(VkPhysicalDevice physical_device, VkDevice device, uint32_t queue_family,
+      uint32_t frame_count, uint32_t max_scopes_per_frame = 32) {
+    this->device = device;
+    this->max_scopes = max_scopes_per_frame;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+    timestamp_period = properties.limits.timestampPeriod;
+
+    uint32_t family_count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &family_count, nullptr);
+    std::vector<VkQueueFamilyProperties> families(family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &family_count, families.data());
+
+    uint32_t valid_bits = families[queue_family].timestampValidBits;
+    if (valid_bits == 0) {
+      std::cout << "gpu profiler: timestamps not supported on this queue, disabled" << std::endl;
+      return;
+    }
+    timestamp_mask = valid_bits >= 64 ? ~0ull : (1ull << valid_bits) - 1;
+
+    VkQueryPoolCreateInfo pool_info = {};
+    pool_info.sType      = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    pool_info.queryType  = VK_QUERY_TYPE_TIMESTAMP;
+    pool_info.queryCount = frame_count * max_scopes * 2;
+
+    if (vkCreateQueryPool(device, &pool_info, nullptr, &query_pool) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create timestamp query pool!");
+    }
+
+    frames.resize(frame_count);
+  }
+
+
+  bool enabled() const {
+    return query_pool != VK_NULL_HANDLE;
+  }
+
+
+  // reads back the results recorded the last time this frame was used,
+  // which must have finished
+  void collect(uint32_t frame) {
+    if (!enabled() || frames[frame].scope_names.empty() || !frames[frame].submitted) {
+      return;
+    }
+
+    Frame& f = frames[frame];
+    uint32_t query_count = static_cast<uint32_t>(f.scope_names.size()) * 2;
+
+    // value + availability per query
+    std::vector<uint64_t> results(query_count * 2);
+    VkResult result = vkGetQueryPoolResults(device, query_pool, first_query(frame), query_count,
+        results.size() * sizeof(uint64_t), results.data(), 2 * sizeof(uint64_t),
+        VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+    if (result == VK_SUCCESS || result == VK_NOT_READY) {
+      for (size_t i = 0; i < f.scope_names.size(); i++) {
+        const uint64_t* begin = &results[(2 * i) * 2];
+        const uint64_t* end   = &results[(2 * i + 1) * 2];
+        if (begin[1] == 0 || end[1] == 0) continue;
+
+        uint64_t ticks = ((end[0] & timestamp_mask) - (begin[0] & timestamp_mask)) & timestamp_mask;
+        add_sample(f.scope_names[i], ticks * timestamp_period / 1e6);
+      }
+    }
+
+    f.scope_names.clear();
+    f.submitted = false;
+  }
+
+
+  // resets the frame's queries, must be recorded outside of a render pass
+  // before the first scope of the frame
+  void begin_frame(VkCommandBuffer command_buffer, uint32_t frame) {
+    if (!enabled()) return;
+
+    frames[frame].scope_names.clear();
+    frames[frame].submitted = false;
+    vkCmdResetQueryPool(command_buffer, query_pool, first_query(frame), max_scopes * 2);
+  }
+
+
+  // the frame's command buffer has been submitted, its results can be
+  // collected once it has finished
+  void end_frame(uint32_t frame) {
+    if (!enabled()) return;
+    frames[frame].submitted = true;
+  }
+
+
+  // returns the scope to pass to end_scope, scopes beyond
+  // max_scopes_per_frame are silently dropped
+  uint32_t begin_scope(VkCommandBuffer command_buffer, uint32_t frame, const std::string& name) {
+    if (!enabled() || frames[frame].scope_names.size() >= max_scopes) {
+      return NO_SCOPE;
+    }
+
+    uint32_t scope = static_cast<uint32_t>(frames[frame].scope_names.size());
+    frames[frame].scope_names.push_back(name);
+    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, query_pool,
+        first_query(frame) + scope * 2);
+    return scope;
+  }
+
+
+  void end_scope(VkCommandBuffer command_buffer, uint32_t frame, uint32_t scope) {
+    if (scope == NO_SCOPE) return;
+
+    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, query_pool,
+        first_query(frame) + scope * 2 + 1);
+  }
+
+
+  // min/avg/p99 over the last GPU_PROFILER_WINDOW samples of every scope
+  std::map<std::string, GpuScopeStats> get_stats() const {
+    std::map<std::string, GpuScopeStats> stats;
+    for (auto& scope : samples) {
+      std::vector<double> sorted(scope.second.begin(), scope.second.end());
+      if (sorted.empty()) continue;
+      std::sort(sorted.begin(), sorted.end());
+
+      GpuScopeStats s;
+      s.samples = static_cast<uint32_t>(sorted.size());
+      s.min_ms  = sorted.front();
+      double sum = 0.0;
+      for (double sample : sorted) sum += sample;
+      s.avg_ms  = sum / sorted.size();
+      // nearest rank
+      size_t rank = static_cast<size_t>(0.99 * (sorted.size() - 1) + 0.5);
+      s.p99_ms  = sorted[rank];
+      stats[scope.first] = s;
+    }
+    return stats;
+  }
+
+
+  void print_stats(std::ostream& out) const {
+    if (!enabled()) return;
+
+    out << "gpu profiler (last " << GPU_PROFILER_WINDOW << " frames):" << std::endl;
+    for (auto& scope : get_stats()) {
+      out << "  " << std::left << std::setw(20) << scope.first << std::right << std::fixed << std::setprecision(3)
+          << " min " << scope.second.min_ms << " ms, avg " << scope.second.avg_ms
+          << " ms, p99 " << scope.second.p99_ms << " ms" << std::defaultfloat << std::endl;
+    }
+  }
+
+
+  // one JSON object, easy to pick up from a CI job
+  void write_dump(const std::string& path) const {
+    std::ofstream file(path);
+    if (!file.is_open()) {
+      throw std::runtime_error("failed to open " + path + " for writing!");
+    }
+
+    file << "{\n  \"timestamp_period_ns\": " << timestamp_period << ",\n  \"scopes\": [";
+    bool first = true;
+    for (auto& scope : get_stats()) {
+      file << (first ? "\n" : ",\n") << "    {\"name\": \"" << scope.first << "\", \"samples\": "
+           << scope.second.samples << std::fixed << std::setprecision(6)
+           << ", \"min_ms\": " << scope.second.min_ms << ", \"avg_ms\": " << scope.second.avg_ms
+           << ", \"p99_ms\": " << scope.second.p99_ms << "}" << std::defaultfloat;
+      first = false;
+    }
+    file << "\n  ]\n}\n";
+  }
+
+
+  void destroy() {
+    if (query_pool != VK_NULL_HANDLE) {
+      vkDestroyQueryPool(device, query_pool, nullptr);
+      query_pool = VK_NULL_HANDLE;
+    }
+  }
+
+
+private:
+  static const uint32_t NO_SCOPE = ~0u;
+
+  struct Frame {
+    std::vector<std::string> scope_names;
+    bool submitted = false;
+  };
+
+  VkDevice device = VK_NULL_HANDLE;
+  VkQueryPool query_pool = VK_NULL_HANDLE;
+  uint32_t max_scopes = 0;
+  float timestamp_period = 1.0f;
+  uint64_t timestamp_mask = ~0ull;
+
+  std::vector<Frame> frames;
+  std::map<std::string, std::deque<double>> samples;
+
+
+  uint32_t first_query(uint32_t frame) const {
+    return frame * max_scopes * 2;
+  }
+
+
+  void add_sample(const std::string& name, double ms) {
+    std::deque<double>& window = samples[name];
+    window.push_back(ms);
+    if (window.size() > GPU_PROFILER_WINDOW) {
+      window.pop_front();
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,285 @@
+#ifndef GPU_TIMELINE_H
+#define GPU_TIMELINE_H
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <stdexcept>
+#include <vector>
+
+// ------------
+// GPU TIMELINE
+// ------------
+// every submission to the graphics queue (frames, upload batches, readbacks)
+// goes through submit, which numbers them from 1. the GPU signals a number
+// once that submission has finished, and since a queue signals in submission
+// order that means every earlier one has finished as well. so the progress of
+// the GPU is a single value that only grows:
+//   -submitted: the number of the last submission
+//   -completed: the highest number the GPU has signaled
+//   -wait(n):   blocks until n has been signaled
+// anything that has to outlive the GPU work using it (per frame resources,
+// staging buffers, retired objects in a DeletionQueue) just remembers
+// submitted and checks completed, no fence per use
+//
+// with VK_KHR_timeline_semaphore the value is the payload of one timeline
+// semaphore that every submission signals. without it every submission
+// signals a fence from a small pool, and the value is tracked on the CPU by
+// checking the fences in order
+//
+// the SDK in the Makefile predates the extension, so its part of the API is
+// declared below whenever vulkan.h doesn't have it. that way the timeline
+// path is always built and picked at runtime, the fences are only the
+// fallback for devices without the extension
+
+
+#ifndef VK_KHR_timeline_semaphore
+#define VK_KHR_timeline_semaphore 1
+#define VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME "VK_KHR_timeline_semaphore"
+
+const VkStructureType VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR =
+    static_cast<VkStructureType>(1000207000);
+const VkStructureType VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR =
+    static_cast<VkStructureType>(1000207002);
+const VkStructureType VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR =
+    static_cast<VkStructureType>(1000207003);
+const VkStructureType VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR =
+    static_cast<VkStructureType>(1000207004);
+
+typedef enum VkSemaphoreTypeKHR {
+  VK_SEMAPHORE_TYPE_BINARY_KHR   = 0,
+  VK_SEMAPHORE_TYPE_TIMELINE_KHR = 1,
+  VK_SEMAPHORE_TYPE_MAX_ENUM_KHR = 0x7FFFFFFF
+} VkSemaphoreTypeKHR;
+
+typedef VkFlags VkSemaphoreWaitFlagsKHR;
+
+typedef struct VkPhysicalDeviceTimelineSemaphoreFeaturesKHR {
+  VkStructureType sType;
+  void*           pNext;
+  VkBool32        timelineSemaphore;
+} VkPhysicalDeviceTimelineSemaphoreFeaturesKHR;
+
+typedef struct VkSemaphoreTypeCreateInfoKHR {
+  VkStructureType    sType;
+  const void*        pNext;
+  VkSemaphoreTypeKHR semaphoreType;
+  uint64_t           initialValue;
+} VkSemaphoreTypeCreateInfoKHR;
+
+typedef struct VkTimelineSemaphoreSubmitInfoKHR {
+  VkStructureType sType;
+  const void*     pNext;
+  uint32_t        waitSemaphoreValueCount;
+  const uint64_t* pWaitSemaphoreValues;
+  uint32_t        signalSemaphoreValueCount;
+  const uint64_t* pSignalSemaphoreValues;
+} VkTimelineSemaphoreSubmitInfoKHR;
+
+typedef struct VkSemaphoreWaitInfoKHR {
+  VkStructureType         sType;
+  const void*             pNext;
+  VkSemaphoreWaitFlagsKHR flags;
+  uint32_t                semaphoreCount;
+  const VkSemaphore*      pSemaphores;
+  const uint64_t*         pValues;
+} VkSemaphoreWaitInfoKHR;
+
+typedef VkResult (VKAPI_PTR *PFN_vkGetSemaphoreCounterValueKHR)(VkDevice device, VkSemaphore semaphore,
+    uint64_t* pValue);
+typedef VkResult (VKAPI_PTR *PFN_vkWaitSemaphoresKHR)(VkDevice device, const VkSemaphoreWaitInfoKHR* pWaitInfo,
+    uint64_t timeout);
+#endif
+
+
+class GpuTimeline {
+public:
+  // timeline: the device was created with VK_KHR_timeline_semaphore and its
+  // timelineSemaphore feature
+  void init(VkDevice device, VkQueue queue, bool timeline) {
+    this->device = device;
+    this->queue  = queue;
+
+    if (timeline) {
+      wait_semaphores   = (PFN_vkWaitSemaphoresKHR)vkGetDeviceProcAddr(device, "vkWaitSemaphoresKHR");
+      get_counter_value = (PFN_vkGetSemaphoreCounterValueKHR)
+          vkGetDeviceProcAddr(device, "vkGetSemaphoreCounterValueKHR");
+
+      VkSemaphoreTypeCreateInfoKHR type_info = {};
+      type_info.sType         = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+      type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+      type_info.initialValue  = 0;
+
+      VkSemaphoreCreateInfo semaphore_info = {};
+      semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+      semaphore_info.pNext = &type_info;
+
+      if (!wait_semaphores || !get_counter_value ||
+          vkCreateSemaphore(device, &semaphore_info, nullptr, &semaphore) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create timeline semaphore!");
+      }
+    }
+  }
+
+
+  bool uses_timeline_semaphore() const {
+    return semaphore != VK_NULL_HANDLE;
+  }
+
+
+  // the number of the last submission, 0 before the first
+  uint64_t submitted() const {
+    return last_submitted;
+  }
+
+
+  // submits info, which signals submitted() once it has finished. the wait
+  // and signal semaphores of info must be binary semaphores
+  VkResult submit(const VkSubmitInfo& info) {
+    uint64_t value = last_submitted + 1;
+    VkSubmitInfo submit_info = info;
+    VkFence fence = VK_NULL_HANDLE;
+
+    VkTimelineSemaphoreSubmitInfoKHR timeline_info = {};
+    if (semaphore != VK_NULL_HANDLE) {
+      signal_semaphores.assign(info.pSignalSemaphores, info.pSignalSemaphores + info.signalSemaphoreCount);
+      signal_semaphores.push_back(semaphore);
+      // binary semaphores ignore their value
+      signal_values.assign(info.signalSemaphoreCount, 0);
+      signal_values.push_back(value);
+
+      timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+      timeline_info.pNext = info.pNext;
+      timeline_info.signalSemaphoreValueCount = static_cast<uint32_t>(signal_values.size());
+      timeline_info.pSignalSemaphoreValues    = signal_values.data();
+
+      submit_info.pNext = &timeline_info;
+      submit_info.signalSemaphoreCount = static_cast<uint32_t>(signal_semaphores.size());
+      submit_info.pSignalSemaphores    = signal_semaphores.data();
+    }
+    if (semaphore == VK_NULL_HANDLE) {
+      fence = acquire_fence();
+    }
+
+    VkResult result = vkQueueSubmit(queue, 1, &submit_info, fence);
+    if (result != VK_SUCCESS) {
+      if (fence != VK_NULL_HANDLE) free_fences.push_back(fence);
+      return result;
+    }
+
+    if (fence != VK_NULL_HANDLE) {
+      pending.push_back(PendingFence{value, fence});
+    }
+    last_submitted = value;
+    return VK_SUCCESS;
+  }
+
+
+  // the highest value the GPU has signaled, does not block
+  uint64_t completed() {
+    if (semaphore != VK_NULL_HANDLE) {
+      uint64_t value;
+      if (get_counter_value(device, semaphore, &value) == VK_SUCCESS) {
+        last_completed = std::max(last_completed, value);
+      }
+      return last_completed;
+    }
+    while (!pending.empty() && vkGetFenceStatus(device, pending.front().fence) == VK_SUCCESS) {
+      retire_front();
+    }
+    return last_completed;
+  }
+
+
+  // blocks until value has been signaled
+  void wait(uint64_t value) {
+    value = std::min(value, last_submitted);
+    if (value <= last_completed) return;
+
+    if (semaphore != VK_NULL_HANDLE) {
+      VkSemaphoreWaitInfoKHR wait_info = {};
+      wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+      wait_info.semaphoreCount = 1;
+      wait_info.pSemaphores    = &semaphore;
+      wait_info.pValues        = &value;
+      if (wait_semaphores(device, &wait_info, UINT64_MAX) != VK_SUCCESS) {
+        throw std::runtime_error("failed to wait for timeline semaphore!");
+      }
+      last_completed = value;
+      return;
+    }
+    while (!pending.empty() && pending.front().value <= value) {
+      if (vkWaitForFences(device, 1, &pending.front().fence, VK_TRUE, UINT64_MAX) != VK_SUCCESS) {
+        throw std::runtime_error("failed to wait for timeline fence!");
+      }
+      retire_front();
+    }
+  }
+
+
+  void destroy() {
+    wait(last_submitted);
+    if (semaphore != VK_NULL_HANDLE) {
+      vkDestroySemaphore(device, semaphore, nullptr);
+    }
+    for (auto fence : free_fences) {
+      vkDestroyFence(device, fence, nullptr);
+    }
+    free_fences.clear();
+  }
+
+
+private:
+  struct PendingFence {
+    uint64_t value;
+    VkFence fence;
+  };
+
+  VkDevice device = VK_NULL_HANDLE;
+  // all submissions go to one queue, that's what keeps the value in order
+  VkQueue queue = VK_NULL_HANDLE;
+  uint64_t last_submitted = 0;
+  uint64_t last_completed = 0;
+
+  VkSemaphore semaphore = VK_NULL_HANDLE;
+  PFN_vkWaitSemaphoresKHR wait_semaphores = nullptr;
+  PFN_vkGetSemaphoreCounterValueKHR get_counter_value = nullptr;
+  // reused by submit
+  std::vector<VkSemaphore> signal_semaphores;
+  std::vector<uint64_t> signal_values;
+
+  // without timeline semaphores, in submission order
+  std::deque<PendingFence> pending;
+  std::vector<VkFence> free_fences;
+
+
+  VkFence acquire_fence() {
+    if (!free_fences.empty()) {
+      VkFence fence = free_fences.back();
+      free_fences.pop_back();
+      return fence;
+    }
+
+    VkFenceCreateInfo fence_info = {};
+    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+    VkFence fence;
+    if (vkCreateFence(device, &fence_info, nullptr, &fence) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create timeline fence!");
+    }
+    return fence;
+  }
+
+
+  void retire_front() {
+    PendingFence& front = pending.front();
+    last_completed = std::max(last_completed, front.value);
+    vkResetFences(device, 1, &front.fence);
+    free_fences.push_back(front.fence);
+    pending.pop_front();
+  }
+};
+
+#endif
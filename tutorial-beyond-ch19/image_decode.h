@@ -0,0 +1,177 @@
+#ifndef IMAGE_DECODE_H
+#define IMAGE_DECODE_H
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+// ----------------------------
+// DECODING INTO STAGING MEMORY
+// ----------------------------
+// stb_image allocates the decoded image itself, so a texture used to exist
+// twice on the host: once on the heap and once in the staging buffer it was
+// copied to. stb_image has no way to hand it an output buffer, but it does
+// let the application replace malloc, realloc and free
+//
+// while an ImageDecodeTarget is alive, the first allocation stb_image makes
+// on this thread that is at least min_size and at most capacity bytes is
+// served from the target's memory, the decoder then writes the image
+// straight into it. min_size is width * height * channels, the JPEG decoder
+// asks for one byte more than that, so capacity should leave some slack
+// (IMAGE_DECODE_SLACK)
+//
+// whether it worked is only known once the decoder returns: the image is in
+// place if stbi_load returned the target's memory (in_place). anything else
+// (an intermediate buffer of the same size took the target, a format that
+// converts the image at the end) is an ordinary heap image the caller copies
+//
+// the hooks also see every heap allocation of the decoder, so a target
+// reports the most heap memory stb_image held at once while it was alive
+// (peak_heap_bytes). that is the image itself plus the decoder's buffers
+// when it missed the target, only the buffers when it didn't
+//
+// include this before stb_image.h in the file that defines
+// STB_IMAGE_IMPLEMENTATION
+
+
+const size_t IMAGE_DECODE_SLACK = 16;
+
+// heap blocks start with their size, padded to keep malloc's alignment
+const size_t IMAGE_DECODE_HEADER = 16;
+
+
+struct ImageDecodeState {
+  unsigned char* data = nullptr;
+  size_t min_size     = 0;
+  size_t capacity     = 0;
+  bool claimed        = false;
+  // stb_image's heap blocks on this thread, see image_decode_heap_alloc
+  size_t heap_bytes      = 0;
+  size_t peak_heap_bytes = 0;
+};
+
+
+inline ImageDecodeState& image_decode_state() {
+  static thread_local ImageDecodeState state;
+  return state;
+}
+
+
+inline void* image_decode_heap_alloc(size_t size) {
+  unsigned char* block = static_cast<unsigned char*>(malloc(size + IMAGE_DECODE_HEADER));
+  if (!block) return nullptr;
+
+  memcpy(block, &size, sizeof(size));
+  ImageDecodeState& state = image_decode_state();
+  state.heap_bytes += size;
+  state.peak_heap_bytes = std::max(state.peak_heap_bytes, state.heap_bytes);
+  return block + IMAGE_DECODE_HEADER;
+}
+
+
+inline size_t image_decode_heap_size(void* p) {
+  size_t size;
+  memcpy(&size, static_cast<unsigned char*>(p) - IMAGE_DECODE_HEADER, sizeof(size));
+  return size;
+}
+
+
+// a block freed on another thread than it was allocated on is only
+// subtracted as far as it can be
+inline void image_decode_heap_free(void* p) {
+  ImageDecodeState& state = image_decode_state();
+  state.heap_bytes -= std::min(state.heap_bytes, image_decode_heap_size(p));
+  free(static_cast<unsigned char*>(p) - IMAGE_DECODE_HEADER);
+}
+
+
+inline void* image_decode_malloc(size_t size) {
+  ImageDecodeState& state = image_decode_state();
+  if (state.data && !state.claimed && size >= state.min_size && size <= state.capacity) {
+    state.claimed = true;
+    return state.data;
+  }
+  return image_decode_heap_alloc(size);
+}
+
+
+inline void image_decode_free(void* p) {
+  ImageDecodeState& state = image_decode_state();
+  if (p && p == state.data) {
+    state.claimed = false;
+    return;
+  }
+  if (p) image_decode_heap_free(p);
+}
+
+
+// the target can't grow, a buffer that does moves to the heap
+inline void* image_decode_realloc(void* p, size_t size) {
+  ImageDecodeState& state = image_decode_state();
+  if (p && p == state.data) {
+    if (size <= state.capacity) return p;
+
+    void* moved = image_decode_heap_alloc(size);
+    if (moved) {
+      memcpy(moved, p, std::min(size, state.capacity));
+      state.claimed = false;
+    }
+    return moved;
+  }
+  if (!p) return image_decode_heap_alloc(size);
+
+  size_t old_size = image_decode_heap_size(p);
+  unsigned char* block = static_cast<unsigned char*>(
+      realloc(static_cast<unsigned char*>(p) - IMAGE_DECODE_HEADER, size + IMAGE_DECODE_HEADER));
+  if (!block) return nullptr;
+
+  memcpy(block, &size, sizeof(size));
+  state.heap_bytes = state.heap_bytes - std::min(state.heap_bytes, old_size) + size;
+  state.peak_heap_bytes = std::max(state.peak_heap_bytes, state.heap_bytes);
+  return block + IMAGE_DECODE_HEADER;
+}
+
+
+class ImageDecodeTarget {
+public:
+  ImageDecodeTarget(void* data, size_t min_size, size_t capacity) {
+    ImageDecodeState& state = image_decode_state();
+    state.data     = static_cast<unsigned char*>(data);
+    state.min_size = min_size;
+    state.capacity = capacity;
+    state.claimed  = false;
+    state.peak_heap_bytes = heap_base = state.heap_bytes;
+  }
+
+  ImageDecodeTarget(const ImageDecodeTarget&) = delete;
+  ImageDecodeTarget& operator=(const ImageDecodeTarget&) = delete;
+
+  ~ImageDecodeTarget() {
+    ImageDecodeState& state = image_decode_state();
+    size_t heap_bytes = state.heap_bytes;
+    state = ImageDecodeState();
+    state.heap_bytes = heap_bytes;
+  }
+
+
+  bool in_place(const void* pixels) const {
+    return pixels && pixels == image_decode_state().data;
+  }
+
+
+  // not counting what stb_image already held when the target was created
+  size_t peak_heap_bytes() const {
+    return image_decode_state().peak_heap_bytes - heap_base;
+  }
+
+
+private:
+  size_t heap_base = 0;
+};
+
+
+#define STBI_MALLOC(size)       image_decode_malloc(size)
+#define STBI_REALLOC(p, size)   image_decode_realloc(p, size)
+#define STBI_FREE(p)            image_decode_free(p)
+
+#endif
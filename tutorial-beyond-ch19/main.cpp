@@ -111,9 +111,27 @@
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
 
+// stb_image allocates through it, see create_texture_image
+#include "image_decode.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
+#include "deletion_queue.h"
+#include "frame_stats.h"
+#include "gpu_profiler.h"
+#include "gpu_timeline.h"
+#include "memory_allocator.h"
+#include "mesh_cache.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+#include "obj_parallel.h"
+#include "pipeline_cache.h"
+#include "startup_graph.h"
+#include "thread_pool.h"
+#include "uniform_ring.h"
+#include "upload_context.h"
+#include "vertex_dedup.h"
+
 #include <iostream>
 #include <stdexcept>
 #include <functional>
@@ -132,14 +150,50 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <chrono>
 #include <unordered_map>
+#include <cmath>
+#include <iomanip>
+#include <string>
+#include <future>
 
 
 const int WIDTH  = 800;
 const int HEIGHT = 600;
 const int MAX_FRAMES_IN_FLIGHT = 2;
 
+// space for the uniforms of one frame in the uniform ring buffer
+const VkDeviceSize UNIFORM_RING_REGION_SIZE = 1024 * 1024;
+
+// distance between two copies of the model when drawing more than one
+const float DRAW_SPACING = 2.0f;
+const int RECORDING_BENCHMARK_FRAMES = 100;
+// the instancing benchmark goes from 1 to this many instances in powers of 10
+const uint32_t INSTANCING_BENCHMARK_MAX_INSTANCES = 100000;
+const int INSTANCING_BENCHMARK_FRAMES = 100;
+// seconds between two GPU profiler reports in the render loop
+const float GPU_PROFILER_REPORT_INTERVAL = 5.0f;
+// LOD 0 is the model as loaded, every further LOD has about half the
+// triangles of the one before it
+const uint32_t MAX_LODS = 8;
+// the chain stops once simplifying no longer removes this share of the
+// triangles (e.g. because everything left is locked)
+const float LOD_MIN_REDUCTION = 0.1f;
+// the LOD benchmark pulls the camera back by these factors
+const float LOD_BENCHMARK_DISTANCES[] = {1.0f, 2.0f, 4.0f, 8.0f, 16.0f, 32.0f};
+const int LOD_BENCHMARK_FRAMES = 100;
+// the OBJ loading benchmark keeps the fastest of this many loads
+const int OBJ_BENCHMARK_RUNS = 3;
+// the deduplication benchmark runs on the model's corners and on this many
+// copies of them, each referencing its own copy of the positions
+const uint32_t DEDUP_BENCHMARK_COPIES[] = {1, 4, 16};
+const int DEDUP_BENCHMARK_RUNS = 3;
+
 const std::string MODEL_PATH = "models/chalet.obj";
 const std::string TEXTURE_PATH = "textures/chalet.jpg";
+const std::string PIPELINE_CACHE_PATH = "pipeline_cache.bin";
+const std::string MESH_CACHE_PATH = "mesh_cache.bin";
+// part of the mesh cache's options hash, bump it whenever prepare_model
+// produces something different for the same model and options
+const uint32_t MODEL_CACHE_VERSION = 2;
 
 const std::vector<const char*> validation_layers = {
   "VK_LAYER_LUNARG_standard_validation"
@@ -179,20 +233,186 @@ void destroy_debug_report_callback_ext(VkInstance instance,
 }
 
 
+// how the draw list is turned into draw calls
+enum DrawMode {
+  // one vkCmdDrawIndexed per draw, split over the recording threads
+  DRAW_MODE_DIRECT,
+  // a single vkCmdDrawIndexed with instanceCount = number of draws
+  DRAW_MODE_INSTANCED,
+  // a compute pass culls the draws against the view frustum and writes the
+  // draw commands of the visible ones, see record_culling
+  DRAW_MODE_GPU_CULLED
+};
+
+
+// how many depth buffers the framebuffers share
+enum DepthPolicy {
+  // one per swap chain image
+  DEPTH_POLICY_PER_IMAGE,
+  // one for all of them, the render pass makes every frame's depth tests
+  // wait for the previous frame's, see create_render_pass
+  DEPTH_POLICY_SHARED
+};
+
+
+// command line options, see parse_options
+struct AppOptions {
+  // parse the model with obj_parallel::LoadObjParallel instead of LoadObj and
+  // deduplicate its vertices with deduplicate_vertices_parallel
+  bool parallel_obj_loading = true;
+  bool benchmark_obj_loading = false;
+  bool benchmark_dedup = false;
+  // load the processed model from MESH_CACHE_PATH if it is up to date
+  bool use_mesh_cache = true;
+  // let stb_image decode the texture straight into the staging buffer
+  // instead of onto the heap
+  bool decode_texture_in_place = true;
+  // prepare the model and decode the texture on worker threads while the
+  // device is set up, see init_vulkan
+  bool parallel_startup = true;
+  uint32_t draw_count = 1;
+  // 0 means one per hardware thread
+  uint32_t recording_threads = 0;
+  bool benchmark_recording = false;
+  DrawMode draw_mode = DRAW_MODE_DIRECT;
+  bool benchmark_instancing = false;
+  // reorder the model's triangles and vertices for the post-transform cache
+  bool optimize_mesh = true;
+  // upload the model as PackedVertex instead of Vertex
+  bool packed_vertices = false;
+  // keep the 32-bit indices instead of splitting the model into sub-meshes
+  // with 16-bit ones
+  bool uint32_indices = false;
+  // build a chain of simplified versions of the model and draw the coarsest
+  // one whose error stays below lod_error_pixels on screen
+  bool generate_lods = true;
+  float lod_error_pixels = 1.0f;
+  bool benchmark_lod = false;
+
+  // render into offscreen images instead of a window, no GLFW, surface or
+  // swap chain involved
+  bool headless = false;
+  uint32_t headless_frames = 100;
+  // written after the last headless frame if not empty
+  std::string screenshot_path;
+  // GPU scope timings are dumped here as JSON at exit if not empty
+  std::string gpu_profile_path;
+  // per frame CPU timings are dumped here as CSV at exit if not empty
+  std::string frame_stats_path;
+  // used if the surface supports it, otherwise MAILBOX > IMMEDIATE > FIFO
+  std::string present_mode;
+  DepthPolicy depth_policy = DEPTH_POLICY_SHARED;
+  // track GPU progress with a timeline semaphore if the device has
+  // VK_KHR_timeline_semaphore, otherwise with fences
+  bool timeline_semaphore = true;
+};
+
+
+// one entry of the draw list, every draw renders the model at its own
+// position
+struct DrawItem {
+  glm::vec3 position;
+};
+
+
+// model is shared by every instance and applied before the instance's own
+// transform
 struct UniformBufferObject {
   glm::mat4 model;
   glm::mat4 view;
   glm::mat4 proj;
+  // attribute = stored * scale + offset, the identity for float vertices
+  glm::vec4 position_scale;
+  glm::vec4 position_offset;
+  // xy scale, zw offset
+  glm::vec4 tex_coord_transform;
+};
+
+
+// one per entry of the draw list in the instance storage buffer, laid out
+// like the std430 InstanceBuffer in shader.vert
+struct InstanceData {
+  glm::mat4 model;
+};
+
+
+// input of the culling pass, laid out like CullUniforms in cull.comp
+struct CullUniforms {
+  // shared model matrix, applied before the instance transform
+  glm::mat4 model;
+  // world space, xyz is the inward facing normal and w the distance
+  glm::vec4 frustum_planes[6];
+  // model space bounding sphere of the mesh, xyz center and w radius
+  glm::vec4 bounds;
+  // xyz world space camera position, w the LOD scale (see select_lod)
+  glm::vec4 camera;
+  // x first sub-mesh and y sub-mesh count of every LOD
+  glm::uvec4 lod_ranges[MAX_LODS];
+  // x error of every LOD
+  glm::vec4 lod_errors[MAX_LODS];
+  uint32_t draw_count;
+  uint32_t lod_count;
+};
+
+
+// one level of detail of the model, a range of the sub-mesh list. all LODs
+// share the vertex buffer, see build_lods and split_model
+struct MeshLod {
+  uint32_t first_submesh  = 0;
+  uint32_t submesh_count  = 0;
+  // range of the LOD in indices before split_model
+  uint32_t first_index    = 0;
+  uint32_t index_count    = 0;
+  // how far (in model units) the surface may be from LOD 0's
+  float error             = 0.0f;
+};
+
+
+// the sections of the mesh cache, see save_mesh_cache
+enum ModelCacheSection {
+  MODEL_CACHE_VERTICES,
+  MODEL_CACHE_INDICES,
+  MODEL_CACHE_SUBMESHES,
+  MODEL_CACHE_LODS,
+  MODEL_CACHE_PARAMS,
+  MODEL_CACHE_SECTION_COUNT
+};
+
+
+// everything else the renderer needs from the processed model
+struct ModelCacheParams {
+  glm::vec4 bounds;
+  glm::vec4 position_scale;
+  glm::vec4 position_offset;
+  glm::vec4 tex_coord_transform;
+  uint32_t vertex_count;
+  uint32_t index_type;
+};
+
+
+// what select_lod needs to know about the frame being recorded
+struct LodSelection {
+  glm::vec3 camera;
+  // world space center of the bounding sphere of the draw at the origin
+  glm::vec3 center;
+  float radius;
+  float scale;
 };
 
+
+// the indirect buffer starts with the number of draws the culling pass wrote,
+// padded so the VkDrawIndexedIndirectCommand array after it stays aligned
+const VkDeviceSize INDIRECT_COMMANDS_OFFSET = 16;
+const uint32_t CULL_WORKGROUP_SIZE = 64;
+
+// the model is textured, a per vertex color would always be white
 struct Vertex {
   glm::vec3 pos;
-  glm::vec3 color;
   glm::vec2 tex_coord;
 
 
   bool operator==(const Vertex& other) const {
-    return pos == other.pos && color == other.color && tex_coord == other.tex_coord;
+    return pos == other.pos && tex_coord == other.tex_coord;
   }
 
 
@@ -208,10 +428,10 @@ struct Vertex {
 
   // an attribute descriptions describes how to extract a vertex attribute from
   // a chunk of vertex information
-  // we have position and color to worry about and so we accordingly need two
-  // of these structs
-  static std::array<VkVertexInputAttributeDescription, 3> get_attribute_descriptions() {
-    std::array<VkVertexInputAttributeDescription, 3> attribute_descriptions = {};
+  // we have position and texture coordinate to worry about and so we
+  // accordingly need two of these structs
+  static std::array<VkVertexInputAttributeDescription, 2> get_attribute_descriptions() {
+    std::array<VkVertexInputAttributeDescription, 2> attribute_descriptions = {};
     // whcih binding the per-vertex information data comes
     attribute_descriptions[0].binding  = 0;
     // references the location directive of the input in the vertex shader
@@ -224,13 +444,47 @@ struct Vertex {
 
     attribute_descriptions[1].binding  = 0;
     attribute_descriptions[1].location = 1;
-    attribute_descriptions[1].format   = VK_FORMAT_R32G32B32_SFLOAT;
-    attribute_descriptions[1].offset   = offsetof(Vertex, color);
+    attribute_descriptions[1].format   = VK_FORMAT_R32G32_SFLOAT;
+    attribute_descriptions[1].offset   = offsetof(Vertex, tex_coord);
+
+    return attribute_descriptions;
+  }
+};
+
+
+// the --packed-vertices layout, 12 bytes instead of 20. position and
+// texture coordinate are stored as 16-bit unorm within the bounds of the
+// mesh, UNORM formats reach the shader as [0, 1] floats and shader.vert maps
+// them back with the position/tex_coord transforms in UniformBufferObject
+struct PackedVertex {
+  // xyz, 3 component 16-bit formats are rarely supported for vertex input so
+  // w is padding
+  uint16_t pos[4];
+  uint16_t tex_coord[2];
+
+
+  static VkVertexInputBindingDescription get_binding_description() {
+    VkVertexInputBindingDescription binding_description = {};
+    binding_description.binding = 0;
+    binding_description.stride = sizeof(PackedVertex);
+    binding_description.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
-    attribute_descriptions[2].binding  = 0;
-    attribute_descriptions[2].location = 2;
-    attribute_descriptions[2].format   = VK_FORMAT_R32G32_SFLOAT;
-    attribute_descriptions[2].offset   = offsetof(Vertex, tex_coord);
+    return binding_description;
+  }
+
+
+  // same locations as Vertex, only the formats differ
+  static std::array<VkVertexInputAttributeDescription, 2> get_attribute_descriptions() {
+    std::array<VkVertexInputAttributeDescription, 2> attribute_descriptions = {};
+    attribute_descriptions[0].binding  = 0;
+    attribute_descriptions[0].location = 0;
+    attribute_descriptions[0].format   = VK_FORMAT_R16G16B16A16_UNORM;
+    attribute_descriptions[0].offset   = offsetof(PackedVertex, pos);
+
+    attribute_descriptions[1].binding  = 0;
+    attribute_descriptions[1].location = 1;
+    attribute_descriptions[1].format   = VK_FORMAT_R16G16_UNORM;
+    attribute_descriptions[1].offset   = offsetof(PackedVertex, tex_coord);
 
     return attribute_descriptions;
   }
@@ -238,11 +492,11 @@ struct Vertex {
 
 
 // CRAZY JUJU HERE
+// only the baseline of benchmark_dedup still hashes whole vertices
 namespace std {
   template <> struct hash<Vertex> {
     size_t operator()(Vertex const& vertex) const {
-      return ((hash<glm::vec3>()(vertex.pos) ^
-             (hash<glm::vec3>()(vertex.color) << 1)) >> 1) ^
+      return (hash<glm::vec3>()(vertex.pos) >> 1) ^
              (hash<glm::vec2>()(vertex.tex_coord) << 1);
     }
   };
@@ -259,6 +513,8 @@ struct SwapChainSupportDetails {
 struct QueueFamilyIndices {
   int graphics_family = -1;
   int present_family  = -1;
+  // a transfer-only family if the device has one, otherwise graphics_family
+  int transfer_family = -1;
 
   bool is_complete() {
     return graphics_family >= 0 && present_family >= 0;
@@ -268,16 +524,42 @@ struct QueueFamilyIndices {
 
 class HelloTriangleApplication {
 public:
-  void run()
+  void run(const AppOptions& options)
   {
-    init_window();
+    this->options = options;
+
+    // needs no window or device
+    if (options.benchmark_obj_loading) {
+      benchmark_obj_loading();
+      return;
+    }
+    if (options.benchmark_dedup) {
+      benchmark_dedup();
+      return;
+    }
+
+    if (!options.headless) {
+      init_window();
+    }
     init_vulkan();
-    main_loop();
+    if (options.benchmark_recording) {
+      benchmark_recording();
+    } else if (options.benchmark_instancing) {
+      benchmark_instancing();
+    } else if (options.benchmark_lod) {
+      benchmark_lod();
+    } else if (options.headless) {
+      run_headless();
+    } else {
+      main_loop();
+    }
     cleanup();
   }
 
 
 private:
+  AppOptions options;
+
   GLFWwindow* window;
   VkInstance instance;
   VkDebugReportCallbackEXT callback;
@@ -286,13 +568,21 @@ private:
   VkPhysicalDevice physical_device = VK_NULL_HANDLE;
   VkDevice device;
 
+  MemoryAllocator allocator;
+
   VkQueue graphics_queue;
   VkQueue present_queue;
+  VkQueue transfer_queue;
+
+  UploadContext upload_context;
 
   VkSwapchainKHR swap_chain;
+  // in headless mode these are offscreen images owned by the application
   std::vector<VkImage> swap_chain_images;
+  std::vector<Allocation> offscreen_images_memory;
   VkFormat swap_chain_image_format;
   VkExtent2D swap_chain_extent;
+  VkPresentModeKHR swap_chain_present_mode;
   std::vector<VkImageView> swap_chain_image_views;
   std::vector<VkFramebuffer> swap_chain_framebuffers;
 
@@ -300,38 +590,147 @@ private:
   VkDescriptorSetLayout descriptor_set_layout;
   VkPipelineLayout pipeline_layout;
   VkPipeline graphics_pipeline;
+  PipelineCache pipeline_cache;
+
+  // command buffers are recorded again every frame. each recording thread
+  // has its own command pool (pools must not be used by two threads at once)
+  // and records one secondary command buffer for its part of the draw list,
+  // the primary command buffer only executes them. everything is per frame in
+  // flight and reset as a whole once that frame has finished (wait_for_frame)
+  struct FrameCommands {
+    VkCommandPool primary_pool;
+    VkCommandBuffer primary;
+    std::vector<VkCommandPool> secondary_pools;
+    std::vector<VkCommandBuffer> secondaries;
+  };
 
-  VkCommandPool command_pool;
-  std::vector<VkCommandBuffer> command_buffers;
+  ThreadPool recording_threads;
+  std::vector<FrameCommands> frame_commands;
+  // decodes reloaded textures, kept apart from recording_threads whose
+  // parallel_for would otherwise wait for a decode in the middle of a frame
+  ThreadPool texture_threads;
+
+  GpuProfiler gpu_profiler;
+
+  FrameStats frame_stats;
+  std::chrono::high_resolution_clock::time_point last_frame_start;
+
+  std::vector<DrawItem> draws;
+  // the first draw_count entries of draws are rendered
+  uint32_t draw_count = 0;
+  DrawMode draw_mode = DRAW_MODE_DIRECT;
+  VkBuffer instance_buffer;
+  Allocation instance_buffer_memory;
+  glm::vec4 model_bounds;
+  // dequantization of the vertex buffer, see PackedVertex
+  glm::vec4 position_scale      = glm::vec4(1.0f);
+  glm::vec4 position_offset     = glm::vec4(0.0f);
+  glm::vec4 tex_coord_transform = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f);
+
+  // GPU culling, one indirect buffer and descriptor set per frame in flight
+  // only created when culling_enabled(), null otherwise
+  VkDescriptorSetLayout cull_descriptor_set_layout = VK_NULL_HANDLE;
+  VkPipelineLayout cull_pipeline_layout = VK_NULL_HANDLE;
+  VkPipeline cull_pipeline = VK_NULL_HANDLE;
+  VkDescriptorPool cull_descriptor_pool = VK_NULL_HANDLE;
+  std::vector<VkDescriptorSet> cull_descriptor_sets;
+  std::vector<VkBuffer> indirect_buffers;
+  std::vector<Allocation> indirect_buffers_memory;
+  // firstInstance of an indirect draw must be 0 without this
+  bool supports_gpu_culling = false;
+  // null without VK_KHR_draw_indirect_count
+  PFN_vkCmdDrawIndexedIndirectCountKHR cmd_draw_indexed_indirect_count = nullptr;
+  // 1 without the multiDrawIndirect feature
+  uint32_t max_draw_indirect_count = 1;
 
   std::vector<VkSemaphore> image_available_semaphores;
   std::vector<VkSemaphore> render_finished_semaphores;
-  std::vector<VkFence> in_flight_fences;
   size_t current_frame = 0;
+  // every submission to the graphics queue, frames and uploads alike
+  GpuTimeline gpu_timeline;
+  // enabled in create_logical_device if the device supports it
+  bool has_timeline_semaphore = false;
+  // enabled in get_required_extensions if the instance supports it, the
+  // timeline semaphore extension requires it on a Vulkan 1.0 instance
+  bool has_physical_device_properties2 = false;
+  // the timeline value of the last submission of each frame in flight, its
+  // command buffers and uniform region are free again once it is reached
+  std::array<uint64_t, MAX_FRAMES_IN_FLIGHT> frame_values = {};
+  // objects retired while submissions that use them may still be running,
+  // keyed on timeline values
+  DeletionQueue deletion_queue;
   
   bool framebuffer_resized = false;
+  // set by pressing T, see start_texture_reload
+  bool texture_reload_requested = false;
+  // valid while a reloaded texture is being decoded into texture_upload
+  std::future<void> texture_decode;
+  std::chrono::high_resolution_clock::time_point texture_reload_start;
+  // the frame_values entry of the last frame before the last reload
+  uint64_t texture_reload_frame = 0;
 
   std::vector<Vertex> vertices;
   std::vector<uint32_t> indices;
+  // what gets uploaded unless --uint32-indices is given, see split_model
+  std::vector<uint16_t> indices16;
+  VkIndexType index_type = VK_INDEX_TYPE_UINT16;
+  // only filled with --packed-vertices
+  std::vector<PackedVertex> packed_vertices;
+  // what create_vertex_buffer and create_index_buffer upload: the arrays
+  // above or, on a warm start, sections of the mesh cache
+  const void* vertex_data = nullptr;
+  VkDeviceSize vertex_data_size = 0;
+  uint32_t vertex_count = 0;
+  const void* index_data = nullptr;
+  VkDeviceSize index_data_size = 0;
+  // keeps the sections mapped until they have been copied
+  MeshCache mesh_cache;
+  // the model is drawn with one draw call per sub-mesh of the selected LOD
+  std::vector<SubMesh> submeshes;
+  std::vector<MeshLod> lods;
+  // multiplies the camera distance, used by the LOD benchmark
+  float camera_distance_scale = 1.0f;
+  // of the frame recorded last
+  LodSelection last_lod_selection;
+  VkBuffer submesh_buffer;
+  Allocation submesh_buffer_memory;
 
   VkBuffer vertex_buffer;
-  VkDeviceMemory vertex_buffer_memory;
+  Allocation vertex_buffer_memory;
   VkBuffer index_buffer;
-  VkDeviceMemory index_buffer_memory;
+  Allocation index_buffer_memory;
 
-  std::vector<VkBuffer> uniform_buffers;
-  std::vector<VkDeviceMemory> uniform_buffers_memory;
+  VkBuffer uniform_buffer;
+  Allocation uniform_buffer_memory;
+  UniformRing uniform_ring;
 
   VkDescriptorPool descriptor_pool;
-  std::vector<VkDescriptorSet> descriptor_sets;
-
+  VkDescriptorSet descriptor_set;
+
+  // level 0 of the texture on its way to texture_image, see
+  // create_texture_staging
+  struct TextureUpload {
+    int width  = 0;
+    int height = 0;
+    VkDeviceSize size = 0;
+    bool decode_in_place = false;
+    VkBuffer staging_buffer;
+    Allocation staging_buffer_memory;
+    // set by decode_texture
+    bool in_place   = false;
+    float decode_ms = 0.0f;
+    // most heap memory stb_image held at once during the decode
+    size_t decode_heap_bytes = 0;
+  } texture_upload;
+
+  uint32_t mip_levels;
   VkImage texture_image;
-  VkDeviceMemory texture_image_memory;
+  Allocation texture_image_memory;
   VkImageView texture_image_view;
   VkSampler texture_sampler;
 
   std::vector<VkImage> depth_images;
-  std::vector<VkDeviceMemory> depth_images_memory;
+  std::vector<Allocation> depth_images_memory;
   std::vector<VkImageView> depth_images_view;
 
 
@@ -343,6 +742,7 @@ private:
     window = glfwCreateWindow(WIDTH, HEIGHT, "vulkan", nullptr, nullptr);
     glfwSetWindowUserPointer(window, this);
     glfwSetFramebufferSizeCallback(window, framebuffer_resize_callback);
+    glfwSetKeyCallback(window, key_callback);
   }
 
 
@@ -351,42 +751,244 @@ private:
     app->framebuffer_resized = true;
   }
 
+
+  static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+    auto app = reinterpret_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window));
+    if (key == GLFW_KEY_T && action == GLFW_PRESS) {
+      app->texture_reload_requested = true;
+    }
+  }
+
   
+  // the steps run in order on the main thread, the two CPU heavy asset tasks
+  // run next to them and are joined right before their results are used
   void init_vulkan() {
-    create_instance();
-    setup_debug_callback();
-    create_surface();
-    pick_physical_device();
-    create_logical_device();
-    create_swap_chain();
-    create_image_views();
-    create_render_pass();
-    create_descriptor_set_layout();
-    create_graphics_pipeline();
-    create_command_pool();
-    create_depth_resources();
-    create_framebuffers();
-    create_texture_image();
-    create_texture_image_view();
-    create_texture_sampler();
-    load_model();
-    create_vertex_buffer();
-    create_index_buffer();
-    create_uniform_buffers();
-    create_descriptor_pool();
-    create_descriptor_sets();
-    create_command_buffers();
-    create_sync_objects();
+    StartupGraph startup(options.parallel_startup);
+
+    // the model needs nothing from Vulkan. its deduplication runs on the
+    // recording threads, which have nothing else to do until the first frame
+    recording_threads.init(options.recording_threads);
+    texture_threads.init(1);
+    StartupTask model = startup.launch("prepare_model", [this] { prepare_model(); });
+
+    startup.step("create_instance", [this] { create_instance(); });
+    startup.step("setup_debug_callback", [this] { setup_debug_callback(); });
+    if (!options.headless) {
+      startup.step("create_surface", [this] { create_surface(); });
+    }
+    startup.step("pick_physical_device", [this] { pick_physical_device(); });
+    startup.step("create_logical_device", [this] { create_logical_device(); });
+
+    // the texture is decoded straight into its staging buffer, which only
+    // needs the allocator
+    startup.step("create_texture_staging", [this] { create_texture_staging(); });
+    StartupTask texture = startup.launch("decode_texture", [this] { decode_texture(); });
+
+    if (options.headless) {
+      startup.step("create_offscreen_targets", [this] { create_offscreen_targets(); });
+    } else {
+      startup.step("create_swap_chain", [this] { create_swap_chain(); });
+    }
+    startup.step("create_image_views", [this] { create_image_views(); });
+    startup.step("create_render_pass", [this] { create_render_pass(); });
+    startup.step("create_descriptor_set_layout", [this] { create_descriptor_set_layout(); });
+    startup.step("create_pipeline_cache", [this] { create_pipeline_cache(); });
+    startup.step("create_graphics_pipeline", [this] { create_graphics_pipeline(); });
+    startup.step("create_command_pools", [this] { create_command_pools(); });
+    startup.step("create_gpu_timeline", [this] { create_gpu_timeline(); });
+    startup.step("create_upload_context", [this] { create_upload_context(); });
+    startup.step("create_depth_resources", [this] { create_depth_resources(); });
+    startup.step("create_framebuffers", [this] { create_framebuffers(); });
+
+    startup.join(texture);
+    startup.step("create_texture_image", [this] { create_texture_image(); });
+    startup.step("create_texture_image_view", [this] { create_texture_image_view(); });
+    startup.step("create_texture_sampler", [this] { create_texture_sampler(); });
+
+    startup.join(model);
+    startup.step("create_draw_list", [this] { create_draw_list(); });
+    startup.step("create_vertex_buffer", [this] { create_vertex_buffer(); });
+    startup.step("create_index_buffer", [this] { create_index_buffer(); });
+    // both are in staging memory now
+    mesh_cache.close();
+    startup.step("create_instance_buffer", [this] { create_instance_buffer(); });
+    // everything above only recorded its copies, kick them off in one batch
+    // and carry on without waiting for them
+    startup.step("submit uploads", [this] { upload_context.submit(); });
+    startup.step("create_uniform_buffers", [this] { create_uniform_buffers(); });
+    startup.step("create_descriptor_pool", [this] { create_descriptor_pool(); });
+    startup.step("create_descriptor_sets", [this] { create_descriptor_sets(); });
+    if (culling_enabled()) {
+      startup.step("create_culling_resources", [this] { create_culling_resources(); });
+    }
+    startup.step("create_command_buffers", [this] { create_command_buffers(); });
+    startup.step("create_sync_objects", [this] { create_sync_objects(); });
+    startup.step("create_gpu_profiler", [this] { create_gpu_profiler(); });
+
+    startup.print_timeline(std::cout);
+    allocator.print_stats(std::cout);
   }
 
 
   void main_loop() {
+    auto last_report = std::chrono::high_resolution_clock::now();
+
     while (!glfwWindowShouldClose(window)) {
       glfwPollEvents();
       draw_frame();
+      upload_context.collect();
+      // the decode runs on a worker, only the swap happens here
+      if (texture_reload_requested && !texture_decode.valid()) {
+        texture_reload_requested = false;
+        start_texture_reload();
+      }
+      // at most one reload per frame, so no more sets are retired than
+      // there are frames in flight
+      uint64_t last_frame = frame_values[(current_frame + MAX_FRAMES_IN_FLIGHT - 1) % MAX_FRAMES_IN_FLIGHT];
+      if (texture_decode.valid() && last_frame > texture_reload_frame &&
+          texture_decode.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        texture_reload_frame = last_frame;
+        reload_texture();
+      }
+
+      auto now = std::chrono::high_resolution_clock::now();
+      if (std::chrono::duration<float>(now - last_report).count() >= GPU_PROFILER_REPORT_INTERVAL) {
+        gpu_profiler.print_stats(std::cout);
+        last_report = now;
+      }
     }
 
     vkDeviceWaitIdle(device);
+
+    // a reload still being decoded is dropped
+    if (texture_decode.valid()) {
+      texture_decode.wait();
+      vkDestroyBuffer(device, texture_upload.staging_buffer, nullptr);
+      allocator.free(texture_upload.staging_buffer_memory);
+    }
+  }
+
+
+  // a warm start takes the processed model from the mesh cache and skips
+  // everything else, a cold start builds it from MODEL_PATH and saves it
+  void prepare_model() {
+    if (options.use_mesh_cache && load_mesh_cache()) return;
+
+    auto start_time = std::chrono::high_resolution_clock::now();
+    load_model();
+    build_lods();
+    optimize_model();
+    split_model();
+    select_model_data();
+    float prepare_ms = std::chrono::duration<float, std::chrono::milliseconds::period>(
+        std::chrono::high_resolution_clock::now() - start_time).count();
+    std::cout << "model: prepared in " << std::fixed << std::setprecision(1) << prepare_ms << " ms (cold start)"
+              << std::defaultfloat << std::endl;
+
+    if (options.use_mesh_cache) save_mesh_cache();
+  }
+
+
+  // everything that changes what prepare_model produces from the same file
+  uint64_t mesh_cache_options_hash() {
+    uint32_t lod_min_reduction;
+    memcpy(&lod_min_reduction, &LOD_MIN_REDUCTION, sizeof(lod_min_reduction));
+    uint32_t inputs[] = {
+      MODEL_CACHE_VERSION, options.optimize_mesh, options.generate_lods, options.packed_vertices,
+      options.uint32_indices, MAX_LODS, lod_min_reduction,
+      sizeof(Vertex), sizeof(PackedVertex), sizeof(SubMesh), sizeof(MeshLod), sizeof(ModelCacheParams)
+    };
+    return hash_bytes(inputs, sizeof(inputs));
+  }
+
+
+  bool load_mesh_cache() {
+    auto start_time = std::chrono::high_resolution_clock::now();
+    if (!mesh_cache.open(MESH_CACHE_PATH, MODEL_PATH, mesh_cache_options_hash())) {
+      return false;
+    }
+    if (mesh_cache.section_count() != MODEL_CACHE_SECTION_COUNT ||
+        mesh_cache.section_size(MODEL_CACHE_PARAMS) != sizeof(ModelCacheParams)) {
+      std::cout << "mesh cache: " << MESH_CACHE_PATH << " not used, unexpected sections" << std::endl;
+      mesh_cache.close();
+      return false;
+    }
+
+    ModelCacheParams params;
+    memcpy(&params, mesh_cache.section(MODEL_CACHE_PARAMS), sizeof(params));
+    model_bounds        = params.bounds;
+    position_scale      = params.position_scale;
+    position_offset     = params.position_offset;
+    tex_coord_transform = params.tex_coord_transform;
+    vertex_count        = params.vertex_count;
+    index_type          = static_cast<VkIndexType>(params.index_type);
+
+    // small enough to copy, the renderer keeps using them
+    auto first_submesh = static_cast<const SubMesh*>(mesh_cache.section(MODEL_CACHE_SUBMESHES));
+    submeshes.assign(first_submesh, first_submesh + mesh_cache.section_size(MODEL_CACHE_SUBMESHES) / sizeof(SubMesh));
+    auto first_lod = static_cast<const MeshLod*>(mesh_cache.section(MODEL_CACHE_LODS));
+    lods.assign(first_lod, first_lod + mesh_cache.section_size(MODEL_CACHE_LODS) / sizeof(MeshLod));
+
+    // the big ones stay in the mapping until they are copied to staging
+    vertex_data      = mesh_cache.section(MODEL_CACHE_VERTICES);
+    vertex_data_size = mesh_cache.section_size(MODEL_CACHE_VERTICES);
+    index_data       = mesh_cache.section(MODEL_CACHE_INDICES);
+    index_data_size  = mesh_cache.section_size(MODEL_CACHE_INDICES);
+
+    float load_ms = std::chrono::duration<float, std::chrono::milliseconds::period>(
+        std::chrono::high_resolution_clock::now() - start_time).count();
+    std::cout << "model: " << MESH_CACHE_PATH << " loaded in " << std::fixed << std::setprecision(1) << load_ms
+              << " ms (warm start), " << lods.size() << (lods.size() == 1 ? " level, " : " levels, ")
+              << submeshes.size() << (submeshes.size() == 1 ? " sub-mesh" : " sub-meshes") << std::defaultfloat
+              << std::endl;
+    return true;
+  }
+
+
+  void save_mesh_cache() {
+    ModelCacheParams params = {};
+    params.bounds              = model_bounds;
+    params.position_scale      = position_scale;
+    params.position_offset     = position_offset;
+    params.tex_coord_transform = tex_coord_transform;
+    params.vertex_count        = vertex_count;
+    params.index_type          = static_cast<uint32_t>(index_type);
+
+    std::vector<MeshCacheBlob> sections(MODEL_CACHE_SECTION_COUNT);
+    sections[MODEL_CACHE_VERTICES]  = MeshCacheBlob{vertex_data, static_cast<size_t>(vertex_data_size)};
+    sections[MODEL_CACHE_INDICES]   = MeshCacheBlob{index_data, static_cast<size_t>(index_data_size)};
+    sections[MODEL_CACHE_SUBMESHES] = MeshCacheBlob{submeshes.data(), sizeof(SubMesh) * submeshes.size()};
+    sections[MODEL_CACHE_LODS]      = MeshCacheBlob{lods.data(), sizeof(MeshLod) * lods.size()};
+    sections[MODEL_CACHE_PARAMS]    = MeshCacheBlob{&params, sizeof(params)};
+
+    if (MeshCache::write(MESH_CACHE_PATH, MODEL_PATH, mesh_cache_options_hash(), sections)) {
+      std::cout << "mesh cache: saved to " << MESH_CACHE_PATH << std::endl;
+    } else {
+      std::cout << "mesh cache: could not write " << MESH_CACHE_PATH << std::endl;
+    }
+  }
+
+
+  // picks the arrays that end up in the vertex and index buffers, packing
+  // the vertices first with --packed-vertices
+  void select_model_data() {
+    if (options.packed_vertices) {
+      packed_vertices  = pack_vertices();
+      vertex_data      = packed_vertices.data();
+      vertex_data_size = sizeof(PackedVertex) * packed_vertices.size();
+    } else {
+      vertex_data      = vertices.data();
+      vertex_data_size = sizeof(Vertex) * vertices.size();
+    }
+    vertex_count = static_cast<uint32_t>(vertices.size());
+
+    if (index_type == VK_INDEX_TYPE_UINT16) {
+      index_data      = indices16.data();
+      index_data_size = sizeof(uint16_t) * indices16.size();
+    } else {
+      index_data      = indices.data();
+      index_data_size = sizeof(uint32_t) * indices.size();
+    }
   }
 
 
@@ -396,103 +998,351 @@ private:
     std::vector<tinyobj::material_t> materials;
     std::string err;
 
-    if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &err, MODEL_PATH.c_str())) {
+    auto start_time = std::chrono::high_resolution_clock::now();
+    bool loaded = options.parallel_obj_loading ?
+        obj_parallel::LoadObjParallel(&attrib, &shapes, &materials, &err, MODEL_PATH.c_str()) :
+        tinyobj::LoadObj(&attrib, &shapes, &materials, &err, MODEL_PATH.c_str());
+    if (!loaded) {
       throw std::runtime_error(err);
     }
+    float load_ms = std::chrono::duration<float, std::chrono::milliseconds::period>(
+        std::chrono::high_resolution_clock::now() - start_time).count();
+    std::cout << "model: " << MODEL_PATH << " parsed in " << std::fixed << std::setprecision(1) << load_ms
+              << " ms (" << (options.parallel_obj_loading ? "parallel" : "serial") << ")" << std::defaultfloat
+              << std::endl;
+
+    // corners with the same position and texture coordinate indices become
+    // one vertex, the file's normals aren't used
+    start_time = std::chrono::high_resolution_clock::now();
+    std::vector<uint64_t> keys = corner_keys(shapes);
+    std::vector<uint32_t> first_corners;
+    if (options.parallel_obj_loading) {
+      deduplicate_vertices_parallel(recording_threads, keys, indices, first_corners);
+    } else {
+      deduplicate_vertices(keys, indices, first_corners);
+    }
+
+    vertices.resize(first_corners.size());
+    for (size_t v = 0; v < vertices.size(); v++) {
+      vertices[v] = corner_vertex(attrib, keys[first_corners[v]]);
+    }
+    float dedup_ms = std::chrono::duration<float, std::chrono::milliseconds::period>(
+        std::chrono::high_resolution_clock::now() - start_time).count();
+    std::cout << "model: " << keys.size() << " corners -> " << vertices.size() << " vertices in " << std::fixed
+              << std::setprecision(1) << dedup_ms << " ms" << std::defaultfloat << std::endl;
+
+    compute_model_bounds();
+  }
 
-    std::unordered_map<Vertex, uint32_t> unique_vertices = {};
 
+  // the position and texture coordinate indices of every face corner, see
+  // vertex_key
+  static std::vector<uint64_t> corner_keys(const std::vector<tinyobj::shape_t>& shapes) {
+    size_t corner_count = 0;
+    for (const auto& shape : shapes) corner_count += shape.mesh.indices.size();
+
+    std::vector<uint64_t> keys;
+    keys.reserve(corner_count);
     for (const auto& shape : shapes) {
       for (const auto& index : shape.mesh.indices) {
-        Vertex vertex = {};
+        keys.push_back(vertex_key(index.vertex_index, index.texcoord_index));
+      }
+    }
+    return keys;
+  }
 
-        vertex.pos = {
-          attrib.vertices[3 * index.vertex_index + 0],
-          attrib.vertices[3 * index.vertex_index + 1],
-          attrib.vertices[3 * index.vertex_index + 2]
-        };
 
-        vertex.tex_coord = {
-          attrib.texcoords[2 * index.texcoord_index + 0],
-          1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
-        };
+  static Vertex corner_vertex(const tinyobj::attrib_t& attrib, uint64_t key) {
+    uint32_t position_index  = static_cast<uint32_t>(key >> 32);
+    uint32_t tex_coord_index = static_cast<uint32_t>(key);
 
-        vertex.color = {1.0f, 1.0f, 1.0f};
+    Vertex vertex = {};
 
-        if (unique_vertices.count(vertex) == 0) {
-          unique_vertices[vertex] = static_cast<uint32_t>(vertices.size());
-          vertices.push_back(vertex);
-        }
+    vertex.pos = {
+      attrib.vertices[3 * position_index + 0],
+      attrib.vertices[3 * position_index + 1],
+      attrib.vertices[3 * position_index + 2]
+    };
+
+    vertex.tex_coord = {
+      attrib.texcoords[2 * tex_coord_index + 0],
+      1.0f - attrib.texcoords[2 * tex_coord_index + 1]
+    };
+
+    return vertex;
+  }
+
+
+  // simplifies every LOD into the next one until MAX_LODS is reached or it
+  // stops paying off. the simplifier only ever moves vertices onto existing
+  // ones, so every LOD indexes a subset of LOD 0's vertices and the LODs are
+  // appended to indices one after the other. with 16-bit indices split_model
+  // still has to give a coarse triangle whose corners end up in different
+  // sub-meshes of LOD 0 vertices of its own
+  void build_lods() {
+    MeshLod full;
+    full.index_count = static_cast<uint32_t>(indices.size());
+    lods.assign(1, full);
+    if (!options.generate_lods) return;
+
+    auto start_time = std::chrono::high_resolution_clock::now();
+    std::vector<uint32_t> previous = indices;
+    while (lods.size() < MAX_LODS) {
+      float error = 0.0f;
+      std::vector<uint32_t> simplified = simplify_mesh(vertices, previous, previous.size() / 2, &error);
+      if (simplified.empty() || simplified.size() > previous.size() * (1.0f - LOD_MIN_REDUCTION)) {
+        break;
+      }
+
+      MeshLod lod;
+      lod.first_index = static_cast<uint32_t>(indices.size());
+      lod.index_count = static_cast<uint32_t>(simplified.size());
+      // each LOD is simplified from the previous one, so its distance to
+      // LOD 0 is at most the sum of the errors along the way
+      lod.error = lods.back().error + error;
+      lods.push_back(lod);
+
+      indices.insert(indices.end(), simplified.begin(), simplified.end());
+      previous.swap(simplified);
+    }
+
+    float build_ms = std::chrono::duration<float, std::chrono::milliseconds::period>(
+        std::chrono::high_resolution_clock::now() - start_time).count();
+
+    std::cout << "lod chain: " << lods.size() << " levels in " << std::fixed << std::setprecision(1)
+              << build_ms << " ms" << std::endl;
+    for (size_t i = 0; i < lods.size(); i++) {
+      std::cout << "  lod " << i << ": " << std::setw(8) << lods[i].index_count / 3 << " triangles, error "
+                << std::setprecision(5) << lods[i].error << std::setprecision(1) << std::endl;
+    }
+    std::cout << std::defaultfloat;
+  }
+
+
+  // runs after the deduplication in load_model, the triangles and vertices
+  // are only reordered so the model renders exactly as before. every LOD is
+  // reordered for the vertex cache on its own, the vertex buffer then follows
+  // the order of first use across all of them. that is LOD 0's order, the
+  // coarser LODs use a subset of its vertices
+  void optimize_model() {
+    if (!options.optimize_mesh) return;
+
+    auto lod_indices = [this](const MeshLod& lod) {
+      return std::vector<uint32_t>(indices.begin() + lod.first_index,
+          indices.begin() + lod.first_index + lod.index_count);
+    };
+
+    auto start_time = std::chrono::high_resolution_clock::now();
+    VertexCacheStats before = analyze_vertex_cache(lod_indices(lods[0]), vertices.size());
+
+    for (const auto& lod : lods) {
+      std::vector<uint32_t> optimized = lod_indices(lod);
+      optimize_vertex_cache(optimized, vertices.size());
+      std::copy(optimized.begin(), optimized.end(), indices.begin() + lod.first_index);
+    }
+    optimize_vertex_fetch(vertices, indices);
+
+    VertexCacheStats after = analyze_vertex_cache(lod_indices(lods[0]), vertices.size());
+    float optimize_ms = std::chrono::duration<float, std::chrono::milliseconds::period>(
+        std::chrono::high_resolution_clock::now() - start_time).count();
+
+    std::cout << "mesh optimizer: " << (lods.size() > 1 ? "lod 0 " : "") << lods[0].index_count / 3
+              << " triangles, " << vertices.size() << " vertices in " << std::fixed << std::setprecision(1)
+              << optimize_ms << " ms" << std::endl;
+    std::cout << "  " << (lods.size() > 1 ? "lod 0 " : "") << "ACMR " << std::setprecision(3) << before.acmr
+              << " -> " << after.acmr << ", ATVR " << before.atvr << " -> " << after.atvr << std::defaultfloat
+              << std::endl;
+  }
 
-        indices.push_back(unique_vertices[vertex]);
+
+  // 16-bit indices halve the index buffer but can only address 65535
+  // vertices, so a bigger model is cut into sub-meshes that each get their
+  // own range of the vertex buffer (drawn with vertexOffset). runs after
+  // optimize_model so every sub-mesh is a cache friendly run of triangles.
+  // no sub-mesh spans two LODs, each LOD is drawn as its own run of
+  // sub-meshes. only LOD 0 is cut into new vertex ranges, the coarser LODs
+  // are drawn from those (see split_lods)
+  void split_model() {
+    if (options.uint32_indices) {
+      submeshes.clear();
+      for (auto& lod : lods) {
+        SubMesh submesh;
+        submesh.first_index  = lod.first_index;
+        submesh.index_count  = lod.index_count;
+        submesh.vertex_count = static_cast<uint32_t>(vertices.size());
+        lod.first_submesh = static_cast<uint32_t>(submeshes.size());
+        lod.submesh_count = 1;
+        submeshes.push_back(submesh);
       }
+      index_type = VK_INDEX_TYPE_UINT32;
+      return;
+    }
+
+    std::vector<uint32_t> lod_starts;
+    for (const auto& lod : lods) lod_starts.push_back(lod.first_index);
+
+    size_t vertex_count = vertices.size();
+    size_t lod_copies   = 0;
+    submeshes  = split_lods(vertices, indices, indices16, lod_starts, &lod_copies);
+    index_type = VK_INDEX_TYPE_UINT16;
+
+    // the sub-meshes come out in index order
+    size_t l = 0;
+    for (auto& lod : lods) lod.submesh_count = 0;
+    for (size_t i = 0; i < submeshes.size(); i++) {
+      while (submeshes[i].first_index >= lods[l].first_index + lods[l].index_count) l++;
+      if (lods[l].submesh_count == 0) lods[l].first_submesh = static_cast<uint32_t>(i);
+      lods[l].submesh_count++;
+    }
+
+    std::cout << "index buffer: 16-bit, " << submeshes.size() << (submeshes.size() == 1 ? " sub-mesh, " : " sub-meshes, ")
+              << indices16.size() * sizeof(uint16_t) / 1024 << " KiB instead of "
+              << indices.size() * sizeof(uint32_t) / 1024 << " KiB";
+    if (vertices.size() > vertex_count + lod_copies) {
+      std::cout << ", " << vertices.size() - vertex_count - lod_copies << " vertices duplicated along the cuts";
+    }
+    if (lod_copies > 0) {
+      std::cout << ", " << lod_copies << " copied for coarse triangles across them";
+    }
+    std::cout << std::endl;
+  }
+
+
+  // bounding sphere around the center of the mesh's bounding box, which is
+  // all the culling pass needs
+  void compute_model_bounds() {
+    glm::vec3 min_pos(std::numeric_limits<float>::max());
+    glm::vec3 max_pos(-std::numeric_limits<float>::max());
+    for (const auto& vertex : vertices) {
+      min_pos = glm::min(min_pos, vertex.pos);
+      max_pos = glm::max(max_pos, vertex.pos);
+    }
+
+    glm::vec3 center = (min_pos + max_pos) * 0.5f;
+    float radius = 0.0f;
+    for (const auto& vertex : vertices) {
+      radius = std::max(radius, glm::length(vertex.pos - center));
     }
+    model_bounds = glm::vec4(center, radius);
   }
 
 
   // facilitates cleanup of objects that were used in the previous swap chain
   // must clean all objects  needed to recreate swap chain
+  // the render pass and pipeline don't depend on the extent and are kept (see
+  // recreate_swap_chain)
   void cleanup_swap_chain() {
-    for (size_t i = 0; i < swap_chain_framebuffers.size(); i++) {
-      vkDestroyImageView(device, depth_images_view[i], nullptr);
-      vkDestroyImage(device, depth_images[i], nullptr);
-      vkFreeMemory(device, depth_images_memory[i], nullptr);
-    }
+    destroy_attachments(swap_chain_framebuffers, swap_chain_image_views, depth_images, depth_images_view,
+        depth_images_memory);
 
-    for (auto framebuffer : swap_chain_framebuffers) {
-      vkDestroyFramebuffer(device, framebuffer, nullptr);
+    if (options.headless) {
+      for (size_t i = 0; i < swap_chain_images.size(); i++) {
+        vkDestroyImage(device, swap_chain_images[i], nullptr);
+        allocator.free(offscreen_images_memory[i]);
+      }
+    } else {
+      vkDestroySwapchainKHR(device, swap_chain, nullptr);
     }
+  }
 
-    // we use this instead of destroying all the command buffers because
-    // we just need to fill in the existing pool with new commands buffers
-    vkFreeCommandBuffers(device, command_pool,
-        static_cast<uint32_t>(command_buffers.size()), command_buffers.data());
 
-    vkDestroyPipeline(device, graphics_pipeline, nullptr);
-    vkDestroyPipelineLayout(device, pipeline_layout, nullptr);
-    vkDestroyRenderPass(device, render_pass, nullptr);
+  // the framebuffers, image views and depth buffers of the current swap
+  // chain go to the deletion queue, the swap chain itself is still needed as
+  // oldSwapchain (see recreate_swap_chain)
+  void retire_swap_chain() {
+    std::vector<VkFramebuffer> framebuffers = swap_chain_framebuffers;
+    std::vector<VkImageView> image_views    = swap_chain_image_views;
+    std::vector<VkImage> depth              = depth_images;
+    std::vector<VkImageView> depth_views    = depth_images_view;
+    std::vector<Allocation> depth_memory    = depth_images_memory;
+    deletion_queue.push(gpu_timeline.submitted(), [=]() mutable {
+      destroy_attachments(framebuffers, image_views, depth, depth_views, depth_memory);
+    });
+  }
 
-    for (auto image_view : swap_chain_image_views) {
-      vkDestroyImageView(device, image_view, nullptr);
+
+  void destroy_attachments(const std::vector<VkFramebuffer>& framebuffers,
+      const std::vector<VkImageView>& image_views, const std::vector<VkImage>& depth,
+      const std::vector<VkImageView>& depth_views, std::vector<Allocation>& depth_memory) {
+    for (size_t i = 0; i < depth.size(); i++) {
+      vkDestroyImageView(device, depth_views[i], nullptr);
+      vkDestroyImage(device, depth[i], nullptr);
+      allocator.free(depth_memory[i]);
     }
 
-    vkDestroySwapchainKHR(device, swap_chain, nullptr);
+    for (auto framebuffer : framebuffers) {
+      vkDestroyFramebuffer(device, framebuffer, nullptr);
+    }
+
+    for (auto image_view : image_views) {
+      vkDestroyImageView(device, image_view, nullptr);
+    }
   }
 
 
   void cleanup() {
+    // the device is idle by now
+    deletion_queue.flush();
     cleanup_swap_chain();
 
+    destroy_graphics_pipeline();
+
     vkDestroySampler(device, texture_sampler, nullptr);
     vkDestroyImageView(device, texture_image_view, nullptr);
 
     vkDestroyImage(device, texture_image, nullptr);
-    vkFreeMemory(device, texture_image_memory, nullptr);
+    allocator.free(texture_image_memory);
 
     vkDestroyDescriptorPool(device, descriptor_pool, nullptr);
 
     vkDestroyDescriptorSetLayout(device, descriptor_set_layout, nullptr);
 
-    for (size_t i = 0; i < swap_chain_images.size(); i++) {
-      vkDestroyBuffer(device, uniform_buffers[i], nullptr);
-      vkFreeMemory(device, uniform_buffers_memory[i], nullptr);
-    }
+    vkDestroyBuffer(device, uniform_buffer, nullptr);
+    allocator.free(uniform_buffer_memory);
 
     vkDestroyBuffer(device, vertex_buffer, nullptr);
     // freeing up the memory used by a buffer after the buffer itself is
     // destroyed
-    vkFreeMemory(device, vertex_buffer_memory, nullptr);
+    allocator.free(vertex_buffer_memory);
 
     vkDestroyBuffer(device, index_buffer, nullptr);
-    vkFreeMemory(device, index_buffer_memory, nullptr);
+    allocator.free(index_buffer_memory);
+
+    vkDestroyBuffer(device, instance_buffer, nullptr);
+    allocator.free(instance_buffer_memory);
+
+    vkDestroyBuffer(device, submesh_buffer, nullptr);
+    allocator.free(submesh_buffer_memory);
+
+    destroy_culling_resources();
 
     for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
       vkDestroySemaphore(device, render_finished_semaphores[i], nullptr);
       vkDestroySemaphore(device, image_available_semaphores[i], nullptr);
-      vkDestroyFence(device, in_flight_fences[i], nullptr);
     }
 
-    vkDestroyCommandPool(device, command_pool, nullptr);
+    for (auto& frame : frame_commands) {
+      vkDestroyCommandPool(device, frame.primary_pool, nullptr);
+      for (auto pool : frame.secondary_pools) {
+        vkDestroyCommandPool(device, pool, nullptr);
+      }
+    }
+    recording_threads.destroy();
+    texture_threads.destroy();
+
+    report_gpu_profile();
+    gpu_profiler.destroy();
+
+    report_frame_stats();
+
+    upload_context.destroy();
+    gpu_timeline.destroy();
+
+    pipeline_cache.save();
+    pipeline_cache.destroy();
+
+    allocator.print_stats(std::cout);
+    allocator.destroy();
 
     vkDestroyDevice(device, nullptr);
 
@@ -500,12 +1350,16 @@ private:
       destroy_debug_report_callback_ext(instance, callback, nullptr);
     }
 
-    vkDestroySurfaceKHR(instance, surface, nullptr);
+    if (!options.headless) {
+      vkDestroySurfaceKHR(instance, surface, nullptr);
+    }
     vkDestroyInstance(instance, nullptr);
 
-    glfwDestroyWindow(window);
+    if (!options.headless) {
+      glfwDestroyWindow(window);
 
-    glfwTerminate();
+      glfwTerminate();
+    }
   }
 
 
@@ -595,7 +1449,7 @@ private:
     QueueFamilyIndices indices = find_queue_families(physical_device);
 
     std::vector<VkDeviceQueueCreateInfo> queue_create_infos;
-    std::set<int> unique_queue_families = {indices.graphics_family, indices.present_family};
+    std::set<int> unique_queue_families = {indices.graphics_family, indices.present_family, indices.transfer_family};
 
     float queue_priority = 1.0f;
     for (int queue_family : unique_queue_families) {
@@ -607,8 +1461,14 @@ private:
       queue_create_infos.push_back(queue_create_info);
     }
       
+    VkPhysicalDeviceFeatures supported_features;
+    vkGetPhysicalDeviceFeatures(physical_device, &supported_features);
+
     VkPhysicalDeviceFeatures device_features = {};
     device_features.samplerAnisotropy = VK_TRUE;
+    // both optional, used by the GPU culling pass
+    device_features.multiDrawIndirect         = supported_features.multiDrawIndirect;
+    device_features.drawIndirectFirstInstance = supported_features.drawIndirectFirstInstance;
 
     VkDeviceCreateInfo create_info = {};
     create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -617,8 +1477,25 @@ private:
 
     create_info.pEnabledFeatures = &device_features;
 
-    create_info.enabledExtensionCount   = static_cast<uint32_t>(device_extensions.size());
-    create_info.ppEnabledExtensionNames = device_extensions.data();
+    std::vector<const char*> extensions = get_required_device_extensions();
+    bool has_draw_indirect_count = has_device_extension(physical_device, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+    if (has_draw_indirect_count) {
+      extensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+    }
+    // the timelineSemaphore feature is required by the extension, so there
+    // is nothing to query
+    VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timeline_features = {};
+    timeline_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+    timeline_features.timelineSemaphore = VK_TRUE;
+    // without its instance dependency the fences are used instead
+    has_timeline_semaphore = options.timeline_semaphore && has_physical_device_properties2 &&
+        has_device_extension(physical_device, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+    if (has_timeline_semaphore) {
+      extensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+      create_info.pNext = &timeline_features;
+    }
+    create_info.enabledExtensionCount   = static_cast<uint32_t>(extensions.size());
+    create_info.ppEnabledExtensionNames = extensions.data();
 
     if (enable_validation_layers) {
       create_info.enabledLayerCount   = static_cast<uint32_t>(validation_layers.size());
@@ -633,11 +1510,26 @@ private:
 
     vkGetDeviceQueue(device, indices.graphics_family, 0, &graphics_queue);
     vkGetDeviceQueue(device, indices.present_family, 0, &present_queue);
+    vkGetDeviceQueue(device, indices.transfer_family, 0, &transfer_queue);
+
+    supports_gpu_culling = supported_features.drawIndirectFirstInstance == VK_TRUE;
+    if (has_draw_indirect_count) {
+      cmd_draw_indexed_indirect_count = (PFN_vkCmdDrawIndexedIndirectCountKHR)
+          vkGetDeviceProcAddr(device, "vkCmdDrawIndexedIndirectCountKHR");
+    }
+    if (supported_features.multiDrawIndirect) {
+      VkPhysicalDeviceProperties properties;
+      vkGetPhysicalDeviceProperties(physical_device, &properties);
+      max_draw_indirect_count = properties.limits.maxDrawIndirectCount;
+    }
 
+    allocator.init(physical_device, device);
   }
 
 
-  void create_swap_chain() {
+  // old_swap_chain lets the presentation engine hand its resources over to
+  // the new swap chain, it has to be destroyed by the caller
+  void create_swap_chain(VkSwapchainKHR old_swap_chain = VK_NULL_HANDLE) {
     SwapChainSupportDetails swap_chain_support =
       query_swap_chain_support(physical_device);
 
@@ -676,9 +1568,10 @@ private:
     create_info.preTransform   = swap_chain_support.capabilities.currentTransform;
     create_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
     create_info.presentMode    = present_mode;
+    swap_chain_present_mode    = present_mode;
     create_info.clipped        = VK_TRUE;
     
-    create_info.oldSwapchain = VK_NULL_HANDLE;
+    create_info.oldSwapchain = old_swap_chain;
 
     if (vkCreateSwapchainKHR(device, &create_info, nullptr, &swap_chain) != VK_SUCCESS) {
       throw std::runtime_error("failed to create swap chain!");
@@ -693,6 +1586,23 @@ private:
   }
 
 
+  // headless replacement for create_swap_chain. one color image per frame in
+  // flight, so a frame's image is free to render into again once the frame
+  // has finished
+  void create_offscreen_targets() {
+    swap_chain_image_format = VK_FORMAT_R8G8B8A8_UNORM;
+    swap_chain_extent       = {static_cast<uint32_t>(WIDTH), static_cast<uint32_t>(HEIGHT)};
+
+    swap_chain_images.resize(MAX_FRAMES_IN_FLIGHT);
+    offscreen_images_memory.resize(MAX_FRAMES_IN_FLIGHT);
+    for (size_t i = 0; i < swap_chain_images.size(); i++) {
+      create_image(swap_chain_extent.width, swap_chain_extent.height, 1, swap_chain_image_format,
+          VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, swap_chain_images[i], offscreen_images_memory[i]);
+    }
+  }
+
+
   // if window is resized then we need to recreate the swap chain to handle it
   void recreate_swap_chain() {
     int width = 0, height = 0;
@@ -701,17 +1611,56 @@ private:
       glfwWaitEvents();
     }
 
-    vkDeviceWaitIdle(device);
+    auto start_time = std::chrono::high_resolution_clock::now();
 
-    cleanup_swap_chain();
+    // frames that are still in flight keep using the old swap chain and
+    // everything built on it, which is destroyed once they have finished.
+    // the device never has to go idle
+    retire_swap_chain();
 
-    create_swap_chain();
+    VkSwapchainKHR old_swap_chain = swap_chain;
+    VkFormat old_format = swap_chain_image_format;
+    create_swap_chain(old_swap_chain);
+    deletion_queue.push(gpu_timeline.submitted(), [this, old_swap_chain] {
+      vkDestroySwapchainKHR(device, old_swap_chain, nullptr);
+    });
     create_image_views();
-    create_render_pass();
-    create_graphics_pipeline();
+
+    // the render pass only depends on the attachment formats, and with the
+    // viewport and scissor being dynamic the pipeline doesn't depend on the
+    // extent at all. both only have to be rebuilt if the surface format
+    // changed (e.g. the window moved to an HDR monitor)
+    bool format_changed = swap_chain_image_format != old_format;
+    if (format_changed) {
+      VkPipeline old_pipeline = graphics_pipeline;
+      VkPipelineLayout old_layout = pipeline_layout;
+      VkRenderPass old_render_pass = render_pass;
+      deletion_queue.push(gpu_timeline.submitted(), [this, old_pipeline, old_layout, old_render_pass] {
+        vkDestroyPipeline(device, old_pipeline, nullptr);
+        vkDestroyPipelineLayout(device, old_layout, nullptr);
+        vkDestroyRenderPass(device, old_render_pass, nullptr);
+      });
+      create_render_pass();
+      create_graphics_pipeline();
+    }
+
     create_depth_resources();
     create_framebuffers();
-    create_command_buffers();
+    upload_context.submit();
+
+    float resize_ms = std::chrono::duration<float, std::chrono::milliseconds::period>(
+        std::chrono::high_resolution_clock::now() - start_time).count();
+    std::cout << "swap chain recreated (" << swap_chain_extent.width << "x" << swap_chain_extent.height
+              << ") in " << resize_ms << " ms, "
+              << (format_changed ? "rebuilt" : "kept") << " render pass and pipeline, old one released at timeline value "
+              << gpu_timeline.submitted() << std::endl;
+  }
+
+
+  void destroy_graphics_pipeline() {
+    vkDestroyPipeline(device, graphics_pipeline, nullptr);
+    vkDestroyPipelineLayout(device, pipeline_layout, nullptr);
+    vkDestroyRenderPass(device, render_pass, nullptr);
   }
 
 
@@ -719,7 +1668,7 @@ private:
     swap_chain_image_views.resize(swap_chain_images.size());
 
     for (size_t i = 0; i < swap_chain_images.size(); i++) {
-      swap_chain_image_views[i] = create_image_view(swap_chain_images[i], swap_chain_image_format, VK_IMAGE_ASPECT_COLOR_BIT);
+      swap_chain_image_views[i] = create_image_view(swap_chain_images[i], swap_chain_image_format, VK_IMAGE_ASPECT_COLOR_BIT, 1);
     }
   }
 
@@ -733,7 +1682,9 @@ private:
     color_attachment.stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     color_attachment.initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;
-    color_attachment.finalLayout    = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    // offscreen images are only ever read back by a copy
+    color_attachment.finalLayout    = options.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL :
+        VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
     VkAttachmentReference color_attachment_ref = {};
     color_attachment_ref.attachment = 0;
@@ -766,6 +1717,15 @@ private:
     dependency.srcAccessMask = 0;
     dependency.dstStageMask  = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
     dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    if (options.depth_policy == DEPTH_POLICY_SHARED) {
+      // a frame clears the shared depth buffer while the previous one may
+      // still be testing against it, the clear has to wait for those tests
+      dependency.srcStageMask  |= VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+      dependency.srcAccessMask |= VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+      dependency.dstStageMask  |= VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+      dependency.dstAccessMask |= VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+          VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    }
 
     std::array<VkAttachmentDescription, 2> attachments = {color_attachment, depth_attachment};
     VkRenderPassCreateInfo render_pass_info = {};
@@ -807,8 +1767,10 @@ private:
     VkPipelineVertexInputStateCreateInfo vertex_input_info = {};
     vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 
-    auto binding_description    = Vertex::get_binding_description();
-    auto attribute_descriptions = Vertex::get_attribute_descriptions();
+    auto binding_description    = options.packed_vertices ?
+        PackedVertex::get_binding_description() : Vertex::get_binding_description();
+    auto attribute_descriptions = options.packed_vertices ?
+        PackedVertex::get_attribute_descriptions() : Vertex::get_attribute_descriptions();
 
     vertex_input_info.vertexBindingDescriptionCount   = 1;
     vertex_input_info.vertexAttributeDescriptionCount =
@@ -821,24 +1783,25 @@ private:
     input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
     input_assembly.primitiveRestartEnable = VK_FALSE;
 
-    VkViewport viewport = {};
-    viewport.x = 0.0f;
-    viewport.y = 0.0f;
-    viewport.width    = (float) swap_chain_extent.width;
-    viewport.height   = (float) swap_chain_extent.height;
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
-
-    VkRect2D scissor = {};
-    scissor.offset   = {0, 0};
-    scissor.extent   = swap_chain_extent;
-
+    // the viewport and scissor are set in the command buffer instead
+    // (vkCmdSetViewport/vkCmdSetScissor), so the pipeline doesn't depend on
+    // the swap chain extent and survives window resizes
     VkPipelineViewportStateCreateInfo viewport_state = {};
     viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
     viewport_state.viewportCount = 1;
-    viewport_state.pViewports    = &viewport;
+    viewport_state.pViewports    = nullptr;
     viewport_state.scissorCount  = 1;
-    viewport_state.pScissors     = &scissor;
+    viewport_state.pScissors     = nullptr;
+
+    std::array<VkDynamicState, 2> dynamic_states = {
+      VK_DYNAMIC_STATE_VIEWPORT,
+      VK_DYNAMIC_STATE_SCISSOR
+    };
+
+    VkPipelineDynamicStateCreateInfo dynamic_state = {};
+    dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamic_state.dynamicStateCount = static_cast<uint32_t>(dynamic_states.size());
+    dynamic_state.pDynamicStates    = dynamic_states.data();
     
     VkPipelineRasterizationStateCreateInfo rasterizer = {};
     rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
@@ -903,28 +1866,45 @@ private:
     pipeline_info.pRasterizationState = &rasterizer;
     pipeline_info.pMultisampleState = &multisampling;
     pipeline_info.pColorBlendState = &color_blending;
+    pipeline_info.pDynamicState = &dynamic_state;
     pipeline_info.layout = pipeline_layout;
     pipeline_info.renderPass = render_pass;
     pipeline_info.subpass = 0;
     pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
     pipeline_info.pDepthStencilState = &depth_stencil;
 
-    if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &graphics_pipeline) != VK_SUCCESS) {
+    auto start_time = std::chrono::high_resolution_clock::now();
+
+    if (vkCreateGraphicsPipelines(device, pipeline_cache.get(), 1, &pipeline_info, nullptr, &graphics_pipeline) != VK_SUCCESS) {
         throw std::runtime_error("failed to create graphics pipeline!");
     }
+
+    // compare the first run (cold cache) against later ones (warm cache), the
+    // pipelines created by recreate_swap_chain always hit the in-memory cache
+    float creation_ms = std::chrono::duration<float, std::chrono::milliseconds::period>(
+        std::chrono::high_resolution_clock::now() - start_time).count();
+    std::cout << "graphics pipeline created in " << creation_ms << " ms ("
+              << (pipeline_cache.is_warm() ? "warm" : "cold") << " pipeline cache)" << std::endl;
     
     vkDestroyShaderModule(device, vert_shader_module, nullptr);
     vkDestroyShaderModule(device, frag_shader_module, nullptr);
   }
 
 
+  // has to outlive every pipeline created with it, it's only destroyed (after
+  // being written back to disk) in cleanup
+  void create_pipeline_cache() {
+    pipeline_cache.init(physical_device, device, PIPELINE_CACHE_PATH);
+  }
+
+
   void create_framebuffers() {
     swap_chain_framebuffers.resize(swap_chain_image_views.size());
 
     for (size_t i = 0; i < swap_chain_image_views.size(); i++) {
       std::array<VkImageView, 2> attachments = {
         swap_chain_image_views[i],
-        depth_images_view[i]
+        depth_images_view[i % depth_images_view.size()]
       };
 
       VkFramebufferCreateInfo framebuffer_info = {};
@@ -943,23 +1923,63 @@ private:
   }
 
 
-  void create_command_pool() {
+  // recording_threads is started at the beginning of init_vulkan
+  void create_command_pools() {
     QueueFamilyIndices queue_family_indices = find_queue_families(physical_device);
 
+    // the pools are only ever reset as a whole, their command buffers are
+    // short lived
     VkCommandPoolCreateInfo pool_info = {};
     pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
     pool_info.queueFamilyIndex = queue_family_indices.graphics_family;
 
-    if (vkCreateCommandPool(device, &pool_info, nullptr, &command_pool) != VK_SUCCESS) {
-      throw std::runtime_error("failed to create command pool!");
+    frame_commands.resize(MAX_FRAMES_IN_FLIGHT);
+    for (auto& frame : frame_commands) {
+      if (vkCreateCommandPool(device, &pool_info, nullptr, &frame.primary_pool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create command pool!");
+      }
+
+      frame.secondary_pools.resize(recording_threads.size());
+      for (auto& pool : frame.secondary_pools) {
+        if (vkCreateCommandPool(device, &pool_info, nullptr, &pool) != VK_SUCCESS) {
+          throw std::runtime_error("failed to create command pool!");
+        }
+      }
     }
   }
 
 
-  void create_image(uint32_t width, uint32_t height, VkFormat format,
-      VkImageTiling tiling, VkImageUsageFlags usage,
-      VkMemoryPropertyFlags properties, VkImage& image,
-      VkDeviceMemory& image_memory) {
+  // every submission to the graphics queue goes through gpu_timeline from
+  // here on
+  void create_gpu_timeline() {
+    gpu_timeline.init(device, graphics_queue, has_timeline_semaphore);
+    std::cout << "GPU progress tracked with " << (gpu_timeline.uses_timeline_semaphore() ? "a timeline semaphore" :
+        "fences") << std::endl;
+  }
+
+
+  void create_upload_context() {
+    QueueFamilyIndices indices = find_queue_families(physical_device);
+
+    upload_context.init(device, &allocator, &gpu_timeline,
+        indices.graphics_family, indices.transfer_family, transfer_queue);
+  }
+
+
+  void create_image(uint32_t width, uint32_t height, uint32_t mip_levels, VkFormat format,
+      VkImageTiling tiling, VkImageUsageFlags usage,
+      VkMemoryPropertyFlags properties, VkImage& image,
+      Allocation& image_memory) {
+    create_image_handle(width, height, mip_levels, format, tiling, usage, image);
+    allocate_image_memory(image, tiling, properties, image_memory);
+  }
+
+
+  // create_image in two steps, like create_buffer_handle and
+  // allocate_buffer_memory
+  void create_image_handle(uint32_t width, uint32_t height, uint32_t mip_levels, VkFormat format,
+      VkImageTiling tiling, VkImageUsageFlags usage, VkImage& image) {
     VkImageCreateInfo image_info = {};
     image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     // can be 1D, 2D, or 3D
@@ -971,7 +1991,7 @@ private:
     image_info.extent.width = width;
     image_info.extent.height = height;
     image_info.extent.depth = 1;
-    image_info.mipLevels = 1;
+    image_info.mipLevels = mip_levels;
     image_info.arrayLayers = 1;
     // format must be same as pixels in the buffer or failure will occur
     image_info.format = format;
@@ -985,43 +2005,71 @@ private:
     if (vkCreateImage(device, &image_info, nullptr, &image) != VK_SUCCESS) {
       throw std::runtime_error("failed to create image!");
     }
+  }
 
+
+  void allocate_image_memory(VkImage image, VkImageTiling tiling, VkMemoryPropertyFlags properties,
+      Allocation& image_memory) {
     // for similar allocation of memory, see implementation of create_buffer
     // function
+    // optimally tiled images live in their own pools so they never share a
+    // block with buffers (see bufferImageGranularity)
     VkMemoryRequirements mem_requirements;
     vkGetImageMemoryRequirements(device, image, &mem_requirements);
 
-    VkMemoryAllocateInfo alloc_info = {};
-    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    alloc_info. allocationSize = mem_requirements.size;
-    alloc_info.memoryTypeIndex = find_memory_type(mem_requirements.memoryTypeBits, properties);
-
-    if (vkAllocateMemory(device, &alloc_info, nullptr, &image_memory) != VK_SUCCESS) {
-      throw std::runtime_error("failed to allocate image memory!");
-    }
+    image_memory = allocator.allocate(mem_requirements,
+        find_memory_type(mem_requirements.memoryTypeBits, properties),
+        ALLOCATION_STRATEGY_FREE_LIST,
+        tiling == VK_IMAGE_TILING_OPTIMAL ? RESOURCE_KIND_OPTIMAL_IMAGE : RESOURCE_KIND_BUFFER);
 
-    vkBindImageMemory(device, image, image_memory, 0);
+    vkBindImageMemory(device, image, image_memory.memory, image_memory.offset);
   }
 
 
+  // the depth buffer is cleared at the start of the render pass and never
+  // stored, so it is a transient attachment: tile based GPUs keep it in tile
+  // memory and, with lazily allocated memory, never back it with real memory
   void create_depth_resources() {
     VkFormat depth_format = find_depth_format();
 
-    depth_images.resize(swap_chain_images.size());
-    depth_images_memory.resize(swap_chain_images.size());
-    depth_images_view.resize(swap_chain_images.size());
+    size_t depth_count = options.depth_policy == DEPTH_POLICY_SHARED ? 1 : swap_chain_images.size();
+    depth_images.resize(depth_count);
+    depth_images_memory.resize(depth_count);
+    depth_images_view.resize(depth_count);
 
-    for (size_t i = 0; i < swap_chain_image_views.size(); i++) {
-      create_image(swap_chain_extent.width, swap_chain_extent.height,
+    VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    bool lazily_allocated = false;
+
+    for (size_t i = 0; i < depth_count; i++) {
+      create_image_handle(swap_chain_extent.width, swap_chain_extent.height, 1,
           depth_format, VK_IMAGE_TILING_OPTIMAL,
-          VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depth_images[i],
-          depth_images_memory[i]);
-      depth_images_view[i] = create_image_view(depth_images[i], depth_format, VK_IMAGE_ASPECT_DEPTH_BIT);
+          VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+          depth_images[i]);
+
+      // all depth images are created alike, the first one decides
+      if (i == 0) {
+        VkMemoryRequirements requirements;
+        vkGetImageMemoryRequirements(device, depth_images[0], &requirements);
+        lazily_allocated = has_memory_type(requirements, properties | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
+        if (lazily_allocated) {
+          properties |= VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+        }
+      }
+      allocate_image_memory(depth_images[i], VK_IMAGE_TILING_OPTIMAL, properties, depth_images_memory[i]);
+      depth_images_view[i] = create_image_view(depth_images[i], depth_format, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
       
       transition_image_layout(depth_images[i], depth_format, VK_IMAGE_LAYOUT_UNDEFINED,
-          VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+          VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, 1);
+    }
+
+    VkDeviceSize depth_size = depth_images_memory[0].size;
+    std::cout << "depth buffers: " << depth_count << " for " << swap_chain_images.size() << " images, "
+              << depth_count * depth_size / (1024 * 1024) << " MiB";
+    if (depth_count < swap_chain_images.size()) {
+      std::cout << ", " << (swap_chain_images.size() - depth_count) * depth_size / (1024 * 1024)
+                << " MiB saved by sharing";
     }
+    std::cout << (lazily_allocated ? ", lazily allocated" : "") << std::endl;
   }
 
 
@@ -1054,60 +2102,445 @@ private:
 
 
   // we load an image and upload it into a vulkan image object
-  void create_texture_image() {
-    int tex_width, tex_height, tex_channels;
-    stbi_uc* pixels = stbi_load(TEXTURE_PATH.c_str(), &tex_width, &tex_height,
-        &tex_channels, STBI_rgb_alpha);
-    VkDeviceSize image_size = tex_width * tex_height * 4;
+  // the header is enough to size the staging buffer, decode_texture fills it
+  void create_texture_staging() {
+    TextureUpload& upload = texture_upload;
+    int channels;
+    if (!stbi_info(TEXTURE_PATH.c_str(), &upload.width, &upload.height, &channels)) {
+      throw std::runtime_error("failed to load texture image!");
+    }
+    upload.size = static_cast<VkDeviceSize>(upload.width) * upload.height * 4;
+
+    create_buffer_handle(upload.size + IMAGE_DECODE_SLACK, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, upload.staging_buffer);
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(device, upload.staging_buffer, &requirements);
+
+    // decoders read back what they have written (PNG unfiltering, format
+    // conversions), which is very slow from uncached, write-combined memory.
+    // the image is only decoded in place into staging memory the CPU caches
+    VkMemoryPropertyFlags staging_properties =
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    upload.decode_in_place = options.decode_texture_in_place &&
+        has_memory_type(requirements, staging_properties | VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+    if (upload.decode_in_place) {
+      staging_properties |= VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+    }
+
+    allocate_buffer_memory(upload.staging_buffer, staging_properties, upload.staging_buffer_memory,
+        ALLOCATION_STRATEGY_LINEAR);
+  }
+
+
+  // only touches the staging memory, so it runs on a worker, at startup and
+  // for every reload
+  void decode_texture() {
+    TextureUpload& upload = texture_upload;
+    auto start_time = std::chrono::high_resolution_clock::now();
+
+    // host visible memory is kept mapped by the allocator
+    ImageDecodeTarget target(upload.decode_in_place ? upload.staging_buffer_memory.mapped : nullptr,
+        static_cast<size_t>(upload.size), static_cast<size_t>(upload.size + IMAGE_DECODE_SLACK));
 
-    if (!pixels) {
+    int width, height, channels;
+    stbi_uc* pixels = stbi_load(TEXTURE_PATH.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+    if (!pixels || width != upload.width || height != upload.height) {
+      stbi_image_free(pixels);
       throw std::runtime_error("failed to load texture image!");
     }
 
-    VkBuffer staging_buffer;
-    VkDeviceMemory staging_buffer_memory;
-    create_buffer(image_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        staging_buffer, staging_buffer_memory);
+    upload.in_place = target.in_place(pixels);
+    if (!upload.in_place) {
+      memcpy(upload.staging_buffer_memory.mapped, pixels, static_cast<size_t>(upload.size));
+      stbi_image_free(pixels);
+    }
 
+    upload.decode_heap_bytes = target.peak_heap_bytes();
+    upload.decode_ms = std::chrono::duration<float, std::chrono::milliseconds::period>(
+        std::chrono::high_resolution_clock::now() - start_time).count();
+  }
 
-    void* data;
-    vkMapMemory(device, staging_buffer_memory, 0, image_size, 0, &data);
-    memcpy(data, pixels, static_cast<size_t>(image_size));
-    vkUnmapMemory(device, staging_buffer_memory);
 
-    stbi_image_free(pixels);
+  void create_texture_image() {
+    int tex_width  = texture_upload.width;
+    int tex_height = texture_upload.height;
+
+    // the decoder's own heap use, the staging buffer not included
+    std::cout << "texture: decoded in " << std::fixed << std::setprecision(1) << texture_upload.decode_ms << " ms "
+              << (texture_upload.in_place ? "straight into staging memory" : "on the heap and copied to staging memory")
+              << ", stb_image heap peak " << texture_upload.decode_heap_bytes / 1024 << " KiB" << std::defaultfloat
+              << std::endl;
+
+    // every level is half the size of the previous one down to 1x1
+    mip_levels = static_cast<uint32_t>(std::floor(std::log2(std::max(tex_width, tex_height)))) + 1;
+
+    // blits need the format to support linear filtering, otherwise the levels
+    // are written by a compute shader through storage images
+    bool blit_mipmaps = supports_linear_blit(VK_FORMAT_R8G8B8A8_UNORM);
+    VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+        VK_IMAGE_USAGE_SAMPLED_BIT;
+    if (!blit_mipmaps) {
+      usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+    }
 
-    create_image(tex_width, tex_height, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL,
-        VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, texture_image, texture_image_memory);
+    create_image(tex_width, tex_height, mip_levels, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL,
+        usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, texture_image, texture_image_memory);
 
+    // only level 0 comes from the file, the others are generated from it
     transition_image_layout(texture_image, VK_FORMAT_R8G8B8A8_UNORM,
-        VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-    copy_buffer_to_image(staging_buffer, texture_image,
+        VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mip_levels);
+    copy_buffer_to_image(texture_upload.staging_buffer, texture_image,
         static_cast<uint32_t>(tex_width), static_cast<uint32_t>(tex_height));
-    transition_image_layout(texture_image, VK_FORMAT_R8G8B8A8_UNORM,
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 
-    vkDestroyBuffer(device, staging_buffer, nullptr);
-    vkFreeMemory(device, staging_buffer_memory, nullptr);
+    if (blit_mipmaps) {
+      generate_mipmaps_blit(texture_image, tex_width, tex_height, mip_levels);
+    } else {
+      generate_mipmaps_compute(texture_image, VK_FORMAT_R8G8B8A8_UNORM, tex_width, tex_height, mip_levels);
+    }
+
+    // still being read by the upload, destroyed once it has completed
+    upload_context.retire(texture_upload.staging_buffer, texture_upload.staging_buffer_memory);
+
+    print_mipmap_report(tex_width, tex_height, mip_levels, blit_mipmaps);
+  }
+
+
+  bool supports_linear_blit(VkFormat format) {
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(physical_device, format, &properties);
+
+    VkFormatFeatureFlags required = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+        VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    return (properties.optimalTilingFeatures & required) == required;
+  }
+
+
+  // level 0 was written on the transfer side, generating the rest needs the
+  // graphics queue (blits and compute aren't available on transfer queues)
+  void acquire_for_mipmaps(VkImage image, uint32_t mip_levels) {
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel   = 0;
+    barrier.subresourceRange.levelCount     = mip_levels;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount     = 1;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+
+    upload_context.hand_over_image(barrier, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+  }
+
+
+  // each level is blitted (with linear filtering) from the one before it,
+  // which is then done and moved to SHADER_READ_ONLY_OPTIMAL
+  void generate_mipmaps_blit(VkImage image, int32_t width, int32_t height, uint32_t mip_levels) {
+    acquire_for_mipmaps(image, mip_levels);
+
+    VkCommandBuffer command_buffer = upload_context.graphics_commands();
+
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.levelCount     = 1;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount     = 1;
+
+    for (uint32_t i = 1; i < mip_levels; i++) {
+      // the previous level has been written (by the copy or the last blit)
+      barrier.subresourceRange.baseMipLevel = i - 1;
+      barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+      barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+      barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+      barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+      vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+          0, nullptr, 0, nullptr, 1, &barrier);
+
+      int32_t next_width  = std::max(width / 2, 1);
+      int32_t next_height = std::max(height / 2, 1);
+
+      VkImageBlit blit = {};
+      blit.srcOffsets[0] = {0, 0, 0};
+      blit.srcOffsets[1] = {width, height, 1};
+      blit.srcSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+      blit.srcSubresource.mipLevel       = i - 1;
+      blit.srcSubresource.baseArrayLayer = 0;
+      blit.srcSubresource.layerCount     = 1;
+      blit.dstOffsets[0] = {0, 0, 0};
+      blit.dstOffsets[1] = {next_width, next_height, 1};
+      blit.dstSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+      blit.dstSubresource.mipLevel       = i;
+      blit.dstSubresource.baseArrayLayer = 0;
+      blit.dstSubresource.layerCount     = 1;
+
+      vkCmdBlitImage(command_buffer,
+          image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+          image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+          1, &blit, VK_FILTER_LINEAR);
+
+      barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+      barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+      barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+      barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+      vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+          0, nullptr, 0, nullptr, 1, &barrier);
+
+      width  = next_width;
+      height = next_height;
+    }
+
+    // the last level is only ever blitted to, never from
+    barrier.subresourceRange.baseMipLevel = mip_levels - 1;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+        0, nullptr, 0, nullptr, 1, &barrier);
+  }
+
+
+  // fallback for formats without linear blit support. shaders/mipmap.comp
+  // box filters level i - 1 into level i, both bound as storage images. the
+  // pipeline, views and descriptors are only needed while the upload runs and
+  // are destroyed once it has completed
+  void generate_mipmaps_compute(VkImage image, VkFormat format, int32_t width, int32_t height,
+      uint32_t mip_levels) {
+    // nothing to downsample. the blit path then records no blits, only the
+    // move to SHADER_READ_ONLY_OPTIMAL, and an empty descriptor pool would be
+    // invalid anyway
+    if (mip_levels == 1) {
+      generate_mipmaps_blit(image, width, height, mip_levels);
+      return;
+    }
+
+    VkFormatProperties format_properties;
+    vkGetPhysicalDeviceFormatProperties(physical_device, format, &format_properties);
+    if (!(format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT)) {
+      throw std::runtime_error("texture format supports neither linear blits nor storage images!");
+    }
+
+    std::array<VkDescriptorSetLayoutBinding, 2> bindings = {};
+    for (uint32_t i = 0; i < bindings.size(); i++) {
+      bindings[i].binding         = i;
+      bindings[i].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+      bindings[i].descriptorCount = 1;
+      bindings[i].stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layout_info = {};
+    layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_info.bindingCount = static_cast<uint32_t>(bindings.size());
+    layout_info.pBindings    = bindings.data();
+
+    VkDescriptorSetLayout set_layout;
+    if (vkCreateDescriptorSetLayout(device, &layout_info, nullptr, &set_layout) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create mipmap descriptor set layout!");
+    }
+
+    VkPipelineLayoutCreateInfo pipeline_layout_info = {};
+    pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipeline_layout_info.setLayoutCount = 1;
+    pipeline_layout_info.pSetLayouts    = &set_layout;
+
+    VkPipelineLayout mipmap_pipeline_layout;
+    if (vkCreatePipelineLayout(device, &pipeline_layout_info, nullptr, &mipmap_pipeline_layout) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create mipmap pipeline layout!");
+    }
+
+    VkShaderModule shader_module = create_shader_module(read_file("shaders/mipmap.spv"));
+
+    VkComputePipelineCreateInfo pipeline_info = {};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipeline_info.stage.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipeline_info.stage.stage  = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipeline_info.stage.module = shader_module;
+    pipeline_info.stage.pName  = "main";
+    pipeline_info.layout = mipmap_pipeline_layout;
+
+    VkPipeline mipmap_pipeline;
+    if (vkCreateComputePipelines(device, pipeline_cache.get(), 1, &pipeline_info, nullptr, &mipmap_pipeline) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create mipmap pipeline!");
+    }
+    vkDestroyShaderModule(device, shader_module, nullptr);
+
+    // one view per level, one set per generated level
+    std::vector<VkImageView> level_views(mip_levels);
+    for (uint32_t i = 0; i < mip_levels; i++) {
+      level_views[i] = create_image_view(image, format, VK_IMAGE_ASPECT_COLOR_BIT, 1, i);
+    }
+
+    VkDescriptorPoolSize pool_size = {};
+    pool_size.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    pool_size.descriptorCount = 2 * (mip_levels - 1);
+
+    VkDescriptorPoolCreateInfo pool_info = {};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.poolSizeCount = 1;
+    pool_info.pPoolSizes    = &pool_size;
+    pool_info.maxSets       = mip_levels - 1;
+
+    VkDescriptorPool mipmap_descriptor_pool;
+    if (vkCreateDescriptorPool(device, &pool_info, nullptr, &mipmap_descriptor_pool) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create mipmap descriptor pool!");
+    }
+
+    std::vector<VkDescriptorSetLayout> set_layouts(mip_levels - 1, set_layout);
+    std::vector<VkDescriptorSet> sets(mip_levels - 1);
+    VkDescriptorSetAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool     = mipmap_descriptor_pool;
+    alloc_info.descriptorSetCount = static_cast<uint32_t>(sets.size());
+    alloc_info.pSetLayouts        = set_layouts.data();
+
+    if (vkAllocateDescriptorSets(device, &alloc_info, sets.data()) != VK_SUCCESS) {
+      throw std::runtime_error("failed to allocate mipmap descriptor sets!");
+    }
+
+    for (uint32_t i = 1; i < mip_levels; i++) {
+      std::array<VkDescriptorImageInfo, 2> image_infos = {};
+      image_infos[0].imageView   = level_views[i - 1];
+      image_infos[0].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+      image_infos[1].imageView   = level_views[i];
+      image_infos[1].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+      std::array<VkWriteDescriptorSet, 2> writes = {};
+      for (uint32_t j = 0; j < writes.size(); j++) {
+        writes[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[j].dstSet          = sets[i - 1];
+        writes[j].dstBinding      = j;
+        writes[j].descriptorCount = 1;
+        writes[j].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        writes[j].pImageInfo      = &image_infos[j];
+      }
+      vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
+
+    acquire_for_mipmaps(image, mip_levels);
+
+    VkCommandBuffer command_buffer = upload_context.graphics_commands();
+
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel   = 0;
+    barrier.subresourceRange.levelCount     = mip_levels;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount     = 1;
+
+    // storage images have to be in the GENERAL layout
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+        0, nullptr, 0, nullptr, 1, &barrier);
+
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, mipmap_pipeline);
+
+    barrier.subresourceRange.levelCount = 1;
+    for (uint32_t i = 1; i < mip_levels; i++) {
+      width  = std::max(width / 2, 1);
+      height = std::max(height / 2, 1);
+
+      vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+          mipmap_pipeline_layout, 0, 1, &sets[i - 1], 0, nullptr);
+      // 8x8 threads per group, see local_size in the shader
+      vkCmdDispatch(command_buffer, (width + 7) / 8, (height + 7) / 8, 1);
+
+      // the next dispatch reads what this one wrote
+      barrier.subresourceRange.baseMipLevel = i;
+      barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+      barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+      barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+      barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+      vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+          0, nullptr, 0, nullptr, 1, &barrier);
+    }
+
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount   = mip_levels;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+        0, nullptr, 0, nullptr, 1, &barrier);
+
+    VkDevice device = this->device;
+    upload_context.defer([device, set_layout, mipmap_pipeline_layout, mipmap_pipeline,
+        mipmap_descriptor_pool, level_views] {
+      vkDestroyDescriptorPool(device, mipmap_descriptor_pool, nullptr);
+      for (auto view : level_views) {
+        vkDestroyImageView(device, view, nullptr);
+      }
+      vkDestroyPipeline(device, mipmap_pipeline, nullptr);
+      vkDestroyPipelineLayout(device, mipmap_pipeline_layout, nullptr);
+      vkDestroyDescriptorSetLayout(device, set_layout, nullptr);
+    });
+  }
+
+
+  // the texel data a minified draw has to pull through the texture cache.
+  // without mipmaps every sample comes from level 0 no matter how small the
+  // model is on screen, with them an object covering 1/2^k of the texture's
+  // size in each direction samples level k, which is 4^k times smaller
+  void print_mipmap_report(int32_t width, int32_t height, uint32_t mip_levels, bool blit) {
+    std::cout << "texture: " << width << "x" << height << ", " << mip_levels << " mip levels generated with "
+              << (blit ? "vkCmdBlitImage" : "the compute fallback") << std::endl;
+
+    VkDeviceSize level_0_size = static_cast<VkDeviceSize>(width) * height * 4;
+    VkDeviceSize chain_size   = 0;
+    for (uint32_t i = 0; i < mip_levels; i++) {
+      VkDeviceSize level_size = static_cast<VkDeviceSize>(width) * height * 4;
+      chain_size += level_size;
+
+      std::cout << "  level " << std::setw(2) << i << " " << std::setw(5) << width << "x" << std::setw(5) << height
+                << " " << std::setw(8) << level_size / 1024 << " KiB, at 1/" << (1u << i)
+                << " scale reads " << std::fixed << std::setprecision(1)
+                << 100.0 * level_size / level_0_size << "% of the data level 0 would"
+                << std::defaultfloat << std::endl;
+
+      width  = std::max(width / 2, 1);
+      height = std::max(height / 2, 1);
+    }
+
+    std::cout << "  whole chain " << chain_size / 1024 << " KiB, "
+              << std::fixed << std::setprecision(1) << 100.0 * (chain_size - level_0_size) / level_0_size
+              << "% more memory than level 0 alone" << std::defaultfloat << std::endl;
   }
 
 
   void create_texture_image_view() {
-    texture_image_view = create_image_view(texture_image, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT);
+    texture_image_view = create_image_view(texture_image, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT, mip_levels);
   }
 
 
-  VkImageView create_image_view(VkImage image, VkFormat format, VkImageAspectFlags aspect_flags) {
+  // the view covers mip_levels levels starting at base_mip_level
+  VkImageView create_image_view(VkImage image, VkFormat format, VkImageAspectFlags aspect_flags,
+      uint32_t mip_levels, uint32_t base_mip_level = 0) {
     VkImageViewCreateInfo view_info = {};
     view_info.sType    = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
     view_info.image    = image;
     view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
     view_info.format   = format;
     view_info.subresourceRange.aspectMask     = aspect_flags;
-    view_info.subresourceRange.baseMipLevel   = 0;
-    view_info.subresourceRange.levelCount     = 1;
+    view_info.subresourceRange.baseMipLevel   = base_mip_level;
+    view_info.subresourceRange.levelCount     = mip_levels;
     view_info.subresourceRange.baseArrayLayer = 0;
     view_info.subresourceRange.layerCount     = 1;
 
@@ -1138,7 +2571,7 @@ private:
     sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
     sampler_info.mipLodBias = 0.0F;
     sampler_info.minLod = 0.0F;
-    sampler_info.maxLod = 0.0F;
+    sampler_info.maxLod = static_cast<float>(mip_levels);
 
     if (vkCreateSampler(device, &sampler_info, nullptr, &texture_sampler) != VK_SUCCESS) {
       throw std::runtime_error("failed to create texture sampler!");
@@ -1146,8 +2579,68 @@ private:
   }
 
 
+  // loads TEXTURE_PATH again while frames keep rendering with the old
+  // texture. the staging buffer is created here on the render thread, the
+  // decode into it runs on texture_threads and reload_texture picks up the
+  // pixels once it has finished
+  void start_texture_reload() {
+    texture_reload_start = std::chrono::high_resolution_clock::now();
+    create_texture_staging();
+
+    auto task = std::make_shared<std::packaged_task<void()>>([this] { decode_texture(); });
+    texture_decode = task->get_future();
+    texture_threads.submit([task] { (*task)(); });
+  }
+
+
+  // swaps in the decoded texture. it is uploaded with the next upload batch,
+  // which is submitted before any later frame. the old image, view, sampler
+  // and descriptor set are released once the last frame that binds them has
+  // finished, nothing waits for the device
+  void reload_texture() {
+    // rethrows whatever the decode threw
+    texture_decode.get();
+    auto start_time = std::chrono::high_resolution_clock::now();
+
+    VkImage old_image = texture_image;
+    Allocation old_memory = texture_image_memory;
+    VkImageView old_view = texture_image_view;
+    VkSampler old_sampler = texture_sampler;
+    VkDescriptorSet old_set = descriptor_set;
+    deletion_queue.push(gpu_timeline.submitted(), [=]() mutable {
+      vkFreeDescriptorSets(device, descriptor_pool, 1, &old_set);
+      vkDestroySampler(device, old_sampler, nullptr);
+      vkDestroyImageView(device, old_view, nullptr);
+      vkDestroyImage(device, old_image, nullptr);
+      allocator.free(old_memory);
+    });
+
+    create_texture_image();
+    create_texture_image_view();
+    create_texture_sampler();
+    upload_context.submit();
+    descriptor_set = allocate_descriptor_set();
+
+    auto now = std::chrono::high_resolution_clock::now();
+    float reload_ms = std::chrono::duration<float, std::chrono::milliseconds::period>(now - texture_reload_start).count();
+    float render_thread_ms = std::chrono::duration<float, std::chrono::milliseconds::period>(now - start_time).count();
+    std::cout << "texture reloaded in " << reload_ms << " ms (" << render_thread_ms
+              << " ms of it on the render thread), old one released at timeline value "
+              << gpu_timeline.submitted() << " (" << deletion_queue.size() << " pending)" << std::endl;
+  }
+
+
   void create_buffer(VkDeviceSize size, VkBufferUsageFlags usage,
-      VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& buffer_memory) {
+      VkMemoryPropertyFlags properties, VkBuffer& buffer, Allocation& buffer_memory,
+      AllocationStrategy strategy = ALLOCATION_STRATEGY_FREE_LIST) {
+    create_buffer_handle(size, usage, buffer);
+    allocate_buffer_memory(buffer, properties, buffer_memory, strategy);
+  }
+
+
+  // create_buffer in two steps, for callers that pick the memory properties
+  // from the buffer's memory requirements
+  void create_buffer_handle(VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer& buffer) {
     VkBufferCreateInfo buffer_info = {};
     buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     buffer_info.size  = size;
@@ -1159,27 +2652,25 @@ private:
     if (vkCreateBuffer(device, &buffer_info, nullptr, &buffer) != VK_SUCCESS) {
       throw std::runtime_error("failed to create vertex buffer!");
     }
+  }
+
 
+  void allocate_buffer_memory(VkBuffer buffer, VkMemoryPropertyFlags properties, Allocation& buffer_memory,
+      AllocationStrategy strategy = ALLOCATION_STRATEGY_FREE_LIST) {
     VkMemoryRequirements mem_requirements;
     vkGetBufferMemoryRequirements(device, buffer, &mem_requirements);
 
-    // fill in information necessary for allocating memory for a specific buffer
-    // (in this case a buffer for vertex information)
-    VkMemoryAllocateInfo alloc_info = {};
-    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    alloc_info.allocationSize = mem_requirements.size;
-    alloc_info.memoryTypeIndex = find_memory_type(mem_requirements.memoryTypeBits, properties);
-
-    // allocate memory for a buffer
-    if (vkAllocateMemory(device, &alloc_info, nullptr, &buffer_memory) != VK_SUCCESS) {
-      throw std::runtime_error("failed to allocate vertex buffer memory!");
-    }
+    // rather than a vkAllocateMemory per buffer we take a range out of one of
+    // the allocator's blocks for the matching memory type
+    buffer_memory = allocator.allocate(mem_requirements,
+        find_memory_type(mem_requirements.memoryTypeBits, properties),
+        strategy, RESOURCE_KIND_BUFFER);
 
     // associate the allocated memory with the buffer
     // the fourth parameter is the offset within the region of memory
     // if the fourth parameter is non-zero, then it is required to be divisible
-    // by mem_requirements.alignment
-    vkBindBufferMemory(device, buffer, buffer_memory, 0);
+    // by mem_requirements.alignment, the allocator takes care of that
+    vkBindBufferMemory(device, buffer, buffer_memory.memory, buffer_memory.offset);
   }
 
 
@@ -1187,7 +2678,8 @@ private:
     VkDescriptorSetLayoutBinding ubo_layout_binding = {};
     // binding is set in vert.shader "layout(binding = 0)"
     ubo_layout_binding.binding            = 0;
-    ubo_layout_binding.descriptorType     = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    // dynamic so the offset into the uniform ring is given at bind time
+    ubo_layout_binding.descriptorType     = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     ubo_layout_binding.pImmutableSamplers = nullptr; // optional??
     ubo_layout_binding.descriptorCount    = 1;
     ubo_layout_binding.stageFlags         = VK_SHADER_STAGE_VERTEX_BIT;
@@ -1204,7 +2696,15 @@ private:
     // FRAGMENT shader
     sampler_layout_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-    std::array<VkDescriptorSetLayoutBinding, 2> bindings = {ubo_layout_binding, sampler_layout_binding};
+    // per instance transforms, indexed with gl_InstanceIndex
+    VkDescriptorSetLayoutBinding instance_layout_binding = {};
+    instance_layout_binding.binding         = 2;
+    instance_layout_binding.descriptorCount = 1;
+    instance_layout_binding.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    instance_layout_binding.stageFlags      = VK_SHADER_STAGE_VERTEX_BIT;
+
+    std::array<VkDescriptorSetLayoutBinding, 3> bindings = {ubo_layout_binding, sampler_layout_binding,
+        instance_layout_binding};
     VkDescriptorSetLayoutCreateInfo layout_info = {};
     layout_info.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
     layout_info.bindingCount = static_cast<uint32_t>(bindings.size());
@@ -1220,68 +2720,92 @@ private:
   // need, and a descriptor layout to base them on
   // descriptor sets do not need to be explicitly cleaned because the
   // they are freed when the pools are destroyed 
+  // a single set is enough since the uniform buffer binding is dynamic, every
+  // frame binds it with the offset of its own region in the uniform ring
   void create_descriptor_sets() {
-    std::vector<VkDescriptorSetLayout> layouts(swap_chain_images.size(), descriptor_set_layout);
+    descriptor_set = allocate_descriptor_set();
+  }
+
+
+  // a set that is bound by a submitted frame must not be updated, so every
+  // change of its resources gets a new one (see reload_texture)
+  VkDescriptorSet allocate_descriptor_set() {
     VkDescriptorSetAllocateInfo alloc_info = {};
     alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
     alloc_info.descriptorPool = descriptor_pool;
-    alloc_info.descriptorSetCount = static_cast<uint32_t>(swap_chain_images.size());
-    alloc_info.pSetLayouts = layouts.data();
+    alloc_info.descriptorSetCount = 1;
+    alloc_info.pSetLayouts = &descriptor_set_layout;
 
-    descriptor_sets.resize(swap_chain_images.size());
-    
-    if (vkAllocateDescriptorSets(device, &alloc_info, &descriptor_sets[0]) != VK_SUCCESS) {
+    VkDescriptorSet descriptor_set;
+    if (vkAllocateDescriptorSets(device, &alloc_info, &descriptor_set) != VK_SUCCESS) {
       throw std::runtime_error("failed to allocate descriptor sets!");
     }
 
-    for (size_t i = 0; i < swap_chain_images.size(); i++) {
-      VkDescriptorBufferInfo buffer_info = {};
-      buffer_info.buffer = uniform_buffers[i];
-      buffer_info.offset = 0;
-      buffer_info.range = sizeof(UniformBufferObject);
-
-      VkDescriptorImageInfo image_info = {};
-      image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-      image_info.imageView   = texture_image_view;
-      image_info.sampler     = texture_sampler;
-
-      std::array<VkWriteDescriptorSet, 2> descriptor_writes = {};
-
-      descriptor_writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-      descriptor_writes[0].dstSet = descriptor_sets[i];
-      descriptor_writes[0].dstBinding = 0;
-      descriptor_writes[0].dstArrayElement = 0;
-      descriptor_writes[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-      descriptor_writes[0].descriptorCount = 1;
-      descriptor_writes[0].pBufferInfo = &buffer_info;
-
-      descriptor_writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-      descriptor_writes[1].dstSet = descriptor_sets[i];
-      descriptor_writes[1].dstBinding = 1;
-      descriptor_writes[1].dstArrayElement = 0;
-      descriptor_writes[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-      descriptor_writes[1].descriptorCount = 1;
-      descriptor_writes[1].pImageInfo = &image_info;
-
-      vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptor_writes.size()), descriptor_writes.data(), 0, nullptr);
-    }
+    VkDescriptorBufferInfo buffer_info = {};
+    buffer_info.buffer = uniform_buffer;
+    buffer_info.offset = 0;
+    buffer_info.range = sizeof(UniformBufferObject);
+
+    VkDescriptorImageInfo image_info = {};
+    image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    image_info.imageView   = texture_image_view;
+    image_info.sampler     = texture_sampler;
+
+    VkDescriptorBufferInfo instance_info = {};
+    instance_info.buffer = instance_buffer;
+    instance_info.offset = 0;
+    instance_info.range  = VK_WHOLE_SIZE;
+
+    std::array<VkWriteDescriptorSet, 3> descriptor_writes = {};
+
+    descriptor_writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptor_writes[0].dstSet = descriptor_set;
+    descriptor_writes[0].dstBinding = 0;
+    descriptor_writes[0].dstArrayElement = 0;
+    descriptor_writes[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    descriptor_writes[0].descriptorCount = 1;
+    descriptor_writes[0].pBufferInfo = &buffer_info;
+
+    descriptor_writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptor_writes[1].dstSet = descriptor_set;
+    descriptor_writes[1].dstBinding = 1;
+    descriptor_writes[1].dstArrayElement = 0;
+    descriptor_writes[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptor_writes[1].descriptorCount = 1;
+    descriptor_writes[1].pImageInfo = &image_info;
+
+    descriptor_writes[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptor_writes[2].dstSet = descriptor_set;
+    descriptor_writes[2].dstBinding = 2;
+    descriptor_writes[2].dstArrayElement = 0;
+    descriptor_writes[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptor_writes[2].descriptorCount = 1;
+    descriptor_writes[2].pBufferInfo = &instance_info;
+
+    vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptor_writes.size()), descriptor_writes.data(), 0, nullptr);
+    return descriptor_set;
   }
 
 
   // similar to command buffers, we can't create descriptor sets by themselves
-  // they must be obtained from descriptor set pools
+  // they must be obtained from descriptor set pools. besides the set in use
+  // there is room for one retired set per frame in flight
   void create_descriptor_pool() {
-    std::array<VkDescriptorPoolSize, 2> pool_sizes = {};
-    pool_sizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    pool_sizes[0].descriptorCount = static_cast<uint32_t>(swap_chain_images.size());
+    const uint32_t set_count = 1 + MAX_FRAMES_IN_FLIGHT;
+    std::array<VkDescriptorPoolSize, 3> pool_sizes = {};
+    pool_sizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    pool_sizes[0].descriptorCount = set_count;
     pool_sizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    pool_sizes[1].descriptorCount = static_cast<uint32_t>(swap_chain_images.size());
+    pool_sizes[1].descriptorCount = set_count;
+    pool_sizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    pool_sizes[2].descriptorCount = set_count;
 
     VkDescriptorPoolCreateInfo pool_info = {};
     pool_info.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.flags         = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
     pool_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
     pool_info.pPoolSizes    = pool_sizes.data();
-    pool_info.maxSets       = static_cast<uint32_t>(swap_chain_images.size());
+    pool_info.maxSets       = set_count;
 
     if (vkCreateDescriptorPool(device, &pool_info, nullptr, &descriptor_pool) != VK_SUCCESS) {
       throw std::runtime_error("failed to create descriptor pool!");
@@ -1289,117 +2813,202 @@ private:
   }
 
 
+  // one persistently mapped buffer split into a region per frame in flight.
+  // the per draw transforms live in the instance buffer, so a frame only
+  // needs a single UniformBufferObject in its region
   void create_uniform_buffers() {
-    VkDeviceSize buffer_size = sizeof(UniformBufferObject);
-
-    uniform_buffers.resize(swap_chain_images.size());
-    uniform_buffers_memory.resize(swap_chain_images.size());
-
-    for (size_t i = 0; i < swap_chain_images.size(); i++) {
-      create_buffer(buffer_size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-          uniform_buffers[i], uniform_buffers_memory[i]);
-    }
-  }
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
 
+    VkDeviceSize alignment = properties.limits.minUniformBufferOffsetAlignment;
+    VkDeviceSize region_size = (UNIFORM_RING_REGION_SIZE + alignment - 1) / alignment * alignment;
 
-  void update_uniform_buffer(uint32_t current_image) {
-    static auto start_time = std::chrono::high_resolution_clock::now();
-
-    auto current_time = std::chrono::high_resolution_clock::now();
-    float time = std::chrono::duration<float, 
-          std::chrono::seconds::period>(current_time - start_time).count();
+    uint32_t region_count = MAX_FRAMES_IN_FLIGHT;
+    VkDeviceSize buffer_size = region_size * region_count;
 
-    UniformBufferObject ubo = {};
-    ubo.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f),
-        glm::vec3(0.0f, 0.0f, 1.0f));
-    ubo.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f),
-        glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-    ubo.proj = glm::perspective(glm::radians(45.0f),
-        swap_chain_extent.width / (float) swap_chain_extent.height,
-        0.1f, 10.0f);
-    ubo.proj[1][1] *= -1;
+    create_buffer(buffer_size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        uniform_buffer, uniform_buffer_memory);
 
-    void* data;
-    vkMapMemory(device, uniform_buffers_memory[current_image], 0, sizeof(ubo),
-        0, &data);
-    memcpy(data, &ubo, sizeof(ubo));
-    vkUnmapMemory(device, uniform_buffers_memory[current_image]);
+    // dynamic offsets must be multiples of minUniformBufferOffsetAlignment
+    uniform_ring.init(uniform_buffer_memory.mapped, region_size, region_count, alignment);
   }
 
 
   void create_index_buffer() {
-    VkDeviceSize buffer_size = sizeof(indices[0]) * indices.size();
+    VkDeviceSize buffer_size = index_data_size;
 
     VkBuffer staging_buffer;
-    VkDeviceMemory staging_buffer_memory;
+    Allocation staging_buffer_memory;
     create_buffer(buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        staging_buffer, staging_buffer_memory);
+        staging_buffer, staging_buffer_memory, ALLOCATION_STRATEGY_LINEAR);
 
-    void* data;
-    vkMapMemory(device, staging_buffer_memory, 0, buffer_size, 0, &data);
-    memcpy(data, indices.data(), (size_t) buffer_size);
-    vkUnmapMemory(device, staging_buffer_memory);
+    memcpy(staging_buffer_memory.mapped, index_data, (size_t) buffer_size);
 
     create_buffer(buffer_size,
         VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, index_buffer, index_buffer_memory);
 
     copy_buffer(staging_buffer, index_buffer, buffer_size);
+    hand_over_buffer(index_buffer, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT);
 
-    vkDestroyBuffer(device, staging_buffer, nullptr);
-    vkFreeMemory(device, staging_buffer_memory, nullptr);
+    // still being read by the upload, destroyed once it has completed
+    upload_context.retire(staging_buffer, staging_buffer_memory);
+
+    // the culling pass writes the draw commands of every sub-mesh
+    create_static_buffer(submeshes.data(), sizeof(submeshes[0]) * submeshes.size(),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+        submesh_buffer, submesh_buffer_memory);
   }
 
 
   void create_vertex_buffer() {
     // copy the vertex data to the buffer
-    // map the buffer memory into the CPU accessible memory with vkMapMemory
-    // buffer_info.size is the size of memory is the size of the accessible
-    // region in the memory resource
-    // we may also use VK_WHOLE_SIZE to map all of the memory
-    // 2nd to last parameter is for flags, currently unavailable and must be 0
-    // last parameter specifies output for the pointer to the mapped memory
-    VkDeviceSize buffer_size = sizeof(vertices[0]) * vertices.size();
+    // the allocator maps host visible blocks once with vkMapMemory (using
+    // VK_WHOLE_SIZE) and keeps them mapped, so the staging allocation already
+    // carries a pointer to CPU accessible memory
+    VkDeviceSize buffer_size = vertex_data_size;
+
+    std::cout << "vertex buffer: " << vertex_count << " vertices, "
+              << (options.packed_vertices ? sizeof(PackedVertex) : sizeof(Vertex)) << " bytes each, "
+              << buffer_size / 1024 << " KiB" << std::endl;
 
     VkBuffer staging_buffer;
-    VkDeviceMemory staging_buffer_memory;
+    Allocation staging_buffer_memory;
     create_buffer(buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        staging_buffer, staging_buffer_memory);
+        staging_buffer, staging_buffer_memory, ALLOCATION_STRATEGY_LINEAR);
 
-    void* data;
-    vkMapMemory(device, staging_buffer_memory, 0, buffer_size, 0, &data);
-    memcpy(data, vertices.data(), (size_t) buffer_size);
-    vkUnmapMemory(device, staging_buffer_memory);
+    memcpy(staging_buffer_memory.mapped, vertex_data, (size_t) buffer_size);
 
     create_buffer(buffer_size,
         VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertex_buffer, vertex_buffer_memory);
 
     copy_buffer(staging_buffer, vertex_buffer, buffer_size);
+    hand_over_buffer(vertex_buffer, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
 
-    vkDestroyBuffer(device, staging_buffer, nullptr);
-    vkFreeMemory(device, staging_buffer_memory, nullptr);
+    // still being read by the upload, destroyed once it has completed
+    upload_context.retire(staging_buffer, staging_buffer_memory);
   }
 
 
+  // the draws never move, so their transforms are uploaded once into a device
+  // local storage buffer the vertex shader indexes with gl_InstanceIndex
+  void create_instance_buffer() {
+    std::vector<InstanceData> instances(draws.size());
+    for (size_t i = 0; i < draws.size(); i++) {
+      instances[i].model = glm::translate(glm::mat4(1.0f), draws[i].position);
+    }
+
+    // read by the vertex shader and by the culling pass
+    create_static_buffer(instances.data(), sizeof(instances[0]) * instances.size(),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_ACCESS_SHADER_READ_BIT, instance_buffer, instance_buffer_memory);
+  }
+
+
+  // a device local buffer filled with data through the upload context and
+  // made visible to dst_stage on the graphics queue
+  void create_static_buffer(const void* data, VkDeviceSize size, VkBufferUsageFlags usage,
+      VkPipelineStageFlags dst_stage, VkAccessFlags dst_access, VkBuffer& buffer, Allocation& buffer_memory) {
+    VkBuffer staging_buffer;
+    Allocation staging_buffer_memory;
+    create_buffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        staging_buffer, staging_buffer_memory, ALLOCATION_STRATEGY_LINEAR);
+
+    memcpy(staging_buffer_memory.mapped, data, (size_t) size);
+
+    create_buffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, buffer_memory);
+
+    copy_buffer(staging_buffer, buffer, size);
+    hand_over_buffer(buffer, dst_stage, dst_access);
+
+    upload_context.retire(staging_buffer, staging_buffer_memory);
+  }
+
+
+  // quantizes every component to 16 bits within the bounding box of the mesh
+  // (and of its texture coordinates, which may lie outside [0, 1]) and sets
+  // the transforms that undo it in the vertex shader. the error is at most
+  // half a step, extent / 131070
+  std::vector<PackedVertex> pack_vertices() {
+    glm::vec3 min_pos(std::numeric_limits<float>::max());
+    glm::vec3 max_pos(-std::numeric_limits<float>::max());
+    glm::vec2 min_uv(std::numeric_limits<float>::max());
+    glm::vec2 max_uv(-std::numeric_limits<float>::max());
+    for (const auto& vertex : vertices) {
+      min_pos = glm::min(min_pos, vertex.pos);
+      max_pos = glm::max(max_pos, vertex.pos);
+      min_uv  = glm::min(min_uv, vertex.tex_coord);
+      max_uv  = glm::max(max_uv, vertex.tex_coord);
+    }
+
+    // a flat axis still needs a non-zero extent to divide by
+    glm::vec3 pos_extent = glm::max(max_pos - min_pos, glm::vec3(1e-6f));
+    glm::vec2 uv_extent  = glm::max(max_uv - min_uv, glm::vec2(1e-6f));
+
+    auto quantize = [](float value, float min, float extent) {
+      float normalized = std::min(std::max((value - min) / extent, 0.0f), 1.0f);
+      return static_cast<uint16_t>(normalized * 65535.0f + 0.5f);
+    };
+
+    std::vector<PackedVertex> packed(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++) {
+      for (int c = 0; c < 3; c++) {
+        packed[i].pos[c] = quantize(vertices[i].pos[c], min_pos[c], pos_extent[c]);
+      }
+      packed[i].pos[3] = 0;
+      for (int c = 0; c < 2; c++) {
+        packed[i].tex_coord[c] = quantize(vertices[i].tex_coord[c], min_uv[c], uv_extent[c]);
+      }
+    }
+
+    position_scale      = glm::vec4(pos_extent, 1.0f);
+    position_offset     = glm::vec4(min_pos, 0.0f);
+    tex_coord_transform = glm::vec4(uv_extent.x, uv_extent.y, min_uv.x, min_uv.y);
+    return packed;
+  }
+
+
+  // recorded into the upload context, runs when it is next submitted
   void copy_buffer(VkBuffer src_buffer, VkBuffer dst_buffer, VkDeviceSize size) {
-    VkCommandBuffer command_buffer = begin_single_time_commands();
+    VkCommandBuffer command_buffer = upload_context.transfer_commands();
 
     VkBufferCopy copy_region = {};
     copy_region.size = size;
     vkCmdCopyBuffer(command_buffer, src_buffer, dst_buffer, 1, &copy_region);
+  }
+
+
+  // once the upload has written the buffer, make it visible to (and if there
+  // is a separate transfer queue, hand its ownership over to) the graphics
+  // queue stage that reads it
+  void hand_over_buffer(VkBuffer buffer, VkPipelineStageFlags dst_stage, VkAccessFlags dst_access) {
+    VkBufferMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = dst_access;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = buffer;
+    barrier.offset = 0;
+    barrier.size   = VK_WHOLE_SIZE;
 
-    end_single_time_commands(command_buffer);
+    upload_context.hand_over_buffer(barrier, VK_PIPELINE_STAGE_TRANSFER_BIT, dst_stage);
   }
 
 
+  // recorded into the upload context like copy_buffer
   void transition_image_layout(VkImage image, VkFormat format, VkImageLayout old_layout,
-      VkImageLayout new_layout) {
-    VkCommandBuffer command_buffer = begin_single_time_commands();
+      VkImageLayout new_layout, uint32_t mip_levels) {
+    // transitions that only touch the transfer stage can go on the transfer
+    // queue, the rest need the graphics queue
+    VkCommandBuffer command_buffer = VK_NULL_HANDLE;
 
     VkImageMemoryBarrier barrier = {};
     barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -1416,7 +3025,7 @@ private:
     barrier.image = image;
     barrier.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
     barrier.subresourceRange.baseMipLevel   = 0;
-    barrier.subresourceRange.levelCount     = 1;
+    barrier.subresourceRange.levelCount     = mip_levels;
     barrier.subresourceRange.baseArrayLayer = 0;
     barrier.subresourceRange.layerCount     = 1;
 
@@ -1441,6 +3050,7 @@ private:
 
       source_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
       destination_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+      command_buffer = upload_context.transfer_commands();
     } else if (old_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL &&
         new_layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
       barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
@@ -1448,6 +3058,11 @@ private:
 
       source_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
       destination_stage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+
+      // the image was filled by the transfer side, it is sampled on the
+      // graphics queue
+      upload_context.hand_over_image(barrier, source_stage, destination_stage);
+      return;
     } else if (old_layout == VK_IMAGE_LAYOUT_UNDEFINED &&
         new_layout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
       barrier.srcAccessMask = 0;
@@ -1456,6 +3071,7 @@ private:
 
       source_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
       destination_stage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+      command_buffer = upload_context.graphics_commands();
     } else {
       throw std::invalid_argument("unsupported layout transition!");
     }
@@ -1477,13 +3093,11 @@ private:
         0, nullptr,
         1, &barrier
     );
-
-    end_single_time_commands(command_buffer);
   }
 
 
   void copy_buffer_to_image(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height) {
-    VkCommandBuffer command_buffer = begin_single_time_commands();
+    VkCommandBuffer command_buffer = upload_context.transfer_commands();
 
     VkBufferImageCopy region = {};
     region.bufferOffset      = 0;
@@ -1500,8 +3114,22 @@ private:
 
     vkCmdCopyBufferToImage(command_buffer, buffer, image,
         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+  }
+
 
-    end_single_time_commands(command_buffer);
+  // whether find_memory_type would succeed for a resource with these
+  // requirements
+  bool has_memory_type(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties) {
+    VkPhysicalDeviceMemoryProperties mem_properties;
+    vkGetPhysicalDeviceMemoryProperties(physical_device, &mem_properties);
+
+    for (uint32_t i = 0; i < mem_properties.memoryTypeCount; i++) {
+      if ((requirements.memoryTypeBits & (1 << i)) &&
+          (mem_properties.memoryTypes[i].propertyFlags & properties) == properties) {
+        return true;
+      }
+    }
+    return false;
   }
 
 
@@ -1529,89 +3157,869 @@ private:
   }
 
 
+  // only allocates, recording happens every frame in record_command_buffers
   void create_command_buffers() {
-    command_buffers.resize(swap_chain_framebuffers.size());
-
-    VkCommandBufferAllocateInfo alloc_info = {};
-    alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    alloc_info.commandPool = command_pool;
-    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    alloc_info.commandBufferCount = (uint32_t) command_buffers.size();
-
-    if (vkAllocateCommandBuffers(device, &alloc_info, command_buffers.data()) != VK_SUCCESS) {
-      throw std::runtime_error("failed to allocate command buffers!");
-    }
+    for (auto& frame : frame_commands) {
+      VkCommandBufferAllocateInfo alloc_info = {};
+      alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+      alloc_info.commandPool = frame.primary_pool;
+      alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+      alloc_info.commandBufferCount = 1;
+
+      if (vkAllocateCommandBuffers(device, &alloc_info, &frame.primary) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate command buffers!");
+      }
 
-    for (size_t i = 0; i < command_buffers.size(); i++) {
-      VkCommandBufferBeginInfo begin_info = {};
-      begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-      begin_info.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+      frame.secondaries.resize(frame.secondary_pools.size());
+      for (size_t i = 0; i < frame.secondary_pools.size(); i++) {
+        alloc_info.commandPool = frame.secondary_pools[i];
+        alloc_info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
 
-      if (vkBeginCommandBuffer(command_buffers[i], &begin_info) != VK_SUCCESS) {
-        throw std::runtime_error("failed to begin recording command buffer!");
+        if (vkAllocateCommandBuffers(device, &alloc_info, &frame.secondaries[i]) != VK_SUCCESS) {
+          throw std::runtime_error("failed to allocate command buffers!");
+        }
       }
+    }
+  }
 
-      VkRenderPassBeginInfo render_pass_info = {};
-      render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-      render_pass_info.renderPass = render_pass;
-      render_pass_info.framebuffer = swap_chain_framebuffers[i];
-      render_pass_info.renderArea.offset = {0, 0};
-      render_pass_info.renderArea.extent = swap_chain_extent;
-
-      std::array<VkClearValue, 2> clear_values = {};
-      clear_values[0].color = {0.0f, 0.0f, 0.0f, 1.0f};
-      clear_values[1].depthStencil = {1.0f, 0};
 
-      render_pass_info.clearValueCount = static_cast<uint32_t>(clear_values.size());
-      render_pass_info.pClearValues = clear_values.data();
+  // lays the draws out on a square grid around the origin. the instancing
+  // benchmark needs room for its largest run
+  void create_draw_list() {
+    uint32_t count = options.draw_count;
+    if (options.benchmark_instancing) {
+      count = std::max(count, INSTANCING_BENCHMARK_MAX_INSTANCES);
+    }
 
-      vkCmdBeginRenderPass(command_buffers[i], &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
+    uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(count))));
+    float half = (side - 1) * DRAW_SPACING * 0.5f;
 
-      vkCmdBindPipeline(command_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics_pipeline);
+    draws.resize(count);
+    for (uint32_t i = 0; i < count; i++) {
+      draws[i].position = glm::vec3((i % side) * DRAW_SPACING - half, (i / side) * DRAW_SPACING - half, 0.0f);
+    }
 
-      VkBuffer vertex_buffers[] = {vertex_buffer};
-      VkDeviceSize offsets[] = {0};
-      // binds vertex buffers to bindings
-      // parameters:
-      //   -command buffer
-      //   -offset
-      //   -number of bindings
-      //   -array of vertex buffers to bind
-      //   -byte offsets to start reading vertex data from
-      vkCmdBindVertexBuffers(command_buffers[i], 0, 1, vertex_buffers, offsets);
+    draw_count = options.draw_count;
+    draw_mode  = options.draw_mode;
+  }
 
-      vkCmdBindIndexBuffer(command_buffers[i], index_buffer, 0, VK_INDEX_TYPE_UINT32);
 
-      vkCmdBindDescriptorSets(command_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
-          pipeline_layout, 0, 1, &descriptor_sets[i], 0, nullptr);
+  // records the frame with thread_count recording threads. the frame's
+  // previous submission must have finished, its pools and uniform region are
+  // reused here
+  void record_command_buffers(uint32_t frame, uint32_t image_index, uint32_t thread_count) {
+    static auto start_time = std::chrono::high_resolution_clock::now();
 
-      vkCmdDrawIndexed(command_buffers[i], static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
+    auto current_time = std::chrono::high_resolution_clock::now();
+    float time = std::chrono::duration<float, 
+          std::chrono::seconds::period>(current_time - start_time).count();
 
-      vkCmdEndRenderPass(command_buffers[i]);
+    FrameCommands& commands = frame_commands[frame];
+    thread_count = std::min(thread_count, static_cast<uint32_t>(commands.secondaries.size()));
+    // a single (instanced or indirect) draw isn't worth splitting up
+    if (draw_mode != DRAW_MODE_DIRECT) {
+      thread_count = 1;
+    }
 
-      if (vkEndCommandBuffer(command_buffers[i]) != VK_SUCCESS) {
-        throw std::runtime_error("failed to record command buffer!");
-      }
+    // resetting the pool recycles the memory of every command buffer
+    // allocated from it at once
+    vkResetCommandPool(device, commands.primary_pool, 0);
+    for (uint32_t i = 0; i < thread_count; i++) {
+      vkResetCommandPool(device, commands.secondary_pools[i], 0);
     }
-  }
 
-  
-  void create_sync_objects() {
-    image_available_semaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    render_finished_semaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    in_flight_fences.resize(MAX_FRAMES_IN_FLIGHT);
+    // pull the camera back far enough to see the whole grid
+    float grid_size = std::sqrt(static_cast<float>(draw_count)) * DRAW_SPACING;
+    float distance  = std::max(1.0f, grid_size * 0.5f) * camera_distance_scale;
+    glm::vec3 camera = glm::vec3(2.0f, 2.0f, 2.0f) * distance;
+
+    UniformBufferObject ubo = {};
+    ubo.view = glm::lookAt(camera,
+        glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    ubo.proj = glm::perspective(glm::radians(45.0f),
+        swap_chain_extent.width / (float) swap_chain_extent.height,
+        0.1f, 10.0f * distance);
+    ubo.proj[1][1] *= -1;
+    ubo.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f),
+        glm::vec3(0.0f, 0.0f, 1.0f));
+    ubo.position_scale      = position_scale;
+    ubo.position_offset     = position_offset;
+    ubo.tex_coord_transform = tex_coord_transform;
+
+    // no map/unmap, one pointer bump in the region of this frame. the draws
+    // only differ in their instance transform, so they all share it
+    uniform_ring.begin_region(frame);
+    uint32_t uniform_offset = uniform_ring.push(ubo);
+    last_lod_selection = make_lod_selection(camera, ubo);
+
+    recording_threads.parallel_for(draw_count, thread_count,
+        [&](uint32_t partition, size_t begin, size_t end) {
+          record_secondary(commands.secondaries[partition], frame, image_index, uniform_offset,
+              last_lod_selection, begin, end);
+        });
+
+    VkCommandBufferBeginInfo begin_info = {};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    if (vkBeginCommandBuffer(commands.primary, &begin_info) != VK_SUCCESS) {
+      throw std::runtime_error("failed to begin recording command buffer!");
+    }
+
+    VkRenderPassBeginInfo render_pass_info = {};
+    render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    render_pass_info.renderPass = render_pass;
+    render_pass_info.framebuffer = swap_chain_framebuffers[image_index];
+    render_pass_info.renderArea.offset = {0, 0};
+    render_pass_info.renderArea.extent = swap_chain_extent;
+
+    std::array<VkClearValue, 2> clear_values = {};
+    clear_values[0].color = {0.0f, 0.0f, 0.0f, 1.0f};
+    clear_values[1].depthStencil = {1.0f, 0};
+
+    render_pass_info.clearValueCount = static_cast<uint32_t>(clear_values.size());
+    render_pass_info.pClearValues = clear_values.data();
+
+    gpu_profiler.begin_frame(commands.primary, frame);
+    if (draw_mode == DRAW_MODE_GPU_CULLED) {
+      record_culling(commands.primary, frame, ubo, last_lod_selection);
+    }
+
+    // the contents of the subpass come from the secondary command buffers
+    uint32_t render_pass_scope = gpu_profiler.begin_scope(commands.primary, frame, "render pass");
+
+    vkCmdBeginRenderPass(commands.primary, &render_pass_info, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+    vkCmdExecuteCommands(commands.primary, thread_count, commands.secondaries.data());
+    vkCmdEndRenderPass(commands.primary);
+
+    gpu_profiler.end_scope(commands.primary, frame, render_pass_scope);
+
+    if (vkEndCommandBuffer(commands.primary) != VK_SUCCESS) {
+      throw std::runtime_error("failed to record command buffer!");
+    }
+  }
+
+
+  // runs on a recording thread, draws [begin, end) of the draw list
+  void record_secondary(VkCommandBuffer command_buffer, uint32_t frame, uint32_t image_index,
+      uint32_t uniform_offset, const LodSelection& lod_selection, size_t begin, size_t end) {
+    // secondaries that run inside a render pass have to say which one
+    VkCommandBufferInheritanceInfo inheritance_info = {};
+    inheritance_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritance_info.renderPass  = render_pass;
+    inheritance_info.subpass     = 0;
+    inheritance_info.framebuffer = swap_chain_framebuffers[image_index];
+
+    VkCommandBufferBeginInfo begin_info = {};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT |
+        VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    begin_info.pInheritanceInfo = &inheritance_info;
+
+    if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS) {
+      throw std::runtime_error("failed to begin recording command buffer!");
+    }
+
+    // no state is inherited from the primary, each secondary sets up its own
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphics_pipeline);
+
+    VkViewport viewport = {};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width    = (float) swap_chain_extent.width;
+    viewport.height   = (float) swap_chain_extent.height;
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+
+    VkRect2D scissor = {};
+    scissor.offset   = {0, 0};
+    scissor.extent   = swap_chain_extent;
+    vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+
+    VkBuffer vertex_buffers[] = {vertex_buffer};
+    VkDeviceSize offsets[] = {0};
+    // binds vertex buffers to bindings
+    // parameters:
+    //   -command buffer
+    //   -offset
+    //   -number of bindings
+    //   -array of vertex buffers to bind
+    //   -byte offsets to start reading vertex data from
+    vkCmdBindVertexBuffers(command_buffer, 0, 1, vertex_buffers, offsets);
+
+    vkCmdBindIndexBuffer(command_buffer, index_buffer, 0, index_type);
+
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+        pipeline_layout, 0, 1, &descriptor_set, 1, &uniform_offset);
+
+    // gl_InstanceIndex starts at firstInstance, so both ways pick the
+    // transform of draw i out of the instance buffer
+    if (draw_mode == DRAW_MODE_GPU_CULLED) {
+      record_indirect_draws(command_buffer, frame);
+    } else if (draw_mode == DRAW_MODE_INSTANCED) {
+      // all instances of a draw call share its LOD, the closest one decides
+      if (end > begin) {
+        uint32_t lod = static_cast<uint32_t>(lods.size()) - 1;
+        for (size_t i = begin; i < end && lod > 0; i++) {
+          lod = std::min(lod, select_lod(lod_selection, draws[i].position));
+        }
+        record_model_draws(command_buffer, lods[lod], static_cast<uint32_t>(begin),
+            static_cast<uint32_t>(end - begin));
+      }
+    } else {
+      for (size_t i = begin; i < end; i++) {
+        record_model_draws(command_buffer, lods[select_lod(lod_selection, draws[i].position)],
+            static_cast<uint32_t>(i), 1);
+      }
+    }
+
+    if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+      throw std::runtime_error("failed to record command buffer!");
+    }
+  }
+
+
+  // one draw call per sub-mesh of the LOD
+  void record_model_draws(VkCommandBuffer command_buffer, const MeshLod& lod, uint32_t first_instance,
+      uint32_t instance_count) {
+    for (uint32_t i = lod.first_submesh; i < lod.first_submesh + lod.submesh_count; i++) {
+      vkCmdDrawIndexed(command_buffer, submeshes[i].index_count, instance_count, submeshes[i].first_index,
+          submeshes[i].vertex_offset, first_instance);
+    }
+  }
+
+
+  // a LOD is good enough for a draw at distance d if its error, projected to
+  // the screen, stays below lod_error_pixels:
+  //   error * proj[1][1] * height / 2 / d <= lod_error_pixels
+  // that is error * scale <= d, with scale worked out here once per frame. d
+  // is measured to the bounding sphere so the closest point of the model
+  // decides. cull.comp does the same on the GPU
+  LodSelection make_lod_selection(const glm::vec3& camera, const UniformBufferObject& ubo) const {
+    LodSelection selection;
+    selection.camera = camera;
+    selection.center = glm::vec3(ubo.model * glm::vec4(glm::vec3(model_bounds), 1.0f));
+    selection.radius = model_bounds.w;
+    // 0 pixels always picks LOD 0
+    selection.scale  = options.lod_error_pixels > 0.0f ?
+        std::abs(ubo.proj[1][1]) * 0.5f * swap_chain_extent.height / options.lod_error_pixels :
+        std::numeric_limits<float>::infinity();
+    return selection;
+  }
+
+
+  // the coarsest LOD that is good enough for the draw at position
+  uint32_t select_lod(const LodSelection& selection, const glm::vec3& position) const {
+    float distance = glm::length(position + selection.center - selection.camera) - selection.radius;
+    for (uint32_t l = static_cast<uint32_t>(lods.size()) - 1; l > 0; l--) {
+      if (lods[l].error * selection.scale <= distance) return l;
+    }
+    return 0;
+  }
+
+
+  // the most draw commands one draw can turn into
+  uint32_t max_lod_submeshes() const {
+    uint32_t count = 0;
+    for (const auto& lod : lods) count = std::max(count, lod.submesh_count);
+    return count;
+  }
+
+
+  // triangles the draw list is drawn with in the current draw mode (before
+  // any culling), plus the finest and coarsest LOD in use
+  uint64_t count_lod_triangles(const LodSelection& selection, uint32_t& finest, uint32_t& coarsest) const {
+    std::vector<uint32_t> selected(draw_count);
+    for (uint32_t i = 0; i < draw_count; i++) {
+      selected[i] = select_lod(selection, draws[i].position);
+    }
+    if (draw_mode == DRAW_MODE_INSTANCED && draw_count > 0) {
+      std::fill(selected.begin(), selected.end(), *std::min_element(selected.begin(), selected.end()));
+    }
+
+    uint64_t triangles = 0;
+    finest   = static_cast<uint32_t>(lods.size()) - 1;
+    coarsest = 0;
+    for (uint32_t lod : selected) {
+      triangles += lods[lod].index_count / 3;
+      finest   = std::min(finest, lod);
+      coarsest = std::max(coarsest, lod);
+    }
+    return triangles;
+  }
+
+
+  // records frames without submitting them, for 1 up to every recording
+  // thread, and prints the time per frame
+  void benchmark_recording() {
+    vkDeviceWaitIdle(device);
+
+    std::cout << "command recording, " << draw_count << " draws, "
+              << RECORDING_BENCHMARK_FRAMES << " frames per run" << std::endl;
+
+    float single_thread_ms = 0.0f;
+    for (uint32_t thread_count = 1; thread_count <= recording_threads.size(); thread_count++) {
+      // first one warms up the pools
+      record_command_buffers(0, 0, thread_count);
+
+      auto start_time = std::chrono::high_resolution_clock::now();
+      for (int i = 0; i < RECORDING_BENCHMARK_FRAMES; i++) {
+        record_command_buffers(0, 0, thread_count);
+      }
+      float frame_ms = std::chrono::duration<float, std::chrono::milliseconds::period>(
+          std::chrono::high_resolution_clock::now() - start_time).count() / RECORDING_BENCHMARK_FRAMES;
+
+      if (thread_count == 1) single_thread_ms = frame_ms;
+      std::cout << "  " << std::setw(2) << thread_count << " threads: " << std::fixed << std::setprecision(3)
+                << frame_ms << " ms/frame, speedup " << std::setprecision(2) << single_thread_ms / frame_ms
+                << std::defaultfloat << std::endl;
+    }
+  }
+
+
+  // renders INSTANCING_BENCHMARK_FRAMES frames for 1, 10, ... up to
+  // INSTANCING_BENCHMARK_MAX_INSTANCES copies of the model in every draw mode
+  // and prints the average frame time of each. use --headless or
+  // --present-mode immediate, with vsync every run just measures the refresh
+  // rate
+  void benchmark_instancing() {
+    DrawMode modes[] = {DRAW_MODE_DIRECT, DRAW_MODE_INSTANCED, DRAW_MODE_GPU_CULLED};
+    int mode_count = supports_gpu_culling ? 3 : 2;
+
+    std::cout << "instancing, " << INSTANCING_BENCHMARK_FRAMES << " frames per run" << std::endl;
+    std::cout << "  instances    per draw (ms)   instanced (ms)"
+              << (supports_gpu_culling ? "  gpu culled (ms)" : "") << std::endl;
+
+    for (uint32_t count = 1; count <= INSTANCING_BENCHMARK_MAX_INSTANCES; count *= 10) {
+      std::cout << "  " << std::setw(9) << count << std::fixed << std::setprecision(3);
+      for (int i = 0; i < mode_count; i++) {
+        draw_count = count;
+        draw_mode  = modes[i];
+        std::cout << std::setw(17) << time_frames(INSTANCING_BENCHMARK_FRAMES) << std::flush;
+      }
+      std::cout << std::defaultfloat << std::endl;
+    }
+
+    draw_count = options.draw_count;
+    draw_mode  = options.draw_mode;
+  }
+
+
+  // renders LOD_BENCHMARK_FRAMES frames with the camera pulled back by every
+  // factor of LOD_BENCHMARK_DISTANCES, once selecting LODs and once with
+  // LOD 0 only, and prints the triangles drawn and the frame times. like the
+  // instancing benchmark this wants --headless or --present-mode immediate
+  void benchmark_lod() {
+    std::cout << "lod selection, " << draw_count << " draws, " << lods.size() << " lods, "
+              << options.lod_error_pixels << " pixel error, " << LOD_BENCHMARK_FRAMES << " frames per run"
+              << std::endl;
+    std::cout << "  distance   lods    triangles (lod 0 only)      lod (ms)  lod 0 only (ms)" << std::endl;
+
+    float error_pixels = options.lod_error_pixels;
+    uint64_t full_triangles = static_cast<uint64_t>(draw_count) * (lods[0].index_count / 3);
+    for (float scale : LOD_BENCHMARK_DISTANCES) {
+      camera_distance_scale = scale;
+
+      options.lod_error_pixels = error_pixels;
+      float lod_ms = time_frames(LOD_BENCHMARK_FRAMES);
+      uint32_t finest, coarsest;
+      uint64_t triangles = count_lod_triangles(last_lod_selection, finest, coarsest);
+
+      options.lod_error_pixels = 0.0f;
+      float full_ms = time_frames(LOD_BENCHMARK_FRAMES);
+
+      std::cout << "  " << std::setw(7) << scale << "x   " << finest << "-" << coarsest << "  "
+                << std::setw(11) << triangles << " (" << std::setw(10) << full_triangles << ")"
+                << std::fixed << std::setprecision(3) << std::setw(14) << lod_ms << std::setw(17) << full_ms
+                << std::defaultfloat << std::endl;
+    }
+
+    options.lod_error_pixels = error_pixels;
+    camera_distance_scale = 1.0f;
+  }
+
+
+  // parses MODEL_PATH OBJ_BENCHMARK_RUNS times with LoadObj and with
+  // LoadObjParallel on 1, 2, 4, ... threads up to one per hardware thread,
+  // prints the throughput of the fastest run of each and checks that every
+  // parallel result matches the serial one
+  void benchmark_obj_loading() {
+    std::ifstream file(MODEL_PATH, std::ios::ate | std::ios::binary);
+    if (!file.is_open()) {
+      throw std::runtime_error("failed to open " + MODEL_PATH + "!");
+    }
+    float file_mb = static_cast<float>(file.tellg()) / (1024.0f * 1024.0f);
+
+    tinyobj::attrib_t serial_attrib;
+    std::vector<tinyobj::shape_t> serial_shapes;
+    auto load = [this](uint32_t thread_count, tinyobj::attrib_t& attrib, std::vector<tinyobj::shape_t>& shapes) {
+      float best_ms = std::numeric_limits<float>::max();
+      for (int run = 0; run < OBJ_BENCHMARK_RUNS; run++) {
+        std::vector<tinyobj::material_t> materials;
+        std::string err;
+
+        auto start_time = std::chrono::high_resolution_clock::now();
+        bool loaded = thread_count == 0 ?
+            tinyobj::LoadObj(&attrib, &shapes, &materials, &err, MODEL_PATH.c_str()) :
+            obj_parallel::LoadObjParallel(&attrib, &shapes, &materials, &err, MODEL_PATH.c_str(), nullptr, true,
+                thread_count);
+        if (!loaded) {
+          throw std::runtime_error(err);
+        }
+        best_ms = std::min(best_ms, std::chrono::duration<float, std::chrono::milliseconds::period>(
+            std::chrono::high_resolution_clock::now() - start_time).count());
+      }
+      return best_ms;
+    };
+
+    std::cout << "obj loading, " << MODEL_PATH << " " << std::fixed << std::setprecision(1) << file_mb
+              << " MB, fastest of " << OBJ_BENCHMARK_RUNS << " runs" << std::endl;
+
+    float serial_ms = load(0, serial_attrib, serial_shapes);
+    std::cout << "  serial:     " << std::setw(8) << serial_ms << " ms " << std::setw(8)
+              << file_mb * 1000.0f / serial_ms << " MB/s" << std::endl;
+
+    uint32_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+    for (uint32_t thread_count = 1; ; thread_count = std::min(thread_count * 2, max_threads)) {
+      tinyobj::attrib_t attrib;
+      std::vector<tinyobj::shape_t> shapes;
+      float parallel_ms = load(thread_count, attrib, shapes);
+
+      std::cout << "  " << std::setw(2) << thread_count << " threads: " << std::setw(8) << parallel_ms << " ms "
+                << std::setw(8) << file_mb * 1000.0f / parallel_ms << " MB/s, speedup " << std::setprecision(2)
+                << serial_ms / parallel_ms << std::setprecision(1)
+                << (same_obj(serial_attrib, serial_shapes, attrib, shapes) ? "" : ", DIFFERS FROM SERIAL")
+                << std::endl;
+
+      if (thread_count == max_threads) break;
+    }
+    std::cout << std::defaultfloat;
+  }
+
+
+  // compares the unordered_map<Vertex> deduplication load_model used to do
+  // with deduplicate_vertices and deduplicate_vertices_parallel on 1 up to
+  // one thread per hardware thread. every copy of the corners references its
+  // own copy of the positions, moved along x so the baseline doesn't merge
+  // them
+  void benchmark_dedup() {
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string err;
+    if (!obj_parallel::LoadObjParallel(&attrib, &shapes, &materials, &err, MODEL_PATH.c_str())) {
+      throw std::runtime_error(err);
+    }
+
+    std::vector<uint64_t> model_keys = corner_keys(shapes);
+    uint32_t position_count = static_cast<uint32_t>(attrib.vertices.size() / 3);
+    uint32_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+
+    auto time_runs = [](const std::function<void()>& run) {
+      float best_ms = std::numeric_limits<float>::max();
+      for (int i = 0; i < DEDUP_BENCHMARK_RUNS; i++) {
+        auto start_time = std::chrono::high_resolution_clock::now();
+        run();
+        best_ms = std::min(best_ms, std::chrono::duration<float, std::chrono::milliseconds::period>(
+            std::chrono::high_resolution_clock::now() - start_time).count());
+      }
+      return best_ms;
+    };
+
+    std::cout << "vertex deduplication, " << MODEL_PATH << ", fastest of " << DEDUP_BENCHMARK_RUNS << " runs"
+              << std::fixed << std::setprecision(1) << std::endl;
+
+    for (uint32_t copies : DEDUP_BENCHMARK_COPIES) {
+      std::vector<uint64_t> keys;
+      keys.reserve(model_keys.size() * copies);
+      for (uint32_t copy = 0; copy < copies; copy++) {
+        for (uint64_t key : model_keys) keys.push_back(key + (static_cast<uint64_t>(copy * position_count) << 32));
+      }
+      float million_corners = keys.size() / 1e6f;
+
+      std::vector<uint32_t> baseline_indices;
+      size_t baseline_vertices = 0;
+      float baseline_ms = time_runs([&] {
+        std::unordered_map<Vertex, uint32_t> unique_vertices;
+        std::vector<Vertex> unique;
+        baseline_indices.clear();
+        for (uint64_t key : keys) {
+          uint32_t position_index = static_cast<uint32_t>(key >> 32);
+          Vertex vertex = corner_vertex(attrib, vertex_key(position_index % position_count, static_cast<uint32_t>(key)));
+          vertex.pos.x += static_cast<float>(position_index / position_count) * 1000.0f;
+
+          if (unique_vertices.count(vertex) == 0) {
+            unique_vertices[vertex] = static_cast<uint32_t>(unique.size());
+            unique.push_back(vertex);
+          }
+          baseline_indices.push_back(unique_vertices[vertex]);
+        }
+        baseline_vertices = unique.size();
+      });
+
+      std::vector<uint32_t> serial_indices, serial_first_corners;
+      float serial_ms = time_runs([&] { deduplicate_vertices(keys, serial_indices, serial_first_corners); });
+
+      std::cout << "  " << copies << "x, " << keys.size() << " corners, " << serial_first_corners.size()
+                << " vertices (" << baseline_vertices << " by value)" << std::endl;
+      std::cout << "    unordered_map:   " << std::setw(8) << baseline_ms << " ms " << std::setw(8)
+                << million_corners * 1000.0f / baseline_ms << " M corners/s" << std::endl;
+      std::cout << "    open addressing: " << std::setw(8) << serial_ms << " ms " << std::setw(8)
+                << million_corners * 1000.0f / serial_ms << " M corners/s, speedup " << std::setprecision(2)
+                << baseline_ms / serial_ms << std::setprecision(1) << std::endl;
+
+      for (uint32_t thread_count = 1; ; thread_count = std::min(thread_count * 2, max_threads)) {
+        ThreadPool pool;
+        pool.init(thread_count);
+        std::vector<uint32_t> parallel_indices, parallel_first_corners;
+        float parallel_ms = time_runs([&] {
+          deduplicate_vertices_parallel(pool, keys, parallel_indices, parallel_first_corners);
+        });
+
+        bool same = parallel_indices == serial_indices && parallel_first_corners == serial_first_corners;
+        std::cout << "    " << std::setw(2) << thread_count << " threads:      " << std::setw(8) << parallel_ms
+                  << " ms " << std::setw(8) << million_corners * 1000.0f / parallel_ms << " M corners/s, speedup "
+                  << std::setprecision(2) << baseline_ms / parallel_ms << std::setprecision(1)
+                  << (same ? "" : ", DIFFERS FROM SERIAL") << std::endl;
+
+        if (thread_count == max_threads) break;
+      }
+    }
+    std::cout << std::defaultfloat;
+  }
+
+
+  static bool same_obj(const tinyobj::attrib_t& a, const std::vector<tinyobj::shape_t>& a_shapes,
+      const tinyobj::attrib_t& b, const std::vector<tinyobj::shape_t>& b_shapes) {
+    if (a.vertices != b.vertices || a.normals != b.normals || a.texcoords != b.texcoords ||
+        a.colors != b.colors || a_shapes.size() != b_shapes.size()) {
+      return false;
+    }
+
+    for (size_t i = 0; i < a_shapes.size(); i++) {
+      const tinyobj::shape_t& x = a_shapes[i];
+      const tinyobj::shape_t& y = b_shapes[i];
+      if (x.name != y.name || x.mesh.num_face_vertices != y.mesh.num_face_vertices ||
+          x.mesh.material_ids != y.mesh.material_ids || x.mesh.smoothing_group_ids != y.mesh.smoothing_group_ids ||
+          x.mesh.indices.size() != y.mesh.indices.size() || x.mesh.tags.size() != y.mesh.tags.size() ||
+          x.path.indices != y.path.indices) {
+        return false;
+      }
+      for (size_t j = 0; j < x.mesh.indices.size(); j++) {
+        if (x.mesh.indices[j].vertex_index != y.mesh.indices[j].vertex_index ||
+            x.mesh.indices[j].normal_index != y.mesh.indices[j].normal_index ||
+            x.mesh.indices[j].texcoord_index != y.mesh.indices[j].texcoord_index) {
+          return false;
+        }
+      }
+      for (size_t j = 0; j < x.mesh.tags.size(); j++) {
+        if (x.mesh.tags[j].name != y.mesh.tags[j].name || x.mesh.tags[j].intValues != y.mesh.tags[j].intValues ||
+            x.mesh.tags[j].floatValues != y.mesh.tags[j].floatValues ||
+            x.mesh.tags[j].stringValues != y.mesh.tags[j].stringValues) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+
+  // average wall time of frame_count frames, including the time the GPU needs
+  // to finish the last of them
+  float time_frames(int frame_count) {
+    // one frame per frame in flight to get the pipeline going
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+      options.headless ? draw_frame_headless() : draw_frame();
+    }
+    vkDeviceWaitIdle(device);
+
+    auto start_time = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < frame_count; i++) {
+      if (!options.headless) {
+        glfwPollEvents();
+      }
+      options.headless ? draw_frame_headless() : draw_frame();
+      upload_context.collect();
+    }
+    vkDeviceWaitIdle(device);
+
+    return std::chrono::duration<float, std::chrono::milliseconds::period>(
+        std::chrono::high_resolution_clock::now() - start_time).count() / frame_count;
+  }
+
+
+  // --gpu-culling draws with the culling pass, --benchmark-instancing runs
+  // it as one of its modes when the device can
+  bool culling_enabled() const {
+    return options.draw_mode == DRAW_MODE_GPU_CULLED ||
+        (options.benchmark_instancing && supports_gpu_culling);
+  }
+
+
+  // pipeline, indirect buffers and descriptor sets of the culling pass. every
+  // frame in flight gets its own indirect buffer since the compute pass of
+  // one frame may run while the previous one is still drawing
+  void create_culling_resources() {
+    if (draw_mode == DRAW_MODE_GPU_CULLED && !supports_gpu_culling) {
+      throw std::runtime_error("gpu culling needs the drawIndirectFirstInstance feature!");
+    }
+
+    std::array<VkDescriptorSetLayoutBinding, 4> bindings = {};
+    bindings[0].binding        = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    bindings[1].binding        = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[2].binding        = 2;
+    bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[3].binding        = 3;
+    bindings[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    for (auto& binding : bindings) {
+      binding.descriptorCount = 1;
+      binding.stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layout_info = {};
+    layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_info.bindingCount = static_cast<uint32_t>(bindings.size());
+    layout_info.pBindings    = bindings.data();
+
+    if (vkCreateDescriptorSetLayout(device, &layout_info, nullptr, &cull_descriptor_set_layout) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create cull descriptor set layout!");
+    }
+
+    VkPipelineLayoutCreateInfo pipeline_layout_info = {};
+    pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipeline_layout_info.setLayoutCount = 1;
+    pipeline_layout_info.pSetLayouts    = &cull_descriptor_set_layout;
+
+    if (vkCreatePipelineLayout(device, &pipeline_layout_info, nullptr, &cull_pipeline_layout) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create cull pipeline layout!");
+    }
+
+    VkShaderModule shader_module = create_shader_module(read_file("shaders/cull.spv"));
+
+    VkComputePipelineCreateInfo pipeline_info = {};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipeline_info.stage.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipeline_info.stage.stage  = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipeline_info.stage.module = shader_module;
+    pipeline_info.stage.pName  = "main";
+    pipeline_info.layout = cull_pipeline_layout;
+
+    if (vkCreateComputePipelines(device, pipeline_cache.get(), 1, &pipeline_info, nullptr, &cull_pipeline) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create cull pipeline!");
+    }
+    vkDestroyShaderModule(device, shader_module, nullptr);
+
+    VkDeviceSize indirect_size = INDIRECT_COMMANDS_OFFSET +
+        sizeof(VkDrawIndexedIndirectCommand) * draws.size() * max_lod_submeshes();
+    indirect_buffers.resize(MAX_FRAMES_IN_FLIGHT);
+    indirect_buffers_memory.resize(MAX_FRAMES_IN_FLIGHT);
+    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+      create_buffer(indirect_size,
+          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indirect_buffers[i], indirect_buffers_memory[i]);
+    }
+
+    std::array<VkDescriptorPoolSize, 2> pool_sizes = {};
+    pool_sizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    pool_sizes[0].descriptorCount = MAX_FRAMES_IN_FLIGHT;
+    pool_sizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    pool_sizes[1].descriptorCount = 3 * MAX_FRAMES_IN_FLIGHT;
+
+    VkDescriptorPoolCreateInfo pool_info = {};
+    pool_info.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+    pool_info.pPoolSizes    = pool_sizes.data();
+    pool_info.maxSets       = MAX_FRAMES_IN_FLIGHT;
+
+    if (vkCreateDescriptorPool(device, &pool_info, nullptr, &cull_descriptor_pool) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create cull descriptor pool!");
+    }
+
+    std::vector<VkDescriptorSetLayout> set_layouts(MAX_FRAMES_IN_FLIGHT, cull_descriptor_set_layout);
+    VkDescriptorSetAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool     = cull_descriptor_pool;
+    alloc_info.descriptorSetCount = MAX_FRAMES_IN_FLIGHT;
+    alloc_info.pSetLayouts        = set_layouts.data();
+
+    cull_descriptor_sets.resize(MAX_FRAMES_IN_FLIGHT);
+    if (vkAllocateDescriptorSets(device, &alloc_info, cull_descriptor_sets.data()) != VK_SUCCESS) {
+      throw std::runtime_error("failed to allocate cull descriptor sets!");
+    }
+
+    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+      std::array<VkDescriptorBufferInfo, 4> buffer_infos = {};
+      buffer_infos[0].buffer = uniform_buffer;
+      buffer_infos[0].range  = sizeof(CullUniforms);
+      buffer_infos[1].buffer = instance_buffer;
+      buffer_infos[1].range  = VK_WHOLE_SIZE;
+      buffer_infos[2].buffer = indirect_buffers[i];
+      buffer_infos[2].range  = VK_WHOLE_SIZE;
+      buffer_infos[3].buffer = submesh_buffer;
+      buffer_infos[3].range  = VK_WHOLE_SIZE;
+
+      std::array<VkWriteDescriptorSet, 4> writes = {};
+      for (uint32_t j = 0; j < writes.size(); j++) {
+        writes[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[j].dstSet          = cull_descriptor_sets[i];
+        writes[j].dstBinding      = j;
+        writes[j].descriptorCount = 1;
+        writes[j].descriptorType  = bindings[j].descriptorType;
+        writes[j].pBufferInfo     = &buffer_infos[j];
+      }
+      vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
+  }
+
+
+  void destroy_culling_resources() {
+    for (size_t i = 0; i < indirect_buffers.size(); i++) {
+      vkDestroyBuffer(device, indirect_buffers[i], nullptr);
+      allocator.free(indirect_buffers_memory[i]);
+    }
+    vkDestroyDescriptorPool(device, cull_descriptor_pool, nullptr);
+    vkDestroyPipeline(device, cull_pipeline, nullptr);
+    vkDestroyPipelineLayout(device, cull_pipeline_layout, nullptr);
+    vkDestroyDescriptorSetLayout(device, cull_descriptor_set_layout, nullptr);
+  }
+
+
+  // planes of the view frustum from the rows of proj * view (Gribb/Hartmann),
+  // for a [0, 1] depth range
+  static void extract_frustum_planes(const glm::mat4& view_proj, glm::vec4 planes[6]) {
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; i++) {
+      rows[i] = glm::vec4(view_proj[0][i], view_proj[1][i], view_proj[2][i], view_proj[3][i]);
+    }
+
+    planes[0] = rows[3] + rows[0]; // left
+    planes[1] = rows[3] - rows[0]; // right
+    planes[2] = rows[3] + rows[1]; // bottom
+    planes[3] = rows[3] - rows[1]; // top
+    planes[4] = rows[2];           // near
+    planes[5] = rows[3] - rows[2]; // far
+
+    for (int i = 0; i < 6; i++) {
+      planes[i] = planes[i] / glm::length(glm::vec3(planes[i]));
+    }
+  }
+
+
+  // recorded into the primary before the render pass. the compute pass tests
+  // the bounding sphere of every draw against the frustum and appends a
+  // VkDrawIndexedIndirectCommand per sub-mesh of its LOD for each visible one,
+  // with firstInstance pointing at its transform. the count at the start of the indirect buffer
+  // is cleared first and bumped atomically by the shader, so the slots past it
+  // keep a zero instanceCount and draw nothing
+  void record_culling(VkCommandBuffer command_buffer, uint32_t frame, const UniformBufferObject& ubo,
+      const LodSelection& lod_selection) {
+    CullUniforms cull = {};
+    cull.model = ubo.model;
+    extract_frustum_planes(ubo.proj * ubo.view, cull.frustum_planes);
+    cull.bounds      = model_bounds;
+    cull.camera      = glm::vec4(lod_selection.camera, lod_selection.scale);
+    for (size_t i = 0; i < lods.size(); i++) {
+      cull.lod_ranges[i].x = lods[i].first_submesh;
+      cull.lod_ranges[i].y = lods[i].submesh_count;
+      cull.lod_errors[i].x = lods[i].error;
+    }
+    cull.draw_count  = draw_count;
+    cull.lod_count   = static_cast<uint32_t>(lods.size());
+    uint32_t uniform_offset = uniform_ring.push(cull);
+
+    uint32_t cull_scope = gpu_profiler.begin_scope(command_buffer, frame, "cull");
+
+    // the last reads of this buffer were by the draws of this frame's
+    // previous use, which wait_for_frame has already waited for
+    uint32_t max_commands  = draw_count * max_lod_submeshes();
+    VkDeviceSize used_size = INDIRECT_COMMANDS_OFFSET + sizeof(VkDrawIndexedIndirectCommand) * max_commands;
+    vkCmdFillBuffer(command_buffer, indirect_buffers[frame], 0, used_size, 0);
+
+    VkBufferMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = indirect_buffers[frame];
+    barrier.offset = 0;
+    barrier.size   = VK_WHOLE_SIZE;
+
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, cull_pipeline);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, cull_pipeline_layout,
+        0, 1, &cull_descriptor_sets[frame], 1, &uniform_offset);
+    vkCmdDispatch(command_buffer, (draw_count + CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE, 1, 1);
+
+    // the commands and the count are read by the draw indirect stage
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+        0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+    gpu_profiler.end_scope(command_buffer, frame, cull_scope);
+  }
+
+
+  // with VK_KHR_draw_indirect_count the GPU reads how many draws there are,
+  // otherwise every slot is drawn and the empty ones are skipped by the GPU.
+  // without multiDrawIndirect that takes one call per slot, the only case in
+  // which the CPU cost still grows with the number of draws
+  void record_indirect_draws(VkCommandBuffer command_buffer, uint32_t frame) {
+    const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+    uint32_t max_commands = draw_count * max_lod_submeshes();
+    if (cmd_draw_indexed_indirect_count != nullptr) {
+      cmd_draw_indexed_indirect_count(command_buffer, indirect_buffers[frame], INDIRECT_COMMANDS_OFFSET,
+          indirect_buffers[frame], 0, max_commands, stride);
+      return;
+    }
+
+    for (uint32_t first = 0; first < max_commands; first += max_draw_indirect_count) {
+      uint32_t count = std::min(max_draw_indirect_count, max_commands - first);
+      vkCmdDrawIndexedIndirect(command_buffer, indirect_buffers[frame],
+          INDIRECT_COMMANDS_OFFSET + first * stride, count, stride);
+    }
+  }
+
+
+  void create_gpu_profiler() {
+    QueueFamilyIndices indices = find_queue_families(physical_device);
+    gpu_profiler.init(physical_device, device, indices.graphics_family, MAX_FRAMES_IN_FLIGHT);
+  }
+
+
+  // the device must be idle, every frame still in flight is collected first
+  void report_gpu_profile() {
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+      gpu_profiler.collect(i);
+    }
+    gpu_profiler.print_stats(std::cout);
+
+    if (!options.gpu_profile_path.empty() && gpu_profiler.enabled()) {
+      gpu_profiler.write_dump(options.gpu_profile_path);
+      std::cout << "gpu profiler: wrote " << options.gpu_profile_path << std::endl;
+    }
+  }
+
+
+  void create_sync_objects() {
+    // the swap chain only takes binary semaphores, so acquire and present
+    // keep their own per frame. when a frame has finished is up to
+    // gpu_timeline
+    image_available_semaphores.resize(MAX_FRAMES_IN_FLIGHT);
+    render_finished_semaphores.resize(MAX_FRAMES_IN_FLIGHT);
 
     VkSemaphoreCreateInfo semaphore_info = {};
     semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-    VkFenceCreateInfo fence_info = {};
-    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
     for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
       if (vkCreateSemaphore(device, &semaphore_info, nullptr, &image_available_semaphores[i]) != VK_SUCCESS ||
-          vkCreateSemaphore(device, &semaphore_info, nullptr, &render_finished_semaphores[i]) != VK_SUCCESS ||
-          vkCreateFence(device, &fence_info, nullptr, &in_flight_fences[i]) != VK_SUCCESS) {
+          vkCreateSemaphore(device, &semaphore_info, nullptr, &render_finished_semaphores[i]) != VK_SUCCESS) {
         throw std::runtime_error("failed to create synchronization objects for a frame!");
       }
     }
@@ -1619,11 +4027,18 @@ private:
 
 
   void draw_frame() {
-    vkWaitForFences(device, 1, &in_flight_fences[current_frame], VK_TRUE, std::numeric_limits<uint64_t>::max());
+    auto frame_start = std::chrono::high_resolution_clock::now();
+    FrameSample sample;
+
+    wait_for_frame(current_frame);
+    // the GPU is done with this frame, its timestamps are ready
+    gpu_profiler.collect(static_cast<uint32_t>(current_frame));
+    auto wait_done = std::chrono::high_resolution_clock::now();
 
     uint32_t image_index;
     VkResult result = vkAcquireNextImageKHR(device, swap_chain, std::numeric_limits<uint64_t>::max(),
         image_available_semaphores[current_frame], VK_NULL_HANDLE, &image_index);
+    auto acquire_done = std::chrono::high_resolution_clock::now();
 
     if (result == VK_ERROR_OUT_OF_DATE_KHR) {
       recreate_swap_chain();
@@ -1632,7 +4047,8 @@ private:
       throw std::runtime_error("failed to acquire swap chain image!");
     }
 
-    update_uniform_buffer(image_index);
+    record_command_buffers(static_cast<uint32_t>(current_frame), image_index, recording_threads.size());
+    auto record_done = std::chrono::high_resolution_clock::now();
 
     VkSubmitInfo submit_info = {};
     submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -1644,17 +4060,18 @@ private:
     submit_info.pWaitDstStageMask = wait_stages;
 
     submit_info.commandBufferCount = 1;
-    submit_info.pCommandBuffers = &command_buffers[image_index];
+    submit_info.pCommandBuffers = &frame_commands[current_frame].primary;
 
     VkSemaphore signal_semaphores[] = {render_finished_semaphores[current_frame]};
     submit_info.signalSemaphoreCount = 1;
     submit_info.pSignalSemaphores = signal_semaphores;
 
-    vkResetFences(device, 1, &in_flight_fences[current_frame]);
-
-    if (vkQueueSubmit(graphics_queue, 1, &submit_info, in_flight_fences[current_frame]) != VK_SUCCESS) {
+    if (gpu_timeline.submit(submit_info) != VK_SUCCESS) {
       throw std::runtime_error("failed to submit draw command buffer!");
     }
+    frame_values[current_frame] = gpu_timeline.submitted();
+    gpu_profiler.end_frame(static_cast<uint32_t>(current_frame));
+    auto submit_done = std::chrono::high_resolution_clock::now();
 
     VkPresentInfoKHR present_info = {};
     present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -1669,6 +4086,14 @@ private:
     present_info.pImageIndices = &image_index;
 
     result = vkQueuePresentKHR(present_queue, &present_info);
+    auto present_done = std::chrono::high_resolution_clock::now();
+
+    sample.phase_ms[FRAME_PHASE_WAIT]    = milliseconds(frame_start, wait_done);
+    sample.phase_ms[FRAME_PHASE_ACQUIRE] = milliseconds(wait_done, acquire_done);
+    sample.phase_ms[FRAME_PHASE_RECORD]  = milliseconds(acquire_done, record_done);
+    sample.phase_ms[FRAME_PHASE_SUBMIT]  = milliseconds(record_done, submit_done);
+    sample.phase_ms[FRAME_PHASE_PRESENT] = milliseconds(submit_done, present_done);
+    push_frame_sample(sample, frame_start);
 
     if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebuffer_resized) {
       framebuffer_resized = false;
@@ -1681,6 +4106,207 @@ private:
   }
 
 
+  // waits for the frame last submitted in this slot, every submission
+  // before it has finished as well. whatever they were the last to use is
+  // released
+  void wait_for_frame(size_t frame) {
+    gpu_timeline.wait(frame_values[frame]);
+    deletion_queue.collect(gpu_timeline.completed());
+  }
+
+
+  // draw_frame without acquire and present, frame i renders into offscreen
+  // image i
+  void draw_frame_headless() {
+    auto frame_start = std::chrono::high_resolution_clock::now();
+    FrameSample sample;
+
+    wait_for_frame(current_frame);
+    // the GPU is done with this frame, its timestamps are ready
+    gpu_profiler.collect(static_cast<uint32_t>(current_frame));
+    auto wait_done = std::chrono::high_resolution_clock::now();
+
+    uint32_t image_index = static_cast<uint32_t>(current_frame);
+    record_command_buffers(static_cast<uint32_t>(current_frame), image_index, recording_threads.size());
+    auto record_done = std::chrono::high_resolution_clock::now();
+
+    VkSubmitInfo submit_info = {};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &frame_commands[current_frame].primary;
+
+    if (gpu_timeline.submit(submit_info) != VK_SUCCESS) {
+      throw std::runtime_error("failed to submit draw command buffer!");
+    }
+    frame_values[current_frame] = gpu_timeline.submitted();
+    gpu_profiler.end_frame(static_cast<uint32_t>(current_frame));
+    auto submit_done = std::chrono::high_resolution_clock::now();
+
+    // no acquire or present without a swap chain
+    sample.phase_ms[FRAME_PHASE_WAIT]   = milliseconds(frame_start, wait_done);
+    sample.phase_ms[FRAME_PHASE_RECORD] = milliseconds(wait_done, record_done);
+    sample.phase_ms[FRAME_PHASE_SUBMIT] = milliseconds(record_done, submit_done);
+    push_frame_sample(sample, frame_start);
+
+    current_frame = (current_frame + 1) % MAX_FRAMES_IN_FLIGHT;
+  }
+
+
+  static float milliseconds(std::chrono::high_resolution_clock::time_point from,
+      std::chrono::high_resolution_clock::time_point to) {
+    return std::chrono::duration<float, std::chrono::milliseconds::period>(to - from).count();
+  }
+
+
+  void push_frame_sample(FrameSample& sample, std::chrono::high_resolution_clock::time_point frame_start) {
+    if (frame_stats.frame_count() > 0) {
+      sample.frame_ms = milliseconds(last_frame_start, frame_start);
+    }
+    last_frame_start = frame_start;
+    frame_stats.push(sample);
+  }
+
+
+  void report_frame_stats() {
+    std::string present_mode = options.headless ? "headless" : present_mode_name(swap_chain_present_mode);
+    std::string configuration = present_mode + ", " + std::to_string(MAX_FRAMES_IN_FLIGHT) + " frames in flight";
+    frame_stats.print_summary(std::cout, configuration);
+
+    if (!options.frame_stats_path.empty() && frame_stats.frame_count() > 0) {
+      frame_stats.write_csv(options.frame_stats_path, present_mode, MAX_FRAMES_IN_FLIGHT);
+      std::cout << "frame stats: wrote " << options.frame_stats_path << std::endl;
+    }
+  }
+
+
+  static std::string present_mode_name(VkPresentModeKHR mode) {
+    switch (mode) {
+      case VK_PRESENT_MODE_IMMEDIATE_KHR:    return "immediate";
+      case VK_PRESENT_MODE_MAILBOX_KHR:      return "mailbox";
+      case VK_PRESENT_MODE_FIFO_KHR:         return "fifo";
+      case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "fifo_relaxed";
+      default:                               return "unknown";
+    }
+  }
+
+
+  void run_headless() {
+    auto start_time = std::chrono::high_resolution_clock::now();
+
+    for (uint32_t i = 0; i < options.headless_frames; i++) {
+      draw_frame_headless();
+      upload_context.collect();
+    }
+    // the last frames are only done once the GPU is
+    vkDeviceWaitIdle(device);
+
+    float total_ms = std::chrono::duration<float, std::chrono::milliseconds::period>(
+        std::chrono::high_resolution_clock::now() - start_time).count();
+    std::cout << "headless: " << options.headless_frames << " frames of " << draw_count
+              << (draw_mode == DRAW_MODE_INSTANCED ? " instances" : " draws") << " at "
+              << swap_chain_extent.width << "x" << swap_chain_extent.height << " in " << total_ms << " ms, "
+              << std::fixed << std::setprecision(3) << total_ms / options.headless_frames << " ms/frame, "
+              << std::setprecision(1) << options.headless_frames * 1000.0f / total_ms << " frames/s"
+              << std::defaultfloat << std::endl;
+
+    if (!options.screenshot_path.empty()) {
+      size_t last_frame = (current_frame + MAX_FRAMES_IN_FLIGHT - 1) % MAX_FRAMES_IN_FLIGHT;
+      save_screenshot(swap_chain_images[last_frame], options.screenshot_path);
+    }
+  }
+
+
+  // copies a rendered offscreen image (TRANSFER_SRC_OPTIMAL, see the render
+  // pass) into a host visible buffer and writes it out as a binary PPM
+  void save_screenshot(VkImage image, const std::string& path) {
+    uint32_t width  = swap_chain_extent.width;
+    uint32_t height = swap_chain_extent.height;
+    VkDeviceSize size = static_cast<VkDeviceSize>(width) * height * 4;
+
+    VkBuffer readback_buffer;
+    Allocation readback_buffer_memory;
+    create_buffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        readback_buffer, readback_buffer_memory, ALLOCATION_STRATEGY_LINEAR);
+
+    VkCommandBuffer command_buffer = upload_context.graphics_commands();
+
+    // make the render pass writes visible to the copy
+    VkImageMemoryBarrier image_barrier = {};
+    image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    image_barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    image_barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    image_barrier.image = image;
+    image_barrier.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+    image_barrier.subresourceRange.baseMipLevel   = 0;
+    image_barrier.subresourceRange.levelCount     = 1;
+    image_barrier.subresourceRange.baseArrayLayer = 0;
+    image_barrier.subresourceRange.layerCount     = 1;
+    image_barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    image_barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &image_barrier);
+
+    VkBufferImageCopy region = {};
+    region.bufferOffset      = 0;
+    region.bufferRowLength   = 0;
+    region.bufferImageHeight = 0;
+    region.imageSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel       = 0;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount     = 1;
+    region.imageOffset = {0, 0, 0};
+    region.imageExtent = {width, height, 1};
+
+    vkCmdCopyImageToBuffer(command_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        readback_buffer, 1, &region);
+
+    // and the copy visible to the host
+    VkBufferMemoryBarrier buffer_barrier = {};
+    buffer_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    buffer_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    buffer_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    buffer_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    buffer_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    buffer_barrier.buffer = readback_buffer;
+    buffer_barrier.offset = 0;
+    buffer_barrier.size   = VK_WHOLE_SIZE;
+
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+        0, nullptr, 1, &buffer_barrier, 0, nullptr);
+
+    // this one we do need to wait for
+    upload_context.wait();
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+      throw std::runtime_error("failed to open " + path + " for writing!");
+    }
+
+    // P6: binary RGB, the alpha channel is dropped
+    file << "P6\n" << width << " " << height << "\n255\n";
+    const unsigned char* pixels = static_cast<const unsigned char*>(readback_buffer_memory.mapped);
+    std::vector<unsigned char> row(width * 3);
+    for (uint32_t y = 0; y < height; y++) {
+      for (uint32_t x = 0; x < width; x++) {
+        const unsigned char* pixel = pixels + (static_cast<size_t>(y) * width + x) * 4;
+        row[x * 3 + 0] = pixel[0];
+        row[x * 3 + 1] = pixel[1];
+        row[x * 3 + 2] = pixel[2];
+      }
+      file.write(reinterpret_cast<const char*>(row.data()), row.size());
+    }
+
+    vkDestroyBuffer(device, readback_buffer, nullptr);
+    allocator.free(readback_buffer_memory);
+
+    std::cout << "headless: wrote the last frame to " << path << std::endl;
+  }
+
+
   VkShaderModule create_shader_module(const std::vector<char>& code) {
     VkShaderModuleCreateInfo create_info = {};
     create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
@@ -1712,6 +4338,12 @@ private:
 
 
   VkPresentModeKHR choose_swap_present_mode(const std::vector<VkPresentModeKHR> available_present_modes) {
+    for (const auto& available_present_mode : available_present_modes) {
+      if (!options.present_mode.empty() && present_mode_name(available_present_mode) == options.present_mode) {
+        return available_present_mode;
+      }
+    }
+
     VkPresentModeKHR best_mode = VK_PRESENT_MODE_FIFO_KHR;
     for (const auto& available_present_mode : available_present_modes) {
       if (available_present_mode == VK_PRESENT_MODE_MAILBOX_KHR) {
@@ -1750,41 +4382,6 @@ private:
   }
 
 
-  VkCommandBuffer begin_single_time_commands() {
-    VkCommandBufferAllocateInfo alloc_info = {};
-    alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    alloc_info.commandPool = command_pool;
-    alloc_info.commandBufferCount = 1;
-
-    VkCommandBuffer command_buffer;
-    vkAllocateCommandBuffers(device, &alloc_info, &command_buffer);
-
-    VkCommandBufferBeginInfo begin_info = {};
-    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-    vkBeginCommandBuffer(command_buffer, &begin_info);
-
-    return command_buffer;
-  }
-
-
-  void end_single_time_commands(VkCommandBuffer command_buffer) {
-    vkEndCommandBuffer(command_buffer);
-
-    VkSubmitInfo submit_info = {};
-    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submit_info.commandBufferCount = 1;
-    submit_info.pCommandBuffers = &command_buffer;
-
-    vkQueueSubmit(graphics_queue, 1, &submit_info, VK_NULL_HANDLE);
-    vkQueueWaitIdle(graphics_queue);
-
-    vkFreeCommandBuffers(device, command_pool, 1, &command_buffer);
-  }
-
-
   SwapChainSupportDetails query_swap_chain_support(VkPhysicalDevice device) {
     SwapChainSupportDetails details;
 
@@ -1815,8 +4412,9 @@ private:
 
     bool extensions_supported = check_device_extension_support(device);
 
-    bool swap_chain_adequate = false;
-    if (extensions_supported) {
+    // nothing is presented in headless mode
+    bool swap_chain_adequate = options.headless;
+    if (extensions_supported && !options.headless) {
       SwapChainSupportDetails swap_chain_support = query_swap_chain_support(device);
       swap_chain_adequate = !swap_chain_support.formats.empty() && !swap_chain_support.present_modes.empty();
     }
@@ -1829,6 +4427,38 @@ private:
   }
 
 
+  bool has_instance_extension(const char* name) {
+    uint32_t extension_count;
+    vkEnumerateInstanceExtensionProperties(nullptr, &extension_count, nullptr);
+
+    std::vector<VkExtensionProperties> available_extensions(extension_count);
+    vkEnumerateInstanceExtensionProperties(nullptr, &extension_count, available_extensions.data());
+
+    for (const auto& extension : available_extensions) {
+      if (strcmp(extension.extensionName, name) == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+
+  bool has_device_extension(VkPhysicalDevice device, const char* name) {
+    uint32_t extension_count;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, nullptr);
+
+    std::vector<VkExtensionProperties> available_extensions(extension_count);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, available_extensions.data());
+
+    for (const auto& extension : available_extensions) {
+      if (strcmp(extension.extensionName, name) == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+
   bool check_device_extension_support(VkPhysicalDevice device) {
     uint32_t extension_count;
     vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, nullptr);
@@ -1836,6 +4466,7 @@ private:
     std::vector<VkExtensionProperties> available_extensions(extension_count);
     vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, available_extensions.data());
 
+    std::vector<const char*> device_extensions = get_required_device_extensions();
     std::set<std::string> required_extensions(device_extensions.begin(), device_extensions.end());
 
     for (const auto& extension : available_extensions) {
@@ -1856,34 +4487,61 @@ private:
     vkGetPhysicalDeviceQueueFamilyProperties(device, &queue_family_count, queue_families.data());
 
     int i = 0;
+    int transfer_only_family = -1;
     for (const auto& queue_family : queue_families) {
-      if (queue_family.queueCount > 0 && queue_family.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+      if (queue_family.queueCount > 0 && queue_family.queueFlags & VK_QUEUE_GRAPHICS_BIT &&
+          indices.graphics_family < 0) {
         indices.graphics_family = i;
       }
 
       VkBool32 present_support = false;
-      vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &present_support);
+      if (!options.headless) {
+        vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &present_support);
+      }
 
-      if (queue_family.queueCount > 0 && present_support) {
+      if (queue_family.queueCount > 0 && present_support && indices.present_family < 0) {
         indices.present_family = i;
       }
 
-
-      if (indices.is_complete()) {
-        break;
+      // transfer capable families without graphics are usually backed by a
+      // DMA engine that copies while the graphics queue keeps rendering.
+      // prefer one that can't do compute either, those are the pure copy
+      // engines
+      if (queue_family.queueCount > 0 && (queue_family.queueFlags & VK_QUEUE_TRANSFER_BIT) &&
+          !(queue_family.queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
+        if (!(queue_family.queueFlags & VK_QUEUE_COMPUTE_BIT) && transfer_only_family < 0) {
+          transfer_only_family = i;
+        } else if (indices.transfer_family < 0) {
+          indices.transfer_family = i;
+        }
       }
-    
+
       i++;
     }
 
+    // nothing is presented without a surface, present_family just mirrors
+    // graphics_family
+    if (options.headless) {
+      indices.present_family = indices.graphics_family;
+    }
+
+    if (transfer_only_family >= 0) {
+      indices.transfer_family = transfer_only_family;
+    } else if (indices.transfer_family < 0) {
+      indices.transfer_family = indices.graphics_family;
+    }
+
     return indices;
   }
   
 
   std::vector<const char*> get_required_extensions() {
     uint32_t glfw_extension_count = 0;
-    const char** glfw_extensions;
-    glfw_extensions = glfwGetRequiredInstanceExtensions(&glfw_extension_count);
+    const char** glfw_extensions = nullptr;
+    // the surface extensions are only needed with a window
+    if (!options.headless) {
+      glfw_extensions = glfwGetRequiredInstanceExtensions(&glfw_extension_count);
+    }
 
     std::vector<const char*> extensions(glfw_extensions, glfw_extensions + glfw_extension_count);
 
@@ -1891,10 +4549,24 @@ private:
       extensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
     }
 
+    has_physical_device_properties2 =
+        has_instance_extension(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+    if (has_physical_device_properties2) {
+      extensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+    }
+
     return extensions;
   }
 
 
+  std::vector<const char*> get_required_device_extensions() {
+    if (options.headless) {
+      return std::vector<const char*>();
+    }
+    return device_extensions;
+  }
+
+
   bool check_validation_layer_support() {
     uint32_t layer_count;
     vkEnumerateInstanceLayerProperties(&layer_count, nullptr);
@@ -1954,12 +4626,130 @@ private:
 };
 
 
-int main()
+// --serial-obj         parse the model and deduplicate its vertices on one
+//                      thread
+// --no-mesh-cache      always build the model from the OBJ file and don't
+//                      write MESH_CACHE_PATH
+// --benchmark-obj-loading
+//                      time parsing the model serially and with 1 up to one
+//                      thread per hardware thread, without opening a window
+// --serial-startup     prepare the model and decode the texture on the main
+//                      thread, between the other initialization steps
+// --texture-copy       decode the texture on the heap and copy it to the
+//                      staging buffer, to compare with decoding in place
+// --benchmark-dedup    time the vertex deduplication of the model and of
+//                      copies of it, without opening a window
+// --draws N            draw the model N times (default 1)
+// --threads N          record command buffers with N threads (default: one
+//                      per hardware thread)
+// --benchmark-recording
+//                      time command recording for 1 up to --threads threads
+//                      instead of opening the render loop
+// --depth-per-image    give every swap chain image its own depth buffer
+//                      instead of sharing one
+// --no-timeline-semaphore
+//                      track GPU progress with fences even if the device
+//                      supports timeline semaphores
+// --instanced          draw all copies with one instanced draw call
+// --gpu-culling        cull the copies on the GPU and draw the visible ones
+//                      with indirect draws
+// --no-mesh-optimization
+//                      keep the model's triangles in OBJ face order
+// --packed-vertices    store positions and texture coordinates as 16-bit
+//                      values, 12 instead of 20 bytes per vertex
+// --uint32-indices     draw the model with 32-bit indices in one piece
+//                      instead of 16-bit sub-meshes
+// --benchmark-instancing
+//                      time frames of 1 up to 100k copies in every draw mode
+//                      instead of opening the render loop
+// --no-lods            draw the model as loaded at every distance
+// --lod-error PIXELS   largest error on screen a LOD may have to be drawn
+//                      (default 1, 0 always draws the full model)
+// --benchmark-lod      time frames at several camera distances with and
+//                      without LOD selection instead of opening the render
+//                      loop
+// --headless           render offscreen without a window (e.g. on CI with a
+//                      software driver like lavapipe) and print throughput
+// --frames N           number of frames rendered in headless mode
+//                      (default 100)
+// --screenshot PATH    write the last headless frame to PATH as a PPM
+// --gpu-profile PATH   write the GPU scope timings to PATH as JSON at exit
+// --frame-stats PATH   write the per frame CPU timings to PATH as CSV at exit
+// --present-mode MODE  immediate, mailbox, fifo or fifo_relaxed if supported
+AppOptions parse_options(int argc, char** argv) {
+  AppOptions options;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+
+    if (arg == "--serial-obj") {
+      options.parallel_obj_loading = false;
+    } else if (arg == "--no-mesh-cache") {
+      options.use_mesh_cache = false;
+    } else if (arg == "--benchmark-obj-loading") {
+      options.benchmark_obj_loading = true;
+    } else if (arg == "--benchmark-dedup") {
+      options.benchmark_dedup = true;
+    } else if (arg == "--texture-copy") {
+      options.decode_texture_in_place = false;
+    } else if (arg == "--serial-startup") {
+      options.parallel_startup = false;
+    } else if (arg == "--draws" && has_value) {
+      options.draw_count = static_cast<uint32_t>(std::max(1, std::atoi(argv[++i])));
+    } else if (arg == "--threads" && has_value) {
+      options.recording_threads = static_cast<uint32_t>(std::max(0, std::atoi(argv[++i])));
+    } else if (arg == "--benchmark-recording") {
+      options.benchmark_recording = true;
+    } else if (arg == "--instanced") {
+      options.draw_mode = DRAW_MODE_INSTANCED;
+    } else if (arg == "--depth-per-image") {
+      options.depth_policy = DEPTH_POLICY_PER_IMAGE;
+    } else if (arg == "--no-timeline-semaphore") {
+      options.timeline_semaphore = false;
+    } else if (arg == "--gpu-culling") {
+      options.draw_mode = DRAW_MODE_GPU_CULLED;
+    } else if (arg == "--no-mesh-optimization") {
+      options.optimize_mesh = false;
+    } else if (arg == "--packed-vertices") {
+      options.packed_vertices = true;
+    } else if (arg == "--uint32-indices") {
+      options.uint32_indices = true;
+    } else if (arg == "--benchmark-instancing") {
+      options.benchmark_instancing = true;
+    } else if (arg == "--no-lods") {
+      options.generate_lods = false;
+    } else if (arg == "--lod-error" && has_value) {
+      options.lod_error_pixels = std::max(0.0f, static_cast<float>(std::atof(argv[++i])));
+    } else if (arg == "--benchmark-lod") {
+      options.benchmark_lod = true;
+    } else if (arg == "--headless") {
+      options.headless = true;
+    } else if (arg == "--frames" && has_value) {
+      options.headless_frames = static_cast<uint32_t>(std::max(1, std::atoi(argv[++i])));
+    } else if (arg == "--screenshot" && has_value) {
+      options.screenshot_path = argv[++i];
+    } else if (arg == "--gpu-profile" && has_value) {
+      options.gpu_profile_path = argv[++i];
+    } else if (arg == "--frame-stats" && has_value) {
+      options.frame_stats_path = argv[++i];
+    } else if (arg == "--present-mode" && has_value) {
+      options.present_mode = argv[++i];
+    } else {
+      throw std::runtime_error("unknown option " + arg + "!");
+    }
+  }
+
+  return options;
+}
+
+
+int main(int argc, char** argv)
 {
   HelloTriangleApplication app;
 
   try {
-    app.run();
+    app.run(parse_options(argc, argv));
   } catch(const std::exception& e) {
     std::cerr << e.what() << std::endl;
     return EXIT_FAILURE;
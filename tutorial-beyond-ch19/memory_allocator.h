@@ -0,0 +1,452 @@
+#ifndef MEMORY_ALLOCATOR_H
+#define MEMORY_ALLOCATOR_H
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+// ---------------------------
+// DEVICE MEMORY SUB-ALLOCATION
+// ---------------------------
+// every vkAllocateMemory call is expensive and the driver only guarantees
+// maxMemoryAllocationCount (can be as low as 4096) live allocations at once
+// so instead of one VkDeviceMemory per buffer/image we allocate large blocks
+// per memory type and hand out aligned ranges of them
+//
+// two strategies are available per pool:
+//   -FREE_LIST: ordered list of free ranges, best fit, neighbours are
+//    coalesced on free. used for long lived resources
+//   -LINEAR: bump pointer that only resets once every allocation in the block
+//    has been freed. used for short lived staging memory
+//
+// buffers and optimally tiled images never share a block so we never have to
+// worry about bufferImageGranularity between neighbouring ranges
+
+
+enum AllocationStrategy {
+  ALLOCATION_STRATEGY_FREE_LIST,
+  ALLOCATION_STRATEGY_LINEAR
+};
+
+
+enum ResourceKind {
+  RESOURCE_KIND_BUFFER,
+  RESOURCE_KIND_OPTIMAL_IMAGE
+};
+
+
+struct MemoryBlock;
+
+
+struct Allocation {
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  VkDeviceSize offset   = 0;
+  VkDeviceSize size     = 0;
+  // points at offset inside the block when the memory is host visible
+  void* mapped = nullptr;
+  MemoryBlock* block = nullptr;
+};
+
+
+struct MemoryPool;
+
+
+struct MemoryBlock {
+  MemoryPool* pool      = nullptr;
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  VkDeviceSize size     = 0;
+  void* mapped          = nullptr;
+  bool dedicated        = false;
+
+  uint32_t allocation_count = 0;
+  VkDeviceSize bytes_in_use = 0;
+
+  // LINEAR
+  VkDeviceSize head = 0;
+
+  // FREE_LIST, offset -> size
+  std::map<VkDeviceSize, VkDeviceSize> free_ranges;
+};
+
+
+struct MemoryPool {
+  uint32_t memory_type;
+  AllocationStrategy strategy;
+  ResourceKind kind;
+  std::vector<std::unique_ptr<MemoryBlock>> blocks;
+};
+
+
+struct AllocatorStats {
+  uint32_t block_count       = 0;
+  uint32_t dedicated_count   = 0;
+  uint32_t allocation_count  = 0;
+  VkDeviceSize bytes_allocated = 0;
+  VkDeviceSize bytes_in_use    = 0;
+  VkDeviceSize bytes_free      = 0;
+  VkDeviceSize largest_free    = 0;
+
+  // 0 means all free space is one contiguous range, values close to 1 mean
+  // the free space is scattered into many small ranges
+  float fragmentation() const {
+    if (bytes_free == 0) return 0.0f;
+    return 1.0f - static_cast<float>(largest_free) / static_cast<float>(bytes_free);
+  }
+};
+
+
+const VkDeviceSize DEFAULT_MEMORY_BLOCK_SIZE = 64ull * 1024 * 1024;
+
+
+class MemoryAllocator {
+public:
+  void init(VkPhysicalDevice physical_device, VkDevice device) {
+    this->device = device;
+    vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+    non_coherent_atom_size = properties.limits.nonCoherentAtomSize;
+  }
+
+
+  // memory_type comes from find_memory_type in the application
+  Allocation allocate(const VkMemoryRequirements& requirements, uint32_t memory_type,
+      AllocationStrategy strategy, ResourceKind kind) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    VkDeviceSize alignment = requirements.alignment;
+    VkMemoryPropertyFlags flags = memory_properties.memoryTypes[memory_type].propertyFlags;
+    if ((flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) &&
+        !(flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+      // flushes/invalidates work on nonCoherentAtomSize granules so keep
+      // neighbouring allocations out of each other's granules
+      alignment = std::max(alignment, non_coherent_atom_size);
+    }
+
+    MemoryPool& pool = get_pool(memory_type, strategy, kind);
+    VkDeviceSize block_size = preferred_block_size(memory_type);
+
+    // big resources (textures, large meshes) would waste most of a block,
+    // they get a block of their own
+    if (requirements.size > block_size / 2) {
+      MemoryBlock* block = create_block(pool, requirements.size, true);
+      Allocation allocation;
+      take_range(*block, 0, requirements.size, allocation);
+      return allocation;
+    }
+
+    Allocation allocation;
+    for (auto& block : pool.blocks) {
+      if (!block->dedicated && try_allocate(*block, strategy, requirements.size, alignment, allocation)) {
+        return allocation;
+      }
+    }
+
+    MemoryBlock* block = create_block(pool, block_size, false);
+    if (!try_allocate(*block, strategy, requirements.size, alignment, allocation)) {
+      throw std::runtime_error("failed to sub-allocate device memory!");
+    }
+    return allocation;
+  }
+
+
+  void free(Allocation& allocation) {
+    if (allocation.block == nullptr) return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    MemoryBlock* block = allocation.block;
+    MemoryPool* pool   = block->pool;
+
+    block->allocation_count--;
+    block->bytes_in_use -= allocation.size;
+
+    if (pool->strategy == ALLOCATION_STRATEGY_LINEAR) {
+      if (block->allocation_count == 0) {
+        block->head = 0;
+      }
+    } else if (!block->dedicated) {
+      release_range(*block, allocation.offset, allocation.size);
+    }
+
+    if (block->allocation_count == 0) {
+      // keep a single empty block around so a pool that is repeatedly
+      // emptied and refilled (staging!) doesn't hit vkAllocateMemory each time
+      bool keep = !block->dedicated && empty_block_count(*pool) == 1;
+      if (!keep) {
+        destroy_block(*pool, block);
+      }
+    }
+
+    allocation = Allocation();
+  }
+
+
+  void destroy() {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for (auto& pool : pools) {
+      for (auto& block : pool->blocks) {
+        if (block->mapped) {
+          vkUnmapMemory(device, block->memory);
+        }
+        vkFreeMemory(device, block->memory, nullptr);
+      }
+    }
+    pools.clear();
+    device_allocation_count = 0;
+  }
+
+
+  AllocatorStats get_stats() {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    AllocatorStats stats;
+    for (auto& pool : pools) {
+      accumulate_stats(*pool, stats);
+    }
+    return stats;
+  }
+
+
+  uint32_t get_device_allocation_count() const {
+    return device_allocation_count;
+  }
+
+
+  void print_stats(std::ostream& out) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    out << "memory allocator: " << device_allocation_count << " vkAllocateMemory allocations live" << std::endl;
+    AllocatorStats total;
+    for (auto& pool : pools) {
+      AllocatorStats stats;
+      accumulate_stats(*pool, stats);
+      accumulate_stats(*pool, total);
+      if (stats.block_count == 0) continue;
+
+      out << "  type " << std::setw(2) << pool->memory_type
+          << (pool->kind == RESOURCE_KIND_BUFFER ? " buffers " : " images  ")
+          << (pool->strategy == ALLOCATION_STRATEGY_LINEAR ? "linear   " : "freelist ");
+      print_line(out, stats);
+    }
+    out << "  total                    ";
+    print_line(out, total);
+  }
+
+
+private:
+  VkDevice device = VK_NULL_HANDLE;
+  VkPhysicalDeviceMemoryProperties memory_properties;
+  VkDeviceSize non_coherent_atom_size = 1;
+  uint32_t device_allocation_count = 0;
+
+  std::vector<std::unique_ptr<MemoryPool>> pools;
+  std::mutex mutex;
+
+
+  static VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment) {
+    return alignment > 1 ? (value + alignment - 1) / alignment * alignment : value;
+  }
+
+
+  static void print_line(std::ostream& out, const AllocatorStats& stats) {
+    out << stats.block_count << " blocks (" << stats.dedicated_count << " dedicated), "
+        << stats.allocation_count << " allocations, "
+        << stats.bytes_in_use / 1024 << " / " << stats.bytes_allocated / 1024 << " KiB in use, "
+        << "fragmentation " << std::fixed << std::setprecision(2) << stats.fragmentation()
+        << std::defaultfloat << std::endl;
+  }
+
+
+  // small heaps (e.g. the 256 MiB host visible + device local heap on AMD)
+  // get smaller blocks so we don't eat a big fraction of them at once
+  VkDeviceSize preferred_block_size(uint32_t memory_type) const {
+    uint32_t heap_index = memory_properties.memoryTypes[memory_type].heapIndex;
+    VkDeviceSize heap_size = memory_properties.memoryHeaps[heap_index].size;
+    if (heap_size <= 1024ull * 1024 * 1024) {
+      return std::min(DEFAULT_MEMORY_BLOCK_SIZE, std::max<VkDeviceSize>(heap_size / 8, 1024 * 1024));
+    }
+    return DEFAULT_MEMORY_BLOCK_SIZE;
+  }
+
+
+  MemoryPool& get_pool(uint32_t memory_type, AllocationStrategy strategy, ResourceKind kind) {
+    for (auto& pool : pools) {
+      if (pool->memory_type == memory_type && pool->strategy == strategy && pool->kind == kind) {
+        return *pool;
+      }
+    }
+
+    std::unique_ptr<MemoryPool> pool(new MemoryPool());
+    pool->memory_type = memory_type;
+    pool->strategy    = strategy;
+    pool->kind        = kind;
+    pools.push_back(std::move(pool));
+    return *pools.back();
+  }
+
+
+  MemoryBlock* create_block(MemoryPool& pool, VkDeviceSize size, bool dedicated) {
+    VkMemoryAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    alloc_info.allocationSize  = size;
+    alloc_info.memoryTypeIndex = pool.memory_type;
+
+    std::unique_ptr<MemoryBlock> block(new MemoryBlock());
+    if (vkAllocateMemory(device, &alloc_info, nullptr, &block->memory) != VK_SUCCESS) {
+      throw std::runtime_error("failed to allocate device memory block!");
+    }
+    device_allocation_count++;
+
+    block->pool      = &pool;
+    block->size      = size;
+    block->dedicated = dedicated;
+    block->free_ranges[0] = size;
+
+    // host visible blocks stay mapped for their whole lifetime, mapping is
+    // not free and we never need the memory unmapped
+    if (memory_properties.memoryTypes[pool.memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+      if (vkMapMemory(device, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mapped) != VK_SUCCESS) {
+        throw std::runtime_error("failed to map device memory block!");
+      }
+    }
+
+    pool.blocks.push_back(std::move(block));
+    return pool.blocks.back().get();
+  }
+
+
+  void destroy_block(MemoryPool& pool, MemoryBlock* block) {
+    if (block->mapped) {
+      vkUnmapMemory(device, block->memory);
+    }
+    vkFreeMemory(device, block->memory, nullptr);
+    device_allocation_count--;
+
+    pool.blocks.erase(std::remove_if(pool.blocks.begin(), pool.blocks.end(),
+        [block](const std::unique_ptr<MemoryBlock>& b) { return b.get() == block; }),
+        pool.blocks.end());
+  }
+
+
+  uint32_t empty_block_count(const MemoryPool& pool) const {
+    uint32_t count = 0;
+    for (auto& block : pool.blocks) {
+      if (!block->dedicated && block->allocation_count == 0) count++;
+    }
+    return count;
+  }
+
+
+  void take_range(MemoryBlock& block, VkDeviceSize offset, VkDeviceSize size, Allocation& allocation) {
+    if (block.dedicated) {
+      block.free_ranges.clear();
+    }
+    block.allocation_count++;
+    block.bytes_in_use += size;
+
+    allocation.memory = block.memory;
+    allocation.offset = offset;
+    allocation.size   = size;
+    allocation.mapped = block.mapped ? static_cast<char*>(block.mapped) + offset : nullptr;
+    allocation.block  = &block;
+  }
+
+
+  bool try_allocate(MemoryBlock& block, AllocationStrategy strategy, VkDeviceSize size,
+      VkDeviceSize alignment, Allocation& allocation) {
+    if (strategy == ALLOCATION_STRATEGY_LINEAR) {
+      VkDeviceSize offset = align_up(block.head, alignment);
+      if (offset + size > block.size) return false;
+      block.head = offset + size;
+      take_range(block, offset, size, allocation);
+      return true;
+    }
+
+    // best fit: the smallest free range the aligned request fits into
+    auto best = block.free_ranges.end();
+    for (auto it = block.free_ranges.begin(); it != block.free_ranges.end(); ++it) {
+      VkDeviceSize offset = align_up(it->first, alignment);
+      if (offset + size > it->first + it->second) continue;
+      if (best == block.free_ranges.end() || it->second < best->second) {
+        best = it;
+      }
+    }
+    if (best == block.free_ranges.end()) return false;
+
+    VkDeviceSize range_offset = best->first;
+    VkDeviceSize range_size   = best->second;
+    VkDeviceSize offset       = align_up(range_offset, alignment);
+    block.free_ranges.erase(best);
+
+    // the padding in front of the aligned offset and the tail both go back
+    // into the free list
+    if (offset > range_offset) {
+      block.free_ranges[range_offset] = offset - range_offset;
+    }
+    if (offset + size < range_offset + range_size) {
+      block.free_ranges[offset + size] = range_offset + range_size - (offset + size);
+    }
+
+    take_range(block, offset, size, allocation);
+    return true;
+  }
+
+
+  void release_range(MemoryBlock& block, VkDeviceSize offset, VkDeviceSize size) {
+    auto it = block.free_ranges.insert(std::make_pair(offset, size)).first;
+
+    // merge with the following range
+    auto next = std::next(it);
+    if (next != block.free_ranges.end() && it->first + it->second == next->first) {
+      it->second += next->second;
+      block.free_ranges.erase(next);
+    }
+
+    // merge with the preceding range
+    if (it != block.free_ranges.begin()) {
+      auto prev = std::prev(it);
+      if (prev->first + prev->second == it->first) {
+        prev->second += it->second;
+        block.free_ranges.erase(it);
+      }
+    }
+  }
+
+
+  static void accumulate_stats(const MemoryPool& pool, AllocatorStats& stats) {
+    for (auto& block : pool.blocks) {
+      stats.block_count++;
+      if (block->dedicated) stats.dedicated_count++;
+      stats.allocation_count += block->allocation_count;
+      stats.bytes_allocated  += block->size;
+      stats.bytes_in_use     += block->bytes_in_use;
+
+      if (block->dedicated) continue;
+
+      if (pool.strategy == ALLOCATION_STRATEGY_LINEAR) {
+        VkDeviceSize tail = block->size - block->head;
+        stats.bytes_free  += tail;
+        stats.largest_free = std::max(stats.largest_free, tail);
+      } else {
+        for (auto& range : block->free_ranges) {
+          stats.bytes_free  += range.second;
+          stats.largest_free = std::max(stats.largest_free, range.second);
+        }
+      }
+    }
+  }
+};
+
+#endif
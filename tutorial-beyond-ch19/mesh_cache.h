@@ -0,0 +1,301 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// ----------
+// MESH CACHE
+// ----------
+// turning an OBJ file into vertex and index buffers (parsing, deduplication,
+// LODs, reordering, splitting, quantization) takes seconds for a big model
+// and gives the same result every time. the cache keeps that result in one
+// file:
+//   -MeshCacheHeader
+//   -a MeshCacheSection per section
+//   -the sections, plain byte arrays whose meaning is up to the caller, each
+//    aligned to MESH_CACHE_ALIGNMENT
+//
+// a cache belongs to one version of one source file, identified by its size,
+// modification time and a hash of its contents, and to the options the
+// result was built with (options_hash). hashing means reading the whole
+// source, so it is only done when size or time don't match: a file that was
+// touched but not changed (a fresh checkout, a copy) still hits, and the
+// header gets the new time
+//
+// open maps the file and hands out pointers into the mapping, so a warm start
+// copies every section once, straight into its staging buffer
+
+
+const uint32_t MESH_CACHE_VERSION = 1;
+const uint64_t MESH_CACHE_ALIGNMENT = 16;
+const char MESH_CACHE_MAGIC[8] = {'M', 'E', 'S', 'H', 'C', 'A', 'C', 'H'};
+
+
+struct MeshCacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t section_count;
+  uint64_t file_size;
+  uint64_t source_size;
+  int64_t  source_mtime_ns;
+  uint64_t source_hash;
+  uint64_t options_hash;
+};
+
+
+struct MeshCacheSection {
+  uint64_t offset;
+  uint64_t size;
+};
+
+
+// a section to write
+struct MeshCacheBlob {
+  const void* data;
+  size_t size;
+};
+
+
+// FNV-1a over 8 byte words instead of single bytes. every step is a bijection
+// of the running hash, so a change in one word always changes the result
+inline uint64_t hash_bytes(const void* data, size_t size) {
+  const uint64_t prime = 1099511628211ull;
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  uint64_t hash = 14695981039346656037ull ^ size;
+
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t word;
+    memcpy(&word, bytes + i, 8);
+    hash = (hash ^ word) * prime;
+  }
+  for (; i < size; i++) {
+    hash = (hash ^ bytes[i]) * prime;
+  }
+
+  // the multiplications only carry bits upwards
+  return hash ^ (hash >> 32);
+}
+
+
+// a read only mapping of a whole file
+class MappedFile {
+public:
+  MappedFile() = default;
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  ~MappedFile() {
+    close();
+  }
+
+
+  bool open(const std::string& path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0;
+    if (ok && st.st_size > 0) {
+      void* address = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+      ok = address != MAP_FAILED;
+      if (ok) {
+        bytes = static_cast<const unsigned char*>(address);
+        length = static_cast<size_t>(st.st_size);
+      }
+    }
+    ::close(fd);
+    return ok;
+  }
+
+
+  void close() {
+    if (bytes) munmap(const_cast<unsigned char*>(bytes), length);
+    bytes  = nullptr;
+    length = 0;
+  }
+
+
+  const unsigned char* data() const { return bytes; }
+  size_t size() const { return length; }
+
+
+private:
+  const unsigned char* bytes = nullptr;
+  size_t length = 0;
+};
+
+
+class MeshCache {
+public:
+  // maps path if it is a cache of the current source_path built with
+  // options_hash, otherwise says why not and returns false
+  bool open(const std::string& path, const std::string& source_path, uint64_t options_hash) {
+    close();
+
+    uint64_t source_size;
+    int64_t source_mtime_ns;
+    if (!stat_file(source_path, source_size, source_mtime_ns)) {
+      return miss(path, "can't stat " + source_path);
+    }
+    if (!file.open(path)) {
+      return miss(path, "no cache file");
+    }
+
+    MeshCacheHeader header;
+    if (file.size() < sizeof(header)) {
+      return miss(path, "truncated");
+    }
+    memcpy(&header, file.data(), sizeof(header));
+
+    if (memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic)) != 0 || header.version != MESH_CACHE_VERSION ||
+        header.file_size != file.size() ||
+        sizeof(header) + header.section_count * sizeof(MeshCacheSection) > file.size()) {
+      return miss(path, "not a cache file of this version");
+    }
+    if (header.options_hash != options_hash) {
+      return miss(path, "built with different options");
+    }
+    if (header.source_size != source_size) {
+      return miss(path, source_path + " has changed");
+    }
+
+    if (header.source_mtime_ns != source_mtime_ns) {
+      MappedFile source;
+      if (!source.open(source_path) || hash_bytes(source.data(), source.size()) != header.source_hash) {
+        return miss(path, source_path + " has changed");
+      }
+      header.source_mtime_ns = source_mtime_ns;
+      refresh_header(path, header);
+    }
+
+    sections.resize(header.section_count);
+    memcpy(sections.data(), file.data() + sizeof(header), sections.size() * sizeof(MeshCacheSection));
+    for (const auto& section : sections) {
+      if (section.offset > file.size() || section.size > file.size() - section.offset) {
+        return miss(path, "corrupt section table");
+      }
+    }
+    return true;
+  }
+
+
+  size_t section_count() const {
+    return sections.size();
+  }
+
+
+  const void* section(size_t index) const {
+    return file.data() + sections[index].offset;
+  }
+
+
+  size_t section_size(size_t index) const {
+    return static_cast<size_t>(sections[index].size);
+  }
+
+
+  // unmaps the file, every pointer handed out by section becomes invalid
+  void close() {
+    file.close();
+    sections.clear();
+  }
+
+
+  // writes a cache of source_path through a temporary file, so a crash
+  // halfway through never leaves a truncated cache behind
+  static bool write(const std::string& path, const std::string& source_path, uint64_t options_hash,
+      const std::vector<MeshCacheBlob>& blobs) {
+    MeshCacheHeader header = {};
+    memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+    header.version       = MESH_CACHE_VERSION;
+    header.section_count = static_cast<uint32_t>(blobs.size());
+    header.options_hash  = options_hash;
+
+    MappedFile source;
+    if (!stat_file(source_path, header.source_size, header.source_mtime_ns) || !source.open(source_path)) {
+      return false;
+    }
+    header.source_hash = hash_bytes(source.data(), source.size());
+
+    std::vector<MeshCacheSection> table(blobs.size());
+    uint64_t offset = sizeof(header) + sizeof(MeshCacheSection) * blobs.size();
+    for (size_t i = 0; i < blobs.size(); i++) {
+      offset = align(offset);
+      table[i].offset = offset;
+      table[i].size   = blobs[i].size;
+      offset += blobs[i].size;
+    }
+    header.file_size = offset;
+
+    std::string temp_path = path + ".tmp";
+    {
+      std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+      if (!out.is_open()) return false;
+
+      out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+      out.write(reinterpret_cast<const char*>(table.data()), sizeof(MeshCacheSection) * table.size());
+      uint64_t written = sizeof(header) + sizeof(MeshCacheSection) * table.size();
+      const char padding[MESH_CACHE_ALIGNMENT] = {};
+      for (size_t i = 0; i < blobs.size(); i++) {
+        out.write(padding, static_cast<std::streamsize>(table[i].offset - written));
+        out.write(static_cast<const char*>(blobs[i].data), static_cast<std::streamsize>(blobs[i].size));
+        written = table[i].offset + table[i].size;
+      }
+      if (!out) {
+        std::remove(temp_path.c_str());
+        return false;
+      }
+    }
+    return std::rename(temp_path.c_str(), path.c_str()) == 0;
+  }
+
+
+private:
+  MappedFile file;
+  std::vector<MeshCacheSection> sections;
+
+
+  static uint64_t align(uint64_t offset) {
+    return (offset + MESH_CACHE_ALIGNMENT - 1) & ~(MESH_CACHE_ALIGNMENT - 1);
+  }
+
+
+  static bool stat_file(const std::string& path, uint64_t& size, int64_t& mtime_ns) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return false;
+    size     = static_cast<uint64_t>(st.st_size);
+    mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    return true;
+  }
+
+
+  // best effort, a stale time only costs another hash at the next start
+  static void refresh_header(const std::string& path, const MeshCacheHeader& header) {
+    std::fstream out(path, std::ios::binary | std::ios::in | std::ios::out);
+    if (out.is_open()) {
+      out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    }
+  }
+
+
+  bool miss(const std::string& path, const std::string& reason) {
+    std::cout << "mesh cache: " << path << " not used, " << reason << std::endl;
+    close();
+    return false;
+  }
+};
+
+#endif
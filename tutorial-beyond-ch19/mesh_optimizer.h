@@ -0,0 +1,487 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// --------------
+// MESH OPTIMIZER
+// --------------
+// the GPU keeps the results of the last few vertex shader invocations in a
+// small post-transform cache keyed on the index. triangles in OBJ face order
+// jump around the mesh, so most vertices end up being shaded several times
+//
+//   -optimize_vertex_cache: reorders the triangles so they reuse vertices
+//    that are still in the cache (Tom Forsyth, "Linear-Speed Vertex Cache
+//    Optimisation", 2006)
+//   -optimize_vertex_fetch: renumbers the vertices in the order they are
+//    first used, so the vertex fetches walk the vertex buffer front to back
+//   -split_mesh: cuts a mesh into sub-meshes of at most 65535 vertices so
+//    every one of them can use 16-bit indices
+//   -split_lods: split_mesh for a LOD chain, the coarser LODs reuse the
+//    vertex ranges of LOD 0
+//   -analyze_vertex_cache: simulates a FIFO cache of cache_size entries to
+//    measure the result:
+//      -ACMR, average cache miss ratio: shaded vertices per triangle, 3 at
+//       worst and around 0.5 for a regular grid at best
+//      -ATVR, average transformed vertex ratio: shaded vertices per vertex,
+//       1 is optimal
+//
+// only the order of the triangles and of the vertex buffer changes, every
+// triangle keeps its winding and its exact vertex data
+
+
+struct VertexCacheStats {
+  float acmr = 0.0f;
+  float atvr = 0.0f;
+};
+
+
+inline VertexCacheStats analyze_vertex_cache(const std::vector<uint32_t>& indices, size_t vertex_count,
+    uint32_t cache_size = 16) {
+  VertexCacheStats stats;
+  if (indices.empty()) return stats;
+
+  // a vertex is in the FIFO if it was pushed less than cache_size misses ago
+  std::vector<uint32_t> pushed_at(vertex_count, 0);
+  std::vector<bool> used(vertex_count, false);
+  uint32_t misses = 0;
+  size_t used_count = 0;
+
+  for (uint32_t index : indices) {
+    if (!used[index]) {
+      used[index] = true;
+      used_count++;
+    }
+    if (pushed_at[index] == 0 || misses - pushed_at[index] >= cache_size) {
+      misses++;
+      pushed_at[index] = misses;
+    }
+  }
+
+  stats.acmr = static_cast<float>(misses) / (indices.size() / 3);
+  stats.atvr = static_cast<float>(misses) / used_count;
+  return stats;
+}
+
+
+// size of the cache the score function models, larger than what is
+// simulated in analyze_vertex_cache works best in practice
+const int FORSYTH_CACHE_SIZE = 32;
+
+
+inline float forsyth_vertex_score(int cache_position, uint32_t remaining_triangles) {
+  if (remaining_triangles == 0) {
+    return -1.0f;
+  }
+
+  float score = 0.0f;
+  if (cache_position >= 0) {
+    // the triangle just drawn, fixed score so it isn't simply reused again
+    if (cache_position < 3) {
+      score = 0.75f;
+    } else {
+      float scaler = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+      score = std::pow(1.0f - (cache_position - 3) * scaler, 1.5f);
+    }
+  }
+
+  // vertices with few triangles left get priority so they don't end up
+  // isolated and have to be shaded again later
+  score += 2.0f * std::pow(static_cast<float>(remaining_triangles), -0.5f);
+  return score;
+}
+
+
+inline void optimize_vertex_cache(std::vector<uint32_t>& indices, size_t vertex_count) {
+  size_t triangle_count = indices.size() / 3;
+  if (triangle_count == 0) return;
+
+  // triangles of every vertex, packed: the ones of vertex v are
+  // adjacency[offsets[v], offsets[v] + remaining[v])
+  std::vector<uint32_t> remaining(vertex_count, 0);
+  for (uint32_t index : indices) remaining[index]++;
+
+  std::vector<uint32_t> offsets(vertex_count, 0);
+  for (size_t v = 1; v < vertex_count; v++) offsets[v] = offsets[v - 1] + remaining[v - 1];
+
+  std::vector<uint32_t> adjacency(indices.size());
+  std::vector<uint32_t> filled(vertex_count, 0);
+  for (size_t t = 0; t < triangle_count; t++) {
+    for (int k = 0; k < 3; k++) {
+      uint32_t v = indices[t * 3 + k];
+      adjacency[offsets[v] + filled[v]++] = static_cast<uint32_t>(t);
+    }
+  }
+
+  std::vector<int> cache_position(vertex_count, -1);
+  std::vector<float> vertex_score(vertex_count);
+  for (size_t v = 0; v < vertex_count; v++) {
+    vertex_score[v] = forsyth_vertex_score(-1, remaining[v]);
+  }
+
+  std::vector<float> triangle_score(triangle_count);
+  std::vector<bool> emitted(triangle_count, false);
+  for (size_t t = 0; t < triangle_count; t++) {
+    triangle_score[t] = vertex_score[indices[t * 3]] + vertex_score[indices[t * 3 + 1]] +
+        vertex_score[indices[t * 3 + 2]];
+  }
+
+  std::vector<uint32_t> result;
+  result.reserve(indices.size());
+  std::vector<uint32_t> cache, new_cache;
+  cache.reserve(FORSYTH_CACHE_SIZE + 3);
+  new_cache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+  // next triangle in input order that may not have been emitted yet, the
+  // fallback when nothing in the cache has triangles left
+  size_t input_cursor = 0;
+  int64_t best = 0;
+  for (size_t t = 1; t < triangle_count; t++) {
+    if (triangle_score[t] > triangle_score[best]) best = static_cast<int64_t>(t);
+  }
+
+  while (best >= 0) {
+    emitted[best] = true;
+    const uint32_t* triangle = &indices[best * 3];
+    result.insert(result.end(), triangle, triangle + 3);
+
+    // the triangle's vertices move to the front of the cache, once each so a
+    // degenerate triangle doesn't take up two slots
+    new_cache.clear();
+    for (int k = 0; k < 3; k++) {
+      if (std::find(new_cache.begin(), new_cache.end(), triangle[k]) == new_cache.end()) {
+        new_cache.push_back(triangle[k]);
+      }
+    }
+    for (uint32_t v : cache) {
+      if (v != triangle[0] && v != triangle[1] && v != triangle[2]) new_cache.push_back(v);
+    }
+
+    for (int k = 0; k < 3; k++) {
+      uint32_t v = triangle[k];
+      uint32_t* begin = &adjacency[offsets[v]];
+      uint32_t* end   = begin + remaining[v];
+      *std::find(begin, end, static_cast<uint32_t>(best)) = *(end - 1);
+      remaining[v]--;
+    }
+
+    // rescore the cached vertices (and the ones that just fell out) and
+    // their triangles, the best of those is drawn next
+    for (size_t i = 0; i < new_cache.size(); i++) {
+      uint32_t v = new_cache[i];
+      cache_position[v] = i < static_cast<size_t>(FORSYTH_CACHE_SIZE) ? static_cast<int>(i) : -1;
+
+      float new_score = forsyth_vertex_score(cache_position[v], remaining[v]);
+      float delta = new_score - vertex_score[v];
+      vertex_score[v] = new_score;
+
+      for (uint32_t j = 0; j < remaining[v]; j++) {
+        triangle_score[adjacency[offsets[v] + j]] += delta;
+      }
+    }
+
+    best = -1;
+    float best_score = -1.0f;
+    for (uint32_t v : new_cache) {
+      for (uint32_t j = 0; j < remaining[v]; j++) {
+        uint32_t t = adjacency[offsets[v] + j];
+        if (triangle_score[t] > best_score) {
+          best_score = triangle_score[t];
+          best = t;
+        }
+      }
+    }
+
+    if (new_cache.size() > static_cast<size_t>(FORSYTH_CACHE_SIZE)) {
+      new_cache.resize(FORSYTH_CACHE_SIZE);
+    }
+    std::swap(cache, new_cache);
+
+    if (best < 0) {
+      while (input_cursor < triangle_count && emitted[input_cursor]) input_cursor++;
+      if (input_cursor < triangle_count) best = static_cast<int64_t>(input_cursor);
+    }
+  }
+
+  indices.swap(result);
+}
+
+
+// renumbers the vertices in order of first use and reorders vertices to
+// match, vertices no index refers to are dropped
+template <typename T>
+void optimize_vertex_fetch(std::vector<T>& vertices, std::vector<uint32_t>& indices) {
+  const uint32_t unused = ~0u;
+  std::vector<uint32_t> remap(vertices.size(), unused);
+  std::vector<T> result;
+  result.reserve(vertices.size());
+
+  for (uint32_t& index : indices) {
+    if (remap[index] == unused) {
+      remap[index] = static_cast<uint32_t>(result.size());
+      result.push_back(vertices[index]);
+    }
+    index = remap[index];
+  }
+
+  vertices.swap(result);
+}
+
+
+// a range of the index buffer drawn with its own vertexOffset, the indices in
+// it are relative to vertex_offset
+struct SubMesh {
+  uint32_t first_index  = 0;
+  uint32_t index_count  = 0;
+  int32_t  vertex_offset = 0;
+  uint32_t vertex_count = 0;
+};
+
+
+// walks the triangles in order and starts a new sub-mesh whenever the next
+// triangle would take the current one past max_vertices. every sub-mesh gets
+// its own contiguous range of vertices, the ones shared across a cut are
+// duplicated. run it after optimize_vertex_cache, the cache friendly order
+// keeps neighbouring triangles together and the cuts short
+//
+// range_starts are index offsets (multiples of 3, ascending) at which a new
+// sub-mesh must begin, e.g. the start of every LOD in a shared index buffer,
+// so no sub-mesh spans two ranges
+//
+// a mesh that already fits keeps its vertices as they are, with one sub-mesh
+// per range
+template <typename T>
+std::vector<SubMesh> split_mesh(std::vector<T>& vertices, const std::vector<uint32_t>& indices,
+    std::vector<uint16_t>& local_indices, const std::vector<uint32_t>& range_starts = std::vector<uint32_t>(),
+    size_t max_vertices = std::numeric_limits<uint16_t>::max()) {
+  std::vector<SubMesh> submeshes;
+  local_indices.resize(indices.size());
+  if (indices.empty()) return submeshes;
+
+  // ranges as [begin, end) pairs, always starting at 0
+  std::vector<uint32_t> cuts(1, 0);
+  for (uint32_t start : range_starts) {
+    if (start > cuts.back() && start < indices.size()) cuts.push_back(start);
+  }
+  cuts.push_back(static_cast<uint32_t>(indices.size()));
+
+  if (vertices.size() <= max_vertices) {
+    for (size_t i = 0; i < indices.size(); i++) local_indices[i] = static_cast<uint16_t>(indices[i]);
+
+    for (size_t r = 0; r + 1 < cuts.size(); r++) {
+      SubMesh submesh;
+      submesh.first_index  = cuts[r];
+      submesh.index_count  = cuts[r + 1] - cuts[r];
+      submesh.vertex_count = static_cast<uint32_t>(vertices.size());
+      submeshes.push_back(submesh);
+    }
+    return submeshes;
+  }
+
+  // local index of every vertex in the current sub-mesh, valid if the
+  // vertex's stamp is the current sub-mesh
+  std::vector<uint32_t> local(vertices.size());
+  std::vector<uint32_t> stamp(vertices.size(), ~0u);
+  std::vector<T> result;
+  result.reserve(vertices.size() + vertices.size() / 8);
+
+  SubMesh current;
+  uint32_t current_id = 0;
+  size_t next_cut = 1;
+  for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+    uint32_t new_vertices = 0;
+    for (int k = 0; k < 3; k++) {
+      if (stamp[indices[t + k]] != current_id) new_vertices++;
+    }
+
+    bool range_start = t == cuts[next_cut];
+    if (range_start) next_cut++;
+
+    // a degenerate triangle may count the same vertex twice, which only
+    // makes the cut a little early
+    if (range_start || current.vertex_count + new_vertices > max_vertices) {
+      submeshes.push_back(current);
+      current = SubMesh();
+      current.first_index   = static_cast<uint32_t>(t);
+      current.vertex_offset = static_cast<int32_t>(result.size());
+      current_id++;
+    }
+
+    for (int k = 0; k < 3; k++) {
+      uint32_t v = indices[t + k];
+      if (stamp[v] != current_id) {
+        stamp[v] = current_id;
+        local[v] = current.vertex_count++;
+        result.push_back(vertices[v]);
+      }
+      local_indices[t + k] = static_cast<uint16_t>(local[v]);
+    }
+    current.index_count += 3;
+  }
+  submeshes.push_back(current);
+
+  vertices.swap(result);
+  return submeshes;
+}
+
+
+// split_mesh for a LOD chain in one index buffer, lod_starts as range_starts.
+// only LOD 0 is cut into new vertex ranges. the coarser LODs index a subset
+// of its vertices, so each of their triangles is drawn from a sub-mesh range
+// of LOD 0 that already holds all three of its corners, and the triangles of
+// a LOD are grouped by range (keeping their order within it). a triangle
+// whose corners ended up in different ranges has no such range, those get
+// ranges of their own appended to the vertex buffer and are counted in
+// lod_copies
+template <typename T>
+std::vector<SubMesh> split_lods(std::vector<T>& vertices, std::vector<uint32_t>& indices,
+    std::vector<uint16_t>& local_indices, const std::vector<uint32_t>& lod_starts, size_t* lod_copies = nullptr,
+    size_t max_vertices = std::numeric_limits<uint16_t>::max()) {
+  if (lod_copies) *lod_copies = 0;
+  if (vertices.size() <= max_vertices || lod_starts.size() < 2) {
+    return split_mesh(vertices, indices, local_indices, lod_starts, max_vertices);
+  }
+
+  std::vector<T> original = vertices;
+  size_t original_count = vertices.size();
+  std::vector<uint32_t> lod0(indices.begin(), indices.begin() + lod_starts[1]);
+  std::vector<uint16_t> lod0_local;
+  std::vector<SubMesh> submeshes = split_mesh(vertices, lod0, lod0_local, std::vector<uint32_t>(), max_vertices);
+  uint32_t lod0_submeshes = static_cast<uint32_t>(submeshes.size());
+
+  local_indices.resize(indices.size());
+  std::copy(lod0_local.begin(), lod0_local.end(), local_indices.begin());
+
+  // the copies of every vertex, packed like the adjacency in
+  // optimize_vertex_cache: (sub-mesh, local index) pairs in
+  // copies[offsets[v], offsets[v + 1])
+  struct Copy {
+    uint32_t submesh;
+    uint32_t local;
+  };
+  std::vector<uint32_t> offsets(original_count + 1, 0);
+  std::vector<uint32_t> stamp(original_count, ~0u);
+  for (uint32_t s = 0; s < lod0_submeshes; s++) {
+    for (uint32_t i = submeshes[s].first_index; i < submeshes[s].first_index + submeshes[s].index_count; i++) {
+      if (stamp[lod0[i]] != s) {
+        stamp[lod0[i]] = s;
+        offsets[lod0[i] + 1]++;
+      }
+    }
+  }
+  for (size_t v = 0; v < original_count; v++) offsets[v + 1] += offsets[v];
+
+  std::vector<Copy> copies(offsets[original_count]);
+  std::vector<uint32_t> filled(offsets.begin(), offsets.end() - 1);
+  std::fill(stamp.begin(), stamp.end(), ~0u);
+  for (uint32_t s = 0; s < lod0_submeshes; s++) {
+    for (uint32_t i = submeshes[s].first_index; i < submeshes[s].first_index + submeshes[s].index_count; i++) {
+      if (stamp[lod0[i]] != s) {
+        stamp[lod0[i]] = s;
+        copies[filled[lod0[i]]++] = Copy{s, lod0_local[i]};
+      }
+    }
+  }
+
+  const uint32_t no_copy = ~0u;
+  auto local_in = [&](uint32_t v, uint32_t submesh) {
+    for (uint32_t c = offsets[v]; c < offsets[v + 1]; c++) {
+      if (copies[c].submesh == submesh) return copies[c].local;
+    }
+    return no_copy;
+  };
+
+  // range of LOD 0 every triangle is drawn from, lod0_submeshes if none
+  const uint32_t own_range = lod0_submeshes;
+  std::vector<uint32_t> range;
+  std::vector<uint32_t> sorted;
+  for (size_t l = 1; l < lod_starts.size(); l++) {
+    uint32_t begin = lod_starts[l];
+    uint32_t end   = l + 1 < lod_starts.size() ? lod_starts[l + 1] : static_cast<uint32_t>(indices.size());
+    size_t triangle_count = (end - begin) / 3;
+
+    // neighbouring triangles mostly share a range, so the last one is tried
+    // first
+    range.assign(triangle_count, own_range);
+    uint32_t previous = 0;
+    std::vector<uint32_t> bucket_sizes(lod0_submeshes + 1, 0);
+    for (size_t t = 0; t < triangle_count; t++) {
+      const uint32_t* triangle = &indices[begin + t * 3];
+      auto fits = [&](uint32_t submesh) {
+        return local_in(triangle[0], submesh) != no_copy && local_in(triangle[1], submesh) != no_copy &&
+            local_in(triangle[2], submesh) != no_copy;
+      };
+
+      if (fits(previous)) {
+        range[t] = previous;
+      } else {
+        for (uint32_t c = offsets[triangle[0]]; c < offsets[triangle[0] + 1]; c++) {
+          if (fits(copies[c].submesh)) {
+            range[t] = previous = copies[c].submesh;
+            break;
+          }
+        }
+      }
+      bucket_sizes[range[t]]++;
+    }
+
+    // counting sort by range, stable so every range keeps the cache order
+    std::vector<uint32_t> bucket_starts(lod0_submeshes + 1, 0);
+    for (uint32_t r = 1; r <= lod0_submeshes; r++) bucket_starts[r] = bucket_starts[r - 1] + bucket_sizes[r - 1];
+    sorted.resize(end - begin);
+    std::vector<uint32_t> bucket_fill = bucket_starts;
+    for (size_t t = 0; t < triangle_count; t++) {
+      uint32_t slot = bucket_fill[range[t]]++;
+      std::copy(&indices[begin + t * 3], &indices[begin + t * 3] + 3, &sorted[slot * 3]);
+    }
+    std::copy(sorted.begin(), sorted.end(), indices.begin() + begin);
+
+    for (uint32_t r = 0; r < lod0_submeshes; r++) {
+      if (bucket_sizes[r] == 0) continue;
+
+      SubMesh submesh = submeshes[r];
+      submesh.first_index = begin + bucket_starts[r] * 3;
+      submesh.index_count = bucket_sizes[r] * 3;
+      for (uint32_t i = submesh.first_index; i < submesh.first_index + submesh.index_count; i++) {
+        local_indices[i] = static_cast<uint16_t>(local_in(indices[i], r));
+      }
+      submeshes.push_back(submesh);
+    }
+
+    // the rest is split on its own and appended to the vertex buffer
+    if (bucket_sizes[own_range] > 0) {
+      uint32_t first = begin + bucket_starts[own_range] * 3;
+      std::vector<T> own_vertices;
+      std::vector<uint32_t> own_indices;
+      std::fill(stamp.begin(), stamp.end(), ~0u);
+      for (uint32_t i = first; i < end; i++) {
+        uint32_t v = indices[i];
+        if (stamp[v] == ~0u) {
+          stamp[v] = static_cast<uint32_t>(own_vertices.size());
+          own_vertices.push_back(original[v]);
+        }
+        own_indices.push_back(stamp[v]);
+      }
+
+      std::vector<uint16_t> own_local;
+      std::vector<SubMesh> own = split_mesh(own_vertices, own_indices, own_local, std::vector<uint32_t>(),
+          max_vertices);
+      for (auto& submesh : own) {
+        submesh.first_index  += first;
+        submesh.vertex_offset += static_cast<int32_t>(vertices.size());
+        submeshes.push_back(submesh);
+      }
+      std::copy(own_local.begin(), own_local.end(), local_indices.begin() + first);
+      vertices.insert(vertices.end(), own_vertices.begin(), own_vertices.end());
+      if (lod_copies) *lod_copies += own_vertices.size();
+    }
+  }
+
+  return submeshes;
+}
+
+#endif
@@ -0,0 +1,259 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// ---------------
+// MESH SIMPLIFIER
+// ---------------
+// builds a coarser index buffer for the same vertex buffer by collapsing
+// edges, cheapest first (Garland and Heckbert, "Surface Simplification Using
+// Quadric Error Metrics", 1997)
+//
+// every vertex carries a quadric: the sum of the squared distance functions
+// of the planes of its triangles. collapsing a onto b merges a's quadric into
+// b's, and evaluating the merged quadric at b estimates how far the surface
+// moves. collapses are half-edge collapses, a vertex is only ever moved onto
+// an existing vertex, so the simplified mesh references a subset of the
+// original vertices and needs no vertex data of its own
+//
+// vertices that would tear the mesh if they moved are locked:
+//   -UV seams: load_model splits a vertex wherever its texture coordinates
+//    change, so several vertices share one position. moving one of them
+//    without the others would open a crack and stretch the texture
+//   -borders: edges with only one triangle, moving them shrinks holes and
+//    silhouettes
+//
+// collapses are done in passes. each pass sorts every candidate edge by cost
+// and applies as many of them as it can as long as they don't touch the
+// same triangles, then the index buffer is rebuilt without the triangles
+// that became degenerate
+
+
+struct SimplifyQuadric {
+  // symmetric 4x4 matrix, upper triangle
+  double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+  double a11 = 0, a12 = 0, a13 = 0;
+  double a22 = 0, a23 = 0;
+  double a33 = 0;
+
+
+  // the plane n.p + d = 0, n of unit length
+  static SimplifyQuadric from_plane(double nx, double ny, double nz, double d) {
+    SimplifyQuadric q;
+    q.a00 = nx * nx; q.a01 = nx * ny; q.a02 = nx * nz; q.a03 = nx * d;
+    q.a11 = ny * ny; q.a12 = ny * nz; q.a13 = ny * d;
+    q.a22 = nz * nz; q.a23 = nz * d;
+    q.a33 = d * d;
+    return q;
+  }
+
+
+  void add(const SimplifyQuadric& o) {
+    a00 += o.a00; a01 += o.a01; a02 += o.a02; a03 += o.a03;
+    a11 += o.a11; a12 += o.a12; a13 += o.a13;
+    a22 += o.a22; a23 += o.a23;
+    a33 += o.a33;
+  }
+
+
+  // sum of squared distances of p to the planes
+  double evaluate(const double* p) const {
+    double x = p[0], y = p[1], z = p[2];
+    return a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z + 2 * a03 * x +
+        a11 * y * y + 2 * a12 * y * z + 2 * a13 * y +
+        a22 * z * z + 2 * a23 * z + a33;
+  }
+};
+
+
+// returns at most target_index_count indices (or as close as the locked
+// vertices allow) referencing the same vertices. result_error, if given,
+// receives the largest error of a collapse that was done, roughly the
+// distance in model units the surface has moved
+template <typename T>
+std::vector<uint32_t> simplify_mesh(const std::vector<T>& vertices, const std::vector<uint32_t>& indices,
+    size_t target_index_count, float* result_error = nullptr) {
+  size_t vertex_count = vertices.size();
+  std::vector<double> positions(vertex_count * 3);
+  for (size_t v = 0; v < vertex_count; v++) {
+    for (int c = 0; c < 3; c++) positions[v * 3 + c] = vertices[v].pos[c];
+  }
+  auto position = [&positions](uint32_t v) { return &positions[v * 3]; };
+
+  // vertices that share a position get the same position id, the smallest
+  // vertex index among them
+  std::vector<uint32_t> sorted(vertex_count);
+  for (size_t v = 0; v < vertex_count; v++) sorted[v] = static_cast<uint32_t>(v);
+  std::sort(sorted.begin(), sorted.end(), [&position](uint32_t a, uint32_t b) {
+    return std::lexicographical_compare(position(a), position(a) + 3, position(b), position(b) + 3);
+  });
+
+  std::vector<uint32_t> position_id(vertex_count);
+  std::vector<bool> locked(vertex_count, false);
+  for (size_t i = 0; i < vertex_count;) {
+    size_t j = i + 1;
+    while (j < vertex_count && std::equal(position(sorted[i]), position(sorted[i]) + 3, position(sorted[j]))) j++;
+
+    uint32_t id = *std::min_element(sorted.begin() + i, sorted.begin() + j);
+    for (size_t k = i; k < j; k++) {
+      position_id[sorted[k]] = id;
+      if (j - i > 1) locked[sorted[k]] = true;
+    }
+    i = j;
+  }
+
+  // a border edge has no twin running the other way, compared by position
+  // so the two sides of a seam count as connected
+  std::unordered_map<uint64_t, uint32_t> edge_count;
+  auto edge_key = [&position_id](uint32_t a, uint32_t b) {
+    return (static_cast<uint64_t>(position_id[a]) << 32) | position_id[b];
+  };
+  for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+    for (int k = 0; k < 3; k++) {
+      edge_count[edge_key(indices[t + k], indices[t + (k + 1) % 3])]++;
+    }
+  }
+  for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+    for (int k = 0; k < 3; k++) {
+      uint32_t a = indices[t + k], b = indices[t + (k + 1) % 3];
+      if (edge_count.find(edge_key(b, a)) == edge_count.end()) {
+        locked[a] = true;
+        locked[b] = true;
+      }
+    }
+  }
+
+  std::vector<SimplifyQuadric> quadrics(vertex_count);
+  for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+    const double* p0 = position(indices[t]);
+    const double* p1 = position(indices[t + 1]);
+    const double* p2 = position(indices[t + 2]);
+    double e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+    double e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+    double n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+    double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if (length == 0.0) continue;
+
+    n[0] /= length; n[1] /= length; n[2] /= length;
+    SimplifyQuadric q = SimplifyQuadric::from_plane(n[0], n[1], n[2], -(n[0] * p0[0] + n[1] * p0[1] + n[2] * p0[2]));
+    for (int k = 0; k < 3; k++) quadrics[indices[t + k]].add(q);
+  }
+
+  struct Collapse {
+    uint32_t from;
+    uint32_t to;
+    double cost;
+  };
+
+  std::vector<uint32_t> result = indices;
+  std::vector<uint32_t> offsets(vertex_count + 1);
+  std::vector<uint32_t> adjacency;
+  std::vector<Collapse> collapses;
+  std::vector<uint32_t> remap(vertex_count);
+  std::vector<bool> touched(vertex_count);
+  double max_error = 0.0;
+
+  while (result.size() > target_index_count) {
+    // triangles around every vertex
+    std::fill(offsets.begin(), offsets.end(), 0);
+    for (uint32_t v : result) offsets[v + 1]++;
+    for (size_t v = 0; v < vertex_count; v++) offsets[v + 1] += offsets[v];
+    adjacency.resize(result.size());
+    std::vector<uint32_t> filled(offsets.begin(), offsets.end() - 1);
+    for (size_t t = 0; t < result.size(); t += 3) {
+      for (int k = 0; k < 3; k++) adjacency[filled[result[t + k]]++] = static_cast<uint32_t>(t);
+    }
+
+    collapses.clear();
+    for (size_t t = 0; t < result.size(); t += 3) {
+      for (int k = 0; k < 3; k++) {
+        uint32_t a = result[t + k], b = result[t + (k + 1) % 3];
+        if (!locked[a]) collapses.push_back(Collapse{a, b, 0.0});
+        if (!locked[b]) collapses.push_back(Collapse{b, a, 0.0});
+      }
+    }
+    for (auto& collapse : collapses) {
+      SimplifyQuadric q = quadrics[collapse.from];
+      q.add(quadrics[collapse.to]);
+      collapse.cost = std::max(0.0, q.evaluate(position(collapse.to)));
+    }
+    std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) {
+      return a.cost < b.cost;
+    });
+
+    // every collapse removes about two triangles
+    size_t wanted = (result.size() - target_index_count) / 6 + 1;
+    size_t applied = 0;
+    for (size_t v = 0; v < vertex_count; v++) remap[v] = static_cast<uint32_t>(v);
+    std::fill(touched.begin(), touched.end(), false);
+
+    for (const auto& collapse : collapses) {
+      if (applied >= wanted) break;
+      uint32_t a = collapse.from, b = collapse.to;
+      if (touched[a] || touched[b]) continue;
+
+      // moving a onto b must not flip any of the triangles that stay
+      bool flips = false;
+      for (uint32_t i = offsets[a]; i < offsets[a + 1] && !flips; i++) {
+        const uint32_t* triangle = &result[adjacency[i]];
+        if (triangle[0] == b || triangle[1] == b || triangle[2] == b) continue;
+
+        const double* before[3];
+        const double* after[3];
+        for (int k = 0; k < 3; k++) {
+          before[k] = position(triangle[k]);
+          after[k]  = triangle[k] == a ? position(b) : before[k];
+        }
+
+        double n[2][3];
+        const double* const* corners[2] = {before, after};
+        for (int s = 0; s < 2; s++) {
+          const double* const* p = corners[s];
+          double e1[3] = {p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2]};
+          double e2[3] = {p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2]};
+          n[s][0] = e1[1] * e2[2] - e1[2] * e2[1];
+          n[s][1] = e1[2] * e2[0] - e1[0] * e2[2];
+          n[s][2] = e1[0] * e2[1] - e1[1] * e2[0];
+        }
+        flips = n[0][0] * n[1][0] + n[0][1] * n[1][1] + n[0][2] * n[1][2] <= 0.0;
+      }
+      if (flips) continue;
+
+      // the triangles around a change shape, none of their vertices may take
+      // part in another collapse of this pass
+      for (uint32_t i = offsets[a]; i < offsets[a + 1]; i++) {
+        for (int k = 0; k < 3; k++) touched[result[adjacency[i] + k]] = true;
+      }
+      touched[b] = true;
+
+      remap[a] = b;
+      quadrics[b].add(quadrics[a]);
+      max_error = std::max(max_error, collapse.cost);
+      applied++;
+    }
+
+    if (applied == 0) break;
+
+    size_t write = 0;
+    for (size_t t = 0; t < result.size(); t += 3) {
+      uint32_t v0 = remap[result[t]], v1 = remap[result[t + 1]], v2 = remap[result[t + 2]];
+      if (v0 == v1 || v1 == v2 || v0 == v2) continue;
+      result[write++] = v0;
+      result[write++] = v1;
+      result[write++] = v2;
+    }
+    result.resize(write);
+  }
+
+  if (result_error) {
+    *result_error = static_cast<float>(std::sqrt(max_error));
+  }
+  return result;
+}
+
+#endif
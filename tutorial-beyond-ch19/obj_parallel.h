@@ -0,0 +1,1406 @@
+#ifndef OBJ_PARALLEL_H
+#define OBJ_PARALLEL_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// ----------------------
+// PARALLEL OBJ PARSING
+// ----------------------
+// obj_parallel::LoadObjParallel takes the same arguments as tinyobj::LoadObj
+// plus a thread count and returns the same attrib_t and shape_t data. the
+// vendored tiny_obj_loader.h is left as it is upstream, it has to be included
+// before this header (including it again here would repeat its
+// implementation in main.cpp)
+//
+// the file is memory mapped and cut at line endings into one chunk per
+// thread, then parsed in three passes:
+//   -every chunk counts its v/vn/vt lines. prefix sums give every chunk its
+//    offset into the attribute arrays, and the vertex counts that relative
+//    face indices are resolved against, exactly like the serial parser
+//   -the chunks are parsed concurrently, attributes go straight into
+//    attrib_t and faces are stored with their final indices
+//   -faces are flattened and triangulated per chunk
+// the g/o/usemtl/mtllib/t/l lines are replayed on one thread in file order,
+// and shapes are built from runs of the flattened faces. smoothing groups
+// carry across chunk borders
+//
+// two cases fall back to LoadObj so the result stays identical: a face parse
+// error, so it is reported the same way, and a polygon that references a
+// vertex defined after it, which LoadObj triangulates against a partial
+// vertex list
+//
+// the code below keeps tinyobjloader's style. the helpers at the top are
+// copied from its implementation (made inline, the IS_* macros turned into
+// functions) so numbers and indices are read exactly the way LoadObj reads
+// them. exportFaceToShape is the per-face body of its exportGroupsToShape
+
+
+namespace obj_parallel {
+
+using tinyobj::attrib_t;
+using tinyobj::index_t;
+using tinyobj::material_t;
+using tinyobj::MaterialFileReader;
+using tinyobj::MaterialReader;
+using tinyobj::mesh_t;
+using tinyobj::real_t;
+using tinyobj::shape_t;
+using tinyobj::tag_t;
+
+// --- copied from tiny_obj_loader.h ---
+
+struct vertex_index_t {
+  int v_idx, vt_idx, vn_idx;
+  vertex_index_t() : v_idx(-1), vt_idx(-1), vn_idx(-1) {}
+  explicit vertex_index_t(int idx) : v_idx(idx), vt_idx(idx), vn_idx(idx) {}
+  vertex_index_t(int vidx, int vtidx, int vnidx)
+      : v_idx(vidx), vt_idx(vtidx), vn_idx(vnidx) {}
+};
+
+struct face_t {
+  unsigned int
+      smoothing_group_id;  // smoothing group id. 0 = smoothing groupd is off.
+  int pad_;
+  std::vector<vertex_index_t> vertex_indices;  // face vertex indices.
+
+  face_t() : smoothing_group_id(0) {}
+};
+
+struct line_t {
+  int idx0;
+  int idx1;
+};
+
+struct tag_sizes {
+  tag_sizes() : num_ints(0), num_reals(0), num_strings(0) {}
+  int num_ints;
+  int num_reals;
+  int num_strings;
+};
+
+inline bool is_space(char x) { return x == ' ' || x == '\t'; }
+inline bool is_digit(char x) {
+  return static_cast<unsigned int>(x - '0') < static_cast<unsigned int>(10);
+}
+inline bool is_new_line(char x) { return x == '\r' || x == '\n' || x == '\0'; }
+
+// Make index zero-base, and also support relative index.
+inline bool fixIndex(int idx, int n, int *ret) {
+  if (!ret) {
+    return false;
+  }
+
+  if (idx > 0) {
+    (*ret) = idx - 1;
+    return true;
+  }
+
+  if (idx == 0) {
+    // zero is not allowed according to the spec.
+    return false;
+  }
+
+  if (idx < 0) {
+    (*ret) = n + idx;  // negative value = relative
+    return true;
+  }
+
+  return false;  // never reach here.
+}
+
+inline std::string parseString(const char **token) {
+  std::string s;
+  (*token) += strspn((*token), " \t");
+  size_t e = strcspn((*token), " \t\r");
+  s = std::string((*token), &(*token)[e]);
+  (*token) += e;
+  return s;
+}
+
+inline int parseInt(const char **token) {
+  (*token) += strspn((*token), " \t");
+  int i = atoi((*token));
+  (*token) += strcspn((*token), " \t\r");
+  return i;
+}
+
+// Tries to parse a floating point number located at s.
+//
+// s_end should be a location in the string where reading should absolutely
+// stop. For example at the end of the string, to prevent buffer overflows.
+//
+// Parses the following EBNF grammar:
+//   sign    = "+" | "-" ;
+//   END     = ? anything not in digit ?
+//   digit   = "0" | "1" | "2" | "3" | "4" | "5" | "6" | "7" | "8" | "9" ;
+//   integer = [sign] , digit , {digit} ;
+//   decimal = integer , ["." , integer] ;
+//   float   = ( decimal , END ) | ( decimal , ("E" | "e") , integer , END ) ;
+//
+//  Valid strings are for example:
+//   -0  +3.1417e+2  -0.0E-3  1.0324  -1.41   11e2
+//
+// If the parsing is a success, result is set to the parsed value and true
+// is returned.
+//
+// The function is greedy and will parse until any of the following happens:
+//  - a non-conforming character is encountered.
+//  - s_end is reached.
+//
+// The following situations triggers a failure:
+//  - s >= s_end.
+//  - parse failure.
+//
+inline bool tryParseDouble(const char *s, const char *s_end, double *result) {
+  if (s >= s_end) {
+    return false;
+  }
+
+  double mantissa = 0.0;
+  // This exponent is base 2 rather than 10.
+  // However the exponent we parse is supposed to be one of ten,
+  // thus we must take care to convert the exponent/and or the
+  // mantissa to a * 2^E, where a is the mantissa and E is the
+  // exponent.
+  // To get the final double we will use ldexp, it requires the
+  // exponent to be in base 2.
+  int exponent = 0;
+
+  // NOTE: THESE MUST BE DECLARED HERE SINCE WE ARE NOT ALLOWED
+  // TO JUMP OVER DEFINITIONS.
+  char sign = '+';
+  char exp_sign = '+';
+  char const *curr = s;
+
+  // How many characters were read in a loop.
+  int read = 0;
+  // Tells whether a loop terminated due to reaching s_end.
+  bool end_not_reached = false;
+
+  /*
+          BEGIN PARSING.
+  */
+
+  // Find out what sign we've got.
+  if (*curr == '+' || *curr == '-') {
+    sign = *curr;
+    curr++;
+  } else if (is_digit(*curr)) { /* Pass through. */
+  } else {
+    goto fail;
+  }
+
+  // Read the integer part.
+  end_not_reached = (curr != s_end);
+  while (end_not_reached && is_digit(*curr)) {
+    mantissa *= 10;
+    mantissa += static_cast<int>(*curr - 0x30);
+    curr++;
+    read++;
+    end_not_reached = (curr != s_end);
+  }
+
+  // We must make sure we actually got something.
+  if (read == 0) goto fail;
+  // We allow numbers of form "#", "###" etc.
+  if (!end_not_reached) goto assemble;
+
+  // Read the decimal part.
+  if (*curr == '.') {
+    curr++;
+    read = 1;
+    end_not_reached = (curr != s_end);
+    while (end_not_reached && is_digit(*curr)) {
+      static const double pow_lut[] = {
+          1.0, 0.1, 0.01, 0.001, 0.0001, 0.00001, 0.000001, 0.0000001,
+      };
+      const int lut_entries = sizeof pow_lut / sizeof pow_lut[0];
+
+      // NOTE: Don't use powf here, it will absolutely murder precision.
+      mantissa += static_cast<int>(*curr - 0x30) *
+                  (read < lut_entries ? pow_lut[read] : std::pow(10.0, -read));
+      read++;
+      curr++;
+      end_not_reached = (curr != s_end);
+    }
+  } else if (*curr == 'e' || *curr == 'E') {
+  } else {
+    goto assemble;
+  }
+
+  if (!end_not_reached) goto assemble;
+
+  // Read the exponent part.
+  if (*curr == 'e' || *curr == 'E') {
+    curr++;
+    // Figure out if a sign is present and if it is.
+    end_not_reached = (curr != s_end);
+    if (end_not_reached && (*curr == '+' || *curr == '-')) {
+      exp_sign = *curr;
+      curr++;
+    } else if (is_digit(*curr)) { /* Pass through. */
+    } else {
+      // Empty E is not allowed.
+      goto fail;
+    }
+
+    read = 0;
+    end_not_reached = (curr != s_end);
+    while (end_not_reached && is_digit(*curr)) {
+      exponent *= 10;
+      exponent += static_cast<int>(*curr - 0x30);
+      curr++;
+      read++;
+      end_not_reached = (curr != s_end);
+    }
+    exponent *= (exp_sign == '+' ? 1 : -1);
+    if (read == 0) goto fail;
+  }
+
+assemble:
+  *result = (sign == '+' ? 1 : -1) *
+            (exponent ? std::ldexp(mantissa * std::pow(5.0, exponent), exponent)
+                      : mantissa);
+  return true;
+fail:
+  return false;
+}
+
+inline real_t parseReal(const char **token, double default_value = 0.0) {
+  (*token) += strspn((*token), " \t");
+  const char *end = (*token) + strcspn((*token), " \t\r");
+  double val = default_value;
+  tryParseDouble((*token), end, &val);
+  real_t f = static_cast<real_t>(val);
+  (*token) = end;
+  return f;
+}
+
+inline void parseReal2(real_t *x, real_t *y, const char **token,
+                              const double default_x = 0.0,
+                              const double default_y = 0.0) {
+  (*x) = parseReal(token, default_x);
+  (*y) = parseReal(token, default_y);
+}
+
+inline void parseReal3(real_t *x, real_t *y, real_t *z,
+                              const char **token, const double default_x = 0.0,
+                              const double default_y = 0.0,
+                              const double default_z = 0.0) {
+  (*x) = parseReal(token, default_x);
+  (*y) = parseReal(token, default_y);
+  (*z) = parseReal(token, default_z);
+}
+
+// Extension: parse vertex with colors(6 items)
+inline bool parseVertexWithColor(real_t *x, real_t *y, real_t *z,
+                                        real_t *r, real_t *g, real_t *b,
+                                        const char **token,
+                                        const double default_x = 0.0,
+                                        const double default_y = 0.0,
+                                        const double default_z = 0.0) {
+  (*x) = parseReal(token, default_x);
+  (*y) = parseReal(token, default_y);
+  (*z) = parseReal(token, default_z);
+
+  (*r) = parseReal(token, 1.0);
+  (*g) = parseReal(token, 1.0);
+  (*b) = parseReal(token, 1.0);
+
+  return true;
+}
+
+inline tag_sizes parseTagTriple(const char **token) {
+  tag_sizes ts;
+
+  (*token) += strspn((*token), " \t");
+  ts.num_ints = atoi((*token));
+  (*token) += strcspn((*token), "/ \t\r");
+  if ((*token)[0] != '/') {
+    return ts;
+  }
+
+  (*token)++;  // Skip '/'
+
+  (*token) += strspn((*token), " \t");
+  ts.num_reals = atoi((*token));
+  (*token) += strcspn((*token), "/ \t\r");
+  if ((*token)[0] != '/') {
+    return ts;
+  }
+  (*token)++;  // Skip '/'
+
+  ts.num_strings = parseInt(token);
+
+  return ts;
+}
+
+// Parse triples with index offsets: i, i/j/k, i//k, i/j
+inline bool parseTriple(const char **token, int vsize, int vnsize, int vtsize,
+                        vertex_index_t *ret) {
+  if (!ret) {
+    return false;
+  }
+
+  vertex_index_t vi(-1);
+
+  if (!fixIndex(atoi((*token)), vsize, &(vi.v_idx))) {
+    return false;
+  }
+
+  (*token) += strcspn((*token), "/ \t\r");
+  if ((*token)[0] != '/') {
+    (*ret) = vi;
+    return true;
+  }
+  (*token)++;
+
+  // i//k
+  if ((*token)[0] == '/') {
+    (*token)++;
+    if (!fixIndex(atoi((*token)), vnsize, &(vi.vn_idx))) {
+      return false;
+    }
+    (*token) += strcspn((*token), "/ \t\r");
+    (*ret) = vi;
+    return true;
+  }
+
+  // i/j/k or i/j
+  if (!fixIndex(atoi((*token)), vtsize, &(vi.vt_idx))) {
+    return false;
+  }
+
+  (*token) += strcspn((*token), "/ \t\r");
+  if ((*token)[0] != '/') {
+    (*ret) = vi;
+    return true;
+  }
+
+  // i/j/k
+  (*token)++;  // skip '/'
+  if (!fixIndex(atoi((*token)), vnsize, &(vi.vn_idx))) {
+    return false;
+  }
+  (*token) += strcspn((*token), "/ \t\r");
+
+  (*ret) = vi;
+
+  return true;
+}
+
+// code from https://wrf.ecse.rpi.edu//Research/Short_Notes/pnpoly.html
+template <typename T>
+inline int pnpoly(int nvert, T *vertx, T *verty, T testx, T testy) {
+  int i, j, c = 0;
+  for (i = 0, j = nvert - 1; i < nvert; j = i++) {
+    if (((verty[i] > testy) != (verty[j] > testy)) &&
+        (testx <
+         (vertx[j] - vertx[i]) * (testy - verty[i]) / (verty[j] - verty[i]) +
+             vertx[i]))
+      c = !c;
+  }
+  return c;
+}
+
+// http://stackoverflow.com/questions/236129/split-a-string-in-c
+inline void SplitString(const std::string &s, char delim,
+                        std::vector<std::string> &elems) {
+  std::stringstream ss;
+  ss.str(s);
+  std::string item;
+  while (std::getline(ss, item, delim)) {
+    elems.push_back(item);
+  }
+}
+
+// --- parallel parser ---
+
+// Parses the indices of a `l' line into pairs of line end points.
+inline void parseLineIndices(const char **token, std::vector<int> *lineGroup) {
+  line_t line_cache;
+  bool end_line_bit = 0;
+  while (!is_new_line((*token)[0])) {
+    // get index from string
+    int idx;
+    fixIndex(parseInt(token), 0, &idx);
+
+    size_t n = strspn((*token), " \t\r");
+    (*token) += n;
+
+    if (!end_line_bit) {
+      line_cache.idx0 = idx;
+    } else {
+      line_cache.idx1 = idx;
+      lineGroup->push_back(line_cache.idx0);
+      lineGroup->push_back(line_cache.idx1);
+      line_cache = line_t();
+    }
+    end_line_bit = !end_line_bit;
+  }
+}
+
+// Parses a `t' line(after `t ').
+inline void parseTag(const char **token, tag_t *tag) {
+  const int max_tag_nums = 8192;  // FIXME(syoyo): Parameterize.
+
+  tag->name = parseString(token);
+
+  tag_sizes ts = parseTagTriple(token);
+
+  if (ts.num_ints < 0) {
+    ts.num_ints = 0;
+  }
+  if (ts.num_ints > max_tag_nums) {
+    ts.num_ints = max_tag_nums;
+  }
+
+  if (ts.num_reals < 0) {
+    ts.num_reals = 0;
+  }
+  if (ts.num_reals > max_tag_nums) {
+    ts.num_reals = max_tag_nums;
+  }
+
+  if (ts.num_strings < 0) {
+    ts.num_strings = 0;
+  }
+  if (ts.num_strings > max_tag_nums) {
+    ts.num_strings = max_tag_nums;
+  }
+
+  tag->intValues.resize(static_cast<size_t>(ts.num_ints));
+
+  for (size_t i = 0; i < static_cast<size_t>(ts.num_ints); ++i) {
+    tag->intValues[i] = parseInt(token);
+  }
+
+  tag->floatValues.resize(static_cast<size_t>(ts.num_reals));
+  for (size_t i = 0; i < static_cast<size_t>(ts.num_reals); ++i) {
+    tag->floatValues[i] = parseReal(token);
+  }
+
+  tag->stringValues.resize(static_cast<size_t>(ts.num_strings));
+  for (size_t i = 0; i < static_cast<size_t>(ts.num_strings); ++i) {
+    tag->stringValues[i] = parseString(token);
+  }
+}
+
+// Parses a `s' line(after `s '). Returns false and leaves
+// `current_smoothing_id' as is when the line has no id.
+inline bool parseSmoothingGroupId(const char *token,
+                                  unsigned int *current_smoothing_id) {
+  // skip space.
+  token += strspn(token, " \t");  // skip space
+
+  if (token[0] == '\0') {
+    return false;
+  }
+
+  if (token[0] == '\r' || token[1] == '\n') {
+    return false;
+  }
+
+  if (strlen(token) >= 3) {
+    if (token[0] == 'o' && token[1] == 'f' && token[2] == 'f') {
+      (*current_smoothing_id) = 0;
+    } else {
+      return false;
+    }
+  } else {
+    // assume number
+    int smGroupId = parseInt(&token);
+    if (smGroupId < 0) {
+      // parse error. force set to 0.
+      // FIXME(syoyo): Report warning.
+      (*current_smoothing_id) = 0;
+    } else {
+      (*current_smoothing_id) = static_cast<unsigned int>(smGroupId);
+    }
+  }
+
+  return true;
+}
+
+// Appends one face to `shape->mesh`, split into triangles when
+// `triangulate` is set. Faces with less than 3 vertices are skipped.
+inline void exportFaceToShape(shape_t *shape,
+                              const vertex_index_t *vertex_indices,
+                              size_t npolys, unsigned int smoothing_group_id,
+                              const int material_id, bool triangulate,
+                              const std::vector<real_t> &v) {
+  if (npolys < 3) {
+    // Face must have 3+ vertices.
+    return;
+  }
+
+  vertex_index_t i0 = vertex_indices[0];
+  vertex_index_t i1(-1);
+  vertex_index_t i2 = vertex_indices[1];
+
+  if (triangulate) {
+    // find the two axes to work in
+    size_t axes[2] = {1, 2};
+    for (size_t k = 0; k < npolys; ++k) {
+      i0 = vertex_indices[(k + 0) % npolys];
+      i1 = vertex_indices[(k + 1) % npolys];
+      i2 = vertex_indices[(k + 2) % npolys];
+      size_t vi0 = size_t(i0.v_idx);
+      size_t vi1 = size_t(i1.v_idx);
+      size_t vi2 = size_t(i2.v_idx);
+
+      if (((3 * vi0 + 2) >= v.size()) || ((3 * vi1 + 2) >= v.size()) ||
+          ((3 * vi2 + 2) >= v.size())) {
+        // Invalid triangle.
+        // FIXME(syoyo): Is it ok to simply skip this invalid triangle?
+        continue;
+      }
+      real_t v0x = v[vi0 * 3 + 0];
+      real_t v0y = v[vi0 * 3 + 1];
+      real_t v0z = v[vi0 * 3 + 2];
+      real_t v1x = v[vi1 * 3 + 0];
+      real_t v1y = v[vi1 * 3 + 1];
+      real_t v1z = v[vi1 * 3 + 2];
+      real_t v2x = v[vi2 * 3 + 0];
+      real_t v2y = v[vi2 * 3 + 1];
+      real_t v2z = v[vi2 * 3 + 2];
+      real_t e0x = v1x - v0x;
+      real_t e0y = v1y - v0y;
+      real_t e0z = v1z - v0z;
+      real_t e1x = v2x - v1x;
+      real_t e1y = v2y - v1y;
+      real_t e1z = v2z - v1z;
+      real_t cx = std::fabs(e0y * e1z - e0z * e1y);
+      real_t cy = std::fabs(e0z * e1x - e0x * e1z);
+      real_t cz = std::fabs(e0x * e1y - e0y * e1x);
+      const real_t epsilon = std::numeric_limits<real_t>::epsilon();
+      if (cx > epsilon || cy > epsilon || cz > epsilon) {
+        // found a corner
+        if (cx > cy && cx > cz) {
+        } else {
+          axes[0] = 0;
+          if (cz > cx && cz > cy) axes[1] = 1;
+        }
+        break;
+      }
+    }
+
+    real_t area = 0;
+    for (size_t k = 0; k < npolys; ++k) {
+      i0 = vertex_indices[(k + 0) % npolys];
+      i1 = vertex_indices[(k + 1) % npolys];
+      size_t vi0 = size_t(i0.v_idx);
+      size_t vi1 = size_t(i1.v_idx);
+      if (((vi0 * 3 + axes[0]) >= v.size()) ||
+          ((vi0 * 3 + axes[1]) >= v.size()) ||
+          ((vi1 * 3 + axes[0]) >= v.size()) ||
+          ((vi1 * 3 + axes[1]) >= v.size())) {
+        // Invalid index.
+        continue;
+      }
+      real_t v0x = v[vi0 * 3 + axes[0]];
+      real_t v0y = v[vi0 * 3 + axes[1]];
+      real_t v1x = v[vi1 * 3 + axes[0]];
+      real_t v1y = v[vi1 * 3 + axes[1]];
+      area += (v0x * v1y - v0y * v1x) * static_cast<real_t>(0.5);
+    }
+
+    int maxRounds = 10;  // arbitrary max loop count to protect against
+                         // unexpected errors
+
+    face_t remainingFace;
+    remainingFace.vertex_indices.assign(vertex_indices,
+                                        vertex_indices + npolys);
+    size_t guess_vert = 0;
+    vertex_index_t ind[3];
+    real_t vx[3];
+    real_t vy[3];
+    while (remainingFace.vertex_indices.size() > 3 && maxRounds > 0) {
+      npolys = remainingFace.vertex_indices.size();
+      if (guess_vert >= npolys) {
+        maxRounds -= 1;
+        guess_vert -= npolys;
+      }
+      for (size_t k = 0; k < 3; k++) {
+        ind[k] = remainingFace.vertex_indices[(guess_vert + k) % npolys];
+        size_t vi = size_t(ind[k].v_idx);
+        if (((vi * 3 + axes[0]) >= v.size()) ||
+            ((vi * 3 + axes[1]) >= v.size())) {
+          // ???
+          vx[k] = static_cast<real_t>(0.0);
+          vy[k] = static_cast<real_t>(0.0);
+        } else {
+          vx[k] = v[vi * 3 + axes[0]];
+          vy[k] = v[vi * 3 + axes[1]];
+        }
+      }
+      real_t e0x = vx[1] - vx[0];
+      real_t e0y = vy[1] - vy[0];
+      real_t e1x = vx[2] - vx[1];
+      real_t e1y = vy[2] - vy[1];
+      real_t cross = e0x * e1y - e0y * e1x;
+      // if an internal angle
+      if (cross * area < static_cast<real_t>(0.0)) {
+        guess_vert += 1;
+        continue;
+      }
+
+      // check all other verts in case they are inside this triangle
+      bool overlap = false;
+      for (size_t otherVert = 3; otherVert < npolys; ++otherVert) {
+        size_t idx = (guess_vert + otherVert) % npolys;
+
+        if (idx >= remainingFace.vertex_indices.size()) {
+          // ???
+          continue;
+        }
+
+        size_t ovi = size_t(remainingFace.vertex_indices[idx].v_idx);
+
+        if (((ovi * 3 + axes[0]) >= v.size()) ||
+            ((ovi * 3 + axes[1]) >= v.size())) {
+          // ???
+          continue;
+        }
+        real_t tx = v[ovi * 3 + axes[0]];
+        real_t ty = v[ovi * 3 + axes[1]];
+        if (pnpoly(3, vx, vy, tx, ty)) {
+          overlap = true;
+          break;
+        }
+      }
+
+      if (overlap) {
+        guess_vert += 1;
+        continue;
+      }
+
+      // this triangle is an ear
+      {
+        index_t idx0, idx1, idx2;
+        idx0.vertex_index = ind[0].v_idx;
+        idx0.normal_index = ind[0].vn_idx;
+        idx0.texcoord_index = ind[0].vt_idx;
+        idx1.vertex_index = ind[1].v_idx;
+        idx1.normal_index = ind[1].vn_idx;
+        idx1.texcoord_index = ind[1].vt_idx;
+        idx2.vertex_index = ind[2].v_idx;
+        idx2.normal_index = ind[2].vn_idx;
+        idx2.texcoord_index = ind[2].vt_idx;
+
+        shape->mesh.indices.push_back(idx0);
+        shape->mesh.indices.push_back(idx1);
+        shape->mesh.indices.push_back(idx2);
+
+        shape->mesh.num_face_vertices.push_back(3);
+        shape->mesh.material_ids.push_back(material_id);
+        shape->mesh.smoothing_group_ids.push_back(smoothing_group_id);
+      }
+
+      // remove v1 from the list
+      size_t removed_vert_index = (guess_vert + 1) % npolys;
+      while (removed_vert_index + 1 < npolys) {
+        remainingFace.vertex_indices[removed_vert_index] =
+            remainingFace.vertex_indices[removed_vert_index + 1];
+        removed_vert_index += 1;
+      }
+      remainingFace.vertex_indices.pop_back();
+    }
+
+    if (remainingFace.vertex_indices.size() == 3) {
+      i0 = remainingFace.vertex_indices[0];
+      i1 = remainingFace.vertex_indices[1];
+      i2 = remainingFace.vertex_indices[2];
+      {
+        index_t idx0, idx1, idx2;
+        idx0.vertex_index = i0.v_idx;
+        idx0.normal_index = i0.vn_idx;
+        idx0.texcoord_index = i0.vt_idx;
+        idx1.vertex_index = i1.v_idx;
+        idx1.normal_index = i1.vn_idx;
+        idx1.texcoord_index = i1.vt_idx;
+        idx2.vertex_index = i2.v_idx;
+        idx2.normal_index = i2.vn_idx;
+        idx2.texcoord_index = i2.vt_idx;
+
+        shape->mesh.indices.push_back(idx0);
+        shape->mesh.indices.push_back(idx1);
+        shape->mesh.indices.push_back(idx2);
+
+        shape->mesh.num_face_vertices.push_back(3);
+        shape->mesh.material_ids.push_back(material_id);
+        shape->mesh.smoothing_group_ids.push_back(smoothing_group_id);
+      }
+    }
+  } else {
+    for (size_t k = 0; k < npolys; k++) {
+      index_t idx;
+      idx.vertex_index = vertex_indices[k].v_idx;
+      idx.normal_index = vertex_indices[k].vn_idx;
+      idx.texcoord_index = vertex_indices[k].vt_idx;
+      shape->mesh.indices.push_back(idx);
+    }
+
+    shape->mesh.num_face_vertices.push_back(
+        static_cast<unsigned char>(npolys));
+    shape->mesh.material_ids.push_back(material_id);  // per face
+    shape->mesh.smoothing_group_ids.push_back(
+        smoothing_group_id);  // per face
+  }
+}
+
+// A file mapped into memory, or read into it where mmap isn't available.
+class MappedFile {
+ public:
+  MappedFile() : data_(NULL), size_(0), mapped_(false) {}
+  ~MappedFile() {
+#ifndef _WIN32
+    if (mapped_) munmap(const_cast<char *>(data_), size_);
+#endif
+  }
+
+  bool open(const char *filename) {
+#ifndef _WIN32
+    int fd = ::open(filename, O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      ::close(fd);
+      return false;
+    }
+
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_ > 0) {
+      void *addr = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (addr == MAP_FAILED) {
+        ::close(fd);
+        return false;
+      }
+      data_ = static_cast<const char *>(addr);
+      mapped_ = true;
+    }
+    ::close(fd);
+    return true;
+#else
+    std::ifstream ifs(filename, std::ios::binary);
+    if (!ifs) {
+      return false;
+    }
+    buffer_.assign(std::istreambuf_iterator<char>(ifs),
+                   std::istreambuf_iterator<char>());
+    data_ = buffer_.empty() ? NULL : &buffer_[0];
+    size_ = buffer_.size();
+    return true;
+#endif
+  }
+
+  const char *data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  MappedFile(const MappedFile &);
+  MappedFile &operator=(const MappedFile &);
+
+  const char *data_;
+  size_t size_;
+  bool mapped_;
+  std::vector<char> buffer_;
+};
+
+// Returns the start of the line after `p', lines end at '\n', '\r' or "\r\n"
+// like in `safeGetline'.
+inline const char *nextLine(const char *p, const char *end,
+                            const char **line_end) {
+  while (p < end && *p != '\n' && *p != '\r') p++;
+  (*line_end) = p;
+  if (p < end && *p == '\r' && p + 1 < end && p[1] == '\n') return p + 2;
+  return p < end ? p + 1 : p;
+}
+
+// A line LoadObjParallel replays on one thread, after the first `face' faces
+// of its chunk.
+struct obj_statement {
+  size_t face;
+  std::string line;
+};
+
+// A range of lines of the file, parsed by one thread.
+struct obj_chunk {
+  const char *begin;
+  const char *end;
+
+  // Number of `v', `vn' and `vt' lines in this chunk and in all chunks before
+  // it.
+  size_t num_v, num_vn, num_vt;
+  size_t v_offset, vn_offset, vt_offset;
+
+  // Faces, the vertices of face i are
+  // face_vertices[face_offsets[i], face_offsets[i + 1]).
+  std::vector<vertex_index_t> face_vertices;
+  std::vector<size_t> face_offsets;
+  std::vector<unsigned int> face_smoothing_ids;
+  // Faces before the first `s' line continue the smoothing group of the
+  // previous chunk.
+  size_t num_faces_before_smoothing;
+  bool has_smoothing;
+  unsigned int smoothing_id;
+
+  std::vector<obj_statement> statements;
+
+  // The chunk can't be merged, LoadObjParallel falls back to LoadObj.
+  bool failed;
+
+  // Faces flattened(and triangulated), the output of face i is
+  // indices[face_index_offsets[i], face_index_offsets[i + 1]) and
+  // num_face_vertices[face_poly_offsets[i], face_poly_offsets[i + 1]).
+  mesh_t mesh;
+  std::vector<size_t> face_index_offsets;
+  std::vector<size_t> face_poly_offsets;
+
+  obj_chunk()
+      : begin(NULL),
+        end(NULL),
+        num_v(0),
+        num_vn(0),
+        num_vt(0),
+        v_offset(0),
+        vn_offset(0),
+        vt_offset(0),
+        num_faces_before_smoothing(0),
+        has_smoothing(false),
+        smoothing_id(0),
+        failed(false) {}
+
+  size_t numFaces() const { return face_smoothing_ids.size(); }
+};
+
+// Faces [begin, end) of a chunk.
+struct obj_face_run {
+  const obj_chunk *chunk;
+  size_t begin;
+  size_t end;
+};
+
+// Runs `fn(chunk)' for every chunk on its own thread.
+template <typename F>
+inline void forEachChunk(std::vector<obj_chunk> &chunks, F fn) {
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < chunks.size(); i++) {
+    obj_chunk *chunk = &chunks[i];
+    threads.push_back(std::thread([fn, chunk] { fn(chunk); }));
+  }
+  fn(&chunks[0]);
+  for (size_t i = 0; i < threads.size(); i++) threads[i].join();
+}
+
+// Pass 1: counts the `v', `vn' and `vt' lines, so every chunk knows where its
+// attributes go and how many there are before each of its faces.
+inline void countAttributes(obj_chunk *chunk) {
+  const char *line_end;
+  for (const char *p = chunk->begin; p < chunk->end;
+       p = nextLine(p, chunk->end, &line_end)) {
+    nextLine(p, chunk->end, &line_end);
+    const char *token = p;
+    while (token < line_end && is_space(token[0])) token++;
+
+    if (line_end - token < 2 || token[0] != 'v') continue;
+    if (is_space(token[1])) {
+      chunk->num_v++;
+    } else if (line_end - token >= 3 && is_space(token[2])) {
+      if (token[1] == 'n') chunk->num_vn++;
+      if (token[1] == 't') chunk->num_vt++;
+    }
+  }
+}
+
+// Pass 2: parses the attributes straight into `attrib' and the faces with
+// their final indices. Everything else is kept for the merge.
+inline void parseChunk(obj_chunk *chunk, attrib_t *attrib, bool triangulate) {
+  size_t num_v = chunk->v_offset;
+  size_t num_vn = chunk->vn_offset;
+  size_t num_vt = chunk->vt_offset;
+  chunk->face_offsets.push_back(0);
+
+  std::string linebuf;
+  const char *line_end;
+  for (const char *p = chunk->begin; p < chunk->end;
+       p = nextLine(p, chunk->end, &line_end)) {
+    nextLine(p, chunk->end, &line_end);
+    linebuf.assign(p, line_end);
+
+    // Skip leading space.
+    const char *token = linebuf.c_str();
+    token += strspn(token, " \t");
+
+    if (token[0] == '\0') continue;  // empty line
+
+    if (token[0] == '#') continue;  // comment line
+
+    // vertex
+    if (token[0] == 'v' && is_space((token[1]))) {
+      token += 2;
+      real_t *v = &attrib->vertices[3 * num_v];
+      real_t *c = &attrib->colors[3 * num_v];
+      parseVertexWithColor(&v[0], &v[1], &v[2], &c[0], &c[1], &c[2], &token);
+      num_v++;
+      continue;
+    }
+
+    // normal
+    if (token[0] == 'v' && token[1] == 'n' && is_space((token[2]))) {
+      token += 3;
+      real_t *vn = &attrib->normals[3 * num_vn];
+      parseReal3(&vn[0], &vn[1], &vn[2], &token);
+      num_vn++;
+      continue;
+    }
+
+    // texcoord
+    if (token[0] == 'v' && token[1] == 't' && is_space((token[2]))) {
+      token += 3;
+      real_t *vt = &attrib->texcoords[2 * num_vt];
+      parseReal2(&vt[0], &vt[1], &token);
+      num_vt++;
+      continue;
+    }
+
+    // face
+    if (token[0] == 'f' && is_space((token[1]))) {
+      token += 2;
+      token += strspn(token, " \t");
+
+      size_t first = chunk->face_vertices.size();
+      while (!is_new_line(token[0])) {
+        vertex_index_t vi;
+        if (!parseTriple(&token, static_cast<int>(num_v),
+                         static_cast<int>(num_vn), static_cast<int>(num_vt),
+                         &vi)) {
+          chunk->failed = true;
+          return;
+        }
+
+        chunk->face_vertices.push_back(vi);
+        size_t n = strspn(token, " \t\r");
+        token += n;
+      }
+
+      // Polygons are triangulated with the vertices LoadObj has seen when
+      // it flushes the face group, so a reference to a later vertex can only
+      // be resolved by LoadObj itself.
+      size_t npolys = chunk->face_vertices.size() - first;
+      if (triangulate && npolys > 3) {
+        for (size_t k = first; k < chunk->face_vertices.size(); k++) {
+          if (chunk->face_vertices[k].v_idx >= static_cast<int>(num_v)) {
+            chunk->failed = true;
+            return;
+          }
+        }
+      }
+
+      chunk->face_offsets.push_back(chunk->face_vertices.size());
+      chunk->face_smoothing_ids.push_back(chunk->smoothing_id);
+      if (!chunk->has_smoothing) {
+        chunk->num_faces_before_smoothing = chunk->numFaces();
+      }
+      continue;
+    }
+
+    if (token[0] == 's' && is_space(token[1])) {
+      if (parseSmoothingGroupId(token + 2, &chunk->smoothing_id)) {
+        chunk->has_smoothing = true;
+      }
+      continue;
+    }
+
+    if ((token[0] == 'l' && is_space((token[1]))) ||
+        ((0 == strncmp(token, "usemtl", 6)) && is_space((token[6]))) ||
+        ((0 == strncmp(token, "mtllib", 6)) && is_space((token[6]))) ||
+        (token[0] == 'g' && is_space((token[1]))) ||
+        (token[0] == 'o' && is_space((token[1]))) ||
+        (token[0] == 't' && is_space(token[1]))) {
+      obj_statement statement;
+      statement.face = chunk->numFaces();
+      statement.line = token;
+      chunk->statements.push_back(statement);
+      continue;
+    }
+
+    // Ignore unknown command.
+  }
+}
+
+// Pass 3: flattens the faces of a chunk the way exportGroupsToShape does.
+// Material ids are filled in during the merge.
+inline void flattenChunk(obj_chunk *chunk, unsigned int smoothing_id,
+                         bool triangulate, const std::vector<real_t> &v) {
+  shape_t shape;
+  chunk->face_index_offsets.reserve(chunk->numFaces() + 1);
+  chunk->face_poly_offsets.reserve(chunk->numFaces() + 1);
+
+  for (size_t i = 0; i < chunk->numFaces(); i++) {
+    chunk->face_index_offsets.push_back(shape.mesh.indices.size());
+    chunk->face_poly_offsets.push_back(shape.mesh.num_face_vertices.size());
+
+    size_t first = chunk->face_offsets[i];
+    size_t npolys = chunk->face_offsets[i + 1] - first;
+    exportFaceToShape(&shape, npolys ? &chunk->face_vertices[first] : NULL,
+                      npolys,
+                      i < chunk->num_faces_before_smoothing
+                          ? smoothing_id
+                          : chunk->face_smoothing_ids[i],
+                      -1, triangulate, v);
+  }
+  chunk->face_index_offsets.push_back(shape.mesh.indices.size());
+  chunk->face_poly_offsets.push_back(shape.mesh.num_face_vertices.size());
+
+  chunk->mesh.indices.swap(shape.mesh.indices);
+  chunk->mesh.num_face_vertices.swap(shape.mesh.num_face_vertices);
+  chunk->mesh.smoothing_group_ids.swap(shape.mesh.smoothing_group_ids);
+
+  std::vector<vertex_index_t>().swap(chunk->face_vertices);
+  std::vector<size_t>().swap(chunk->face_offsets);
+}
+
+// exportGroupsToShape for faces that have already been flattened.
+inline bool exportFaceRunsToShape(shape_t *shape,
+                                  const std::vector<obj_face_run> &faceRuns,
+                                  std::vector<int> &lineGroup,
+                                  const std::vector<tag_t> &tags,
+                                  const int material_id,
+                                  const std::string &name) {
+  if (faceRuns.empty() && lineGroup.empty()) {
+    return false;
+  }
+
+  if (!faceRuns.empty()) {
+    for (size_t i = 0; i < faceRuns.size(); i++) {
+      const obj_chunk &chunk = *faceRuns[i].chunk;
+      const mesh_t &mesh = chunk.mesh;
+      size_t index_begin = chunk.face_index_offsets[faceRuns[i].begin];
+      size_t index_end = chunk.face_index_offsets[faceRuns[i].end];
+      size_t poly_begin = chunk.face_poly_offsets[faceRuns[i].begin];
+      size_t poly_end = chunk.face_poly_offsets[faceRuns[i].end];
+
+      shape->mesh.indices.insert(shape->mesh.indices.end(),
+                                 mesh.indices.begin() + index_begin,
+                                 mesh.indices.begin() + index_end);
+      shape->mesh.num_face_vertices.insert(
+          shape->mesh.num_face_vertices.end(),
+          mesh.num_face_vertices.begin() + poly_begin,
+          mesh.num_face_vertices.begin() + poly_end);
+      shape->mesh.smoothing_group_ids.insert(
+          shape->mesh.smoothing_group_ids.end(),
+          mesh.smoothing_group_ids.begin() + poly_begin,
+          mesh.smoothing_group_ids.begin() + poly_end);
+      shape->mesh.material_ids.insert(shape->mesh.material_ids.end(),
+                                      poly_end - poly_begin, material_id);
+    }
+
+    shape->name = name;
+    shape->mesh.tags = tags;
+  }
+
+  if (!lineGroup.empty()) {
+    shape->path.indices.swap(lineGroup);
+  }
+
+  return true;
+}
+
+// Loads .obj from a file with several threads. Arguments are the same as
+// `tinyobj::LoadObj', the result is identical to it. 'num_threads' is
+// optional, 0 uses one thread per hardware thread.
+inline bool LoadObjParallel(attrib_t *attrib, std::vector<shape_t> *shapes,
+                            std::vector<material_t> *materials,
+                            std::string *err, const char *filename,
+                            const char *mtl_basedir = NULL,
+                            bool triangulate = true,
+                            unsigned int num_threads = 0) {
+  attrib->vertices.clear();
+  attrib->normals.clear();
+  attrib->texcoords.clear();
+  attrib->colors.clear();
+  shapes->clear();
+
+  MappedFile file;
+  if (!file.open(filename)) {
+    if (err) {
+      std::stringstream errss;
+      errss << "Cannot open file [" << filename << "]" << std::endl;
+      (*err) = errss.str();
+    }
+    return false;
+  }
+
+  if (num_threads == 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  // Not worth a thread below 64KiB per chunk.
+  size_t num_chunks = std::min(static_cast<size_t>(num_threads),
+                               file.size() / (64 * 1024) + 1);
+
+  // Chunks start right after a line ending. A cut between "\r" and "\n"
+  // leaves an empty line at the start of the next chunk, which is skipped.
+  std::vector<obj_chunk> chunks(num_chunks);
+  const char *file_end = file.data() + file.size();
+  for (size_t i = 0; i < num_chunks; i++) {
+    chunks[i].begin = i == 0 ? file.data() : chunks[i - 1].end;
+    if (i + 1 == num_chunks) {
+      chunks[i].end = file_end;
+    } else {
+      const char *p = std::max(chunks[i].begin,
+                               file.data() + file.size() / num_chunks * (i + 1));
+      while (p < file_end && *p != '\n' && *p != '\r') p++;
+      chunks[i].end = p < file_end ? p + 1 : p;
+    }
+  }
+
+  forEachChunk(chunks, countAttributes);
+
+  size_t num_v = 0, num_vn = 0, num_vt = 0;
+  for (size_t i = 0; i < num_chunks; i++) {
+    chunks[i].v_offset = num_v;
+    chunks[i].vn_offset = num_vn;
+    chunks[i].vt_offset = num_vt;
+    num_v += chunks[i].num_v;
+    num_vn += chunks[i].num_vn;
+    num_vt += chunks[i].num_vt;
+  }
+  attrib->vertices.resize(3 * num_v);
+  attrib->colors.resize(3 * num_v);
+  attrib->normals.resize(3 * num_vn);
+  attrib->texcoords.resize(2 * num_vt);
+
+  forEachChunk(chunks, [attrib, triangulate](obj_chunk *chunk) {
+    parseChunk(chunk, attrib, triangulate);
+  });
+
+  // Parse errors(reported the way LoadObj does) and the rare files that need
+  // LoadObj's exact order.
+  for (size_t i = 0; i < num_chunks; i++) {
+    if (chunks[i].failed) {
+      return tinyobj::LoadObj(attrib, shapes, materials, err, filename,
+                              mtl_basedir, triangulate);
+    }
+  }
+
+  std::vector<unsigned int> smoothing_ids(num_chunks, 0);
+  for (size_t i = 1; i < num_chunks; i++) {
+    smoothing_ids[i] = chunks[i - 1].has_smoothing ? chunks[i - 1].smoothing_id
+                                                   : smoothing_ids[i - 1];
+  }
+
+  const std::vector<real_t> &v = attrib->vertices;
+  std::vector<unsigned int> *chunk_smoothing_ids = &smoothing_ids;
+  forEachChunk(chunks, [&chunks, chunk_smoothing_ids, triangulate,
+                        &v](obj_chunk *chunk) {
+    flattenChunk(chunk, (*chunk_smoothing_ids)[chunk - &chunks[0]],
+                 triangulate, v);
+  });
+
+  // Merge, the same state machine as LoadObj with runs of faces in place of
+  // single faces.
+  std::string baseDir = mtl_basedir ? mtl_basedir : "";
+  if (!baseDir.empty()) {
+#ifndef _WIN32
+    const char dirsep = '/';
+#else
+    const char dirsep = '\\';
+#endif
+    if (baseDir[baseDir.length() - 1] != dirsep) baseDir += dirsep;
+  }
+  MaterialFileReader matFileReader(baseDir);
+  MaterialReader *readMatFn = &matFileReader;
+
+  std::vector<tag_t> tags;
+  std::vector<obj_face_run> faceRuns;
+  std::vector<int> lineGroup;
+  std::string name;
+  std::map<std::string, int> material_map;
+  int material = -1;
+  shape_t shape;
+
+  for (size_t c = 0; c < num_chunks; c++) {
+    const obj_chunk &chunk = chunks[c];
+    size_t face = 0;
+
+    for (size_t st = 0; st <= chunk.statements.size(); st++) {
+      size_t next_face =
+          st < chunk.statements.size() ? chunk.statements[st].face
+                                       : chunk.numFaces();
+      if (next_face > face) {
+        obj_face_run run;
+        run.chunk = &chunk;
+        run.begin = face;
+        run.end = next_face;
+        faceRuns.push_back(run);
+        face = next_face;
+      }
+      if (st == chunk.statements.size()) break;
+
+      const char *token = chunk.statements[st].line.c_str();
+
+      // line
+      if (token[0] == 'l' && is_space((token[1]))) {
+        token += 2;
+        parseLineIndices(&token, &lineGroup);
+        continue;
+      }
+
+      // use mtl
+      if ((0 == strncmp(token, "usemtl", 6)) && is_space((token[6]))) {
+        token += 7;
+        std::string namebuf = token;
+
+        int newMaterialId = -1;
+        if (material_map.find(namebuf) != material_map.end()) {
+          newMaterialId = material_map[namebuf];
+        } else {
+          // { error!! material not found }
+        }
+
+        if (newMaterialId != material) {
+          exportFaceRunsToShape(&shape, faceRuns, lineGroup, tags, material,
+                                name);
+          faceRuns.clear();
+          material = newMaterialId;
+        }
+
+        continue;
+      }
+
+      // load mtl
+      if ((0 == strncmp(token, "mtllib", 6)) && is_space((token[6]))) {
+        token += 7;
+
+        std::vector<std::string> filenames;
+        SplitString(std::string(token), ' ', filenames);
+
+        if (filenames.empty()) {
+          if (err) {
+            (*err) +=
+                "WARN: Looks like empty filename for mtllib. Use default "
+                "material. \n";
+          }
+        } else {
+          bool found = false;
+          for (size_t s = 0; s < filenames.size(); s++) {
+            std::string err_mtl;
+            bool ok = (*readMatFn)(filenames[s].c_str(), materials,
+                                   &material_map, &err_mtl);
+            if (err && (!err_mtl.empty())) {
+              (*err) += err_mtl;  // This should be warn message.
+            }
+
+            if (ok) {
+              found = true;
+              break;
+            }
+          }
+
+          if (!found) {
+            if (err) {
+              (*err) +=
+                  "WARN: Failed to load material file(s). Use default "
+                  "material.\n";
+            }
+          }
+        }
+
+        continue;
+      }
+
+      // group name
+      if (token[0] == 'g' && is_space((token[1]))) {
+        exportFaceRunsToShape(&shape, faceRuns, lineGroup, tags, material,
+                              name);
+
+        if (shape.mesh.indices.size() > 0) {
+          shapes->push_back(shape);
+        }
+
+        shape = shape_t();
+        faceRuns.clear();
+
+        std::vector<std::string> names;
+        names.reserve(2);
+
+        while (!is_new_line(token[0])) {
+          std::string str = parseString(&token);
+          names.push_back(str);
+          token += strspn(token, " \t\r");  // skip tag
+        }
+
+        // names[0] must be 'g', so skip the 0th element.
+        if (names.size() > 1) {
+          name = names[1];
+        } else {
+          name = "";
+        }
+
+        continue;
+      }
+
+      // object name
+      if (token[0] == 'o' && is_space((token[1]))) {
+        bool ret = exportFaceRunsToShape(&shape, faceRuns, lineGroup, tags,
+                                         material, name);
+        if (ret) {
+          shapes->push_back(shape);
+        }
+
+        faceRuns.clear();
+        shape = shape_t();
+
+        token += 2;
+        name = token;
+
+        continue;
+      }
+
+      if (token[0] == 't' && is_space(token[1])) {
+        tag_t tag;
+
+        token += 2;
+        parseTag(&token, &tag);
+        tags.push_back(tag);
+
+        continue;
+      }
+    }
+  }
+
+  bool ret =
+      exportFaceRunsToShape(&shape, faceRuns, lineGroup, tags, material, name);
+  if (ret || shape.mesh.indices.size()) {
+    shapes->push_back(shape);
+  }
+
+  return true;
+}
+
+}  // namespace obj_parallel
+
+#endif
@@ -0,0 +1,158 @@
+#ifndef PIPELINE_CACHE_H
+#define PIPELINE_CACHE_H
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// -------------------------
+// PERSISTENT PIPELINE CACHE
+// -------------------------
+// compiling shaders into a pipeline is one of the slowest things a driver
+// does. a VkPipelineCache remembers the results, and its contents can be
+// written to disk at shutdown and handed back to the driver at the next start
+//
+// the blob starts with a header (VkPipelineCacheHeaderVersionOne):
+//   -uint32 header length (16 + VK_UUID_SIZE)
+//   -uint32 header version (VK_PIPELINE_CACHE_HEADER_VERSION_ONE)
+//   -uint32 vendorID
+//   -uint32 deviceID
+//   -uint8  pipelineCacheUUID[VK_UUID_SIZE]
+// a driver update or a different GPU changes these, so a file that doesn't
+// match the current device is thrown away instead of handed to the driver
+// (most drivers check this themselves but not all of them do it gracefully)
+
+
+class PipelineCache {
+public:
+  void init(VkPhysicalDevice physical_device, VkDevice device, const std::string& path) {
+    this->device = device;
+    this->path   = path;
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+
+    std::vector<char> data = read_file();
+    warm = !data.empty() && is_valid(data);
+    if (!data.empty() && !warm) {
+      std::cout << "pipeline cache: " << path << " was created for a different device or driver, ignoring it" << std::endl;
+    }
+
+    VkPipelineCacheCreateInfo cache_info = {};
+    cache_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cache_info.initialDataSize = warm ? data.size() : 0;
+    cache_info.pInitialData    = warm ? data.data() : nullptr;
+
+    if (vkCreatePipelineCache(device, &cache_info, nullptr, &cache) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create pipeline cache!");
+    }
+
+    std::cout << "pipeline cache: " << (warm ? "loaded " : "starting cold, no usable ")
+              << path << (warm ? " (" + std::to_string(data.size()) + " bytes)" : "") << std::endl;
+  }
+
+
+  VkPipelineCache get() const {
+    return cache;
+  }
+
+
+  // true if the cache was seeded from disk
+  bool is_warm() const {
+    return warm;
+  }
+
+
+  // writes the current contents to path. goes through a temporary file so a
+  // crash halfway through never leaves a truncated cache behind
+  void save() {
+    size_t size = 0;
+    if (vkGetPipelineCacheData(device, cache, &size, nullptr) != VK_SUCCESS || size == 0) {
+      return;
+    }
+
+    std::vector<char> data(size);
+    if (vkGetPipelineCacheData(device, cache, &size, data.data()) != VK_SUCCESS) {
+      std::cerr << "pipeline cache: failed to read cache data" << std::endl;
+      return;
+    }
+
+    std::string temp_path = path + ".tmp";
+    {
+      std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+      if (!file.is_open()) {
+        std::cerr << "pipeline cache: failed to open " << temp_path << " for writing" << std::endl;
+        return;
+      }
+      file.write(data.data(), size);
+      if (!file) {
+        std::cerr << "pipeline cache: failed to write " << temp_path << std::endl;
+        return;
+      }
+    }
+
+    if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+      std::cerr << "pipeline cache: failed to replace " << path << std::endl;
+      std::remove(temp_path.c_str());
+      return;
+    }
+    std::cout << "pipeline cache: saved " << size << " bytes to " << path << std::endl;
+  }
+
+
+  void destroy() {
+    vkDestroyPipelineCache(device, cache, nullptr);
+    cache = VK_NULL_HANDLE;
+  }
+
+
+private:
+  VkDevice device = VK_NULL_HANDLE;
+  VkPipelineCache cache = VK_NULL_HANDLE;
+  VkPhysicalDeviceProperties properties;
+  std::string path;
+  bool warm = false;
+
+
+  std::vector<char> read_file() const {
+    std::ifstream file(path, std::ios::ate | std::ios::binary);
+    if (!file.is_open()) {
+      return std::vector<char>();
+    }
+
+    size_t file_size = static_cast<size_t>(file.tellg());
+    std::vector<char> buffer(file_size);
+    file.seekg(0);
+    file.read(buffer.data(), file_size);
+    if (!file) {
+      return std::vector<char>();
+    }
+    return buffer;
+  }
+
+
+  bool is_valid(const std::vector<char>& data) const {
+    const size_t header_size = 4 * sizeof(uint32_t) + VK_UUID_SIZE;
+    if (data.size() < header_size) {
+      return false;
+    }
+
+    uint32_t header[4];
+    memcpy(header, data.data(), sizeof(header));
+    uint8_t uuid[VK_UUID_SIZE];
+    memcpy(uuid, data.data() + sizeof(header), VK_UUID_SIZE);
+
+    return header[0] >= header_size &&
+        header[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+        header[2] == properties.vendorID &&
+        header[3] == properties.deviceID &&
+        memcmp(uuid, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+  }
+};
+
+#endif
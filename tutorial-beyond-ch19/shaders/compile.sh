@@ -1,2 +1,4 @@
 /home/wyatt/vulkan/1.1.77.0/x86_64/bin/glslangValidator -V shader.vert
 /home/wyatt/vulkan/1.1.77.0/x86_64/bin/glslangValidator -V shader.frag
+/home/wyatt/vulkan/1.1.77.0/x86_64/bin/glslangValidator -V mipmap.comp -o mipmap.spv
+/home/wyatt/vulkan/1.1.77.0/x86_64/bin/glslangValidator -V cull.comp -o cull.spv
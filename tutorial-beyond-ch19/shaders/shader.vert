@@ -5,14 +5,23 @@ layout(binding = 0) uniform UniformBufferObject {
   mat4 model;
   mat4 view;
   mat4 proj;
+  // undoes the quantization of --packed-vertices, identity otherwise
+  vec4 position_scale;
+  vec4 position_offset;
+  vec4 tex_coord_transform;
 } ubo;
 
+// one transform per draw list entry. gl_InstanceIndex counts from the
+// firstInstance of the draw call, so it indexes this for instanced draws and
+// for single draws alike
+layout(std430, binding = 2) readonly buffer InstanceBuffer {
+  mat4 models[];
+} instances;
+
 layout(location = 0) in vec3 in_position;
-layout(location = 1) in vec3 in_color;
-layout(location = 2) in vec2 in_tex_coord;
+layout(location = 1) in vec2 in_tex_coord;
 
-layout(location = 0) out vec3 frag_color;
-layout(location = 1) out vec2 frag_tex_coord;
+layout(location = 0) out vec2 frag_tex_coord;
 
 out gl_PerVertex {
   vec4 gl_Position;
@@ -21,7 +30,7 @@ out gl_PerVertex {
 
 
 void main() {
-  gl_Position = ubo.proj * ubo.view * ubo.model * vec4(in_position, 1.0);
-  frag_color = in_color;
-  frag_tex_coord = in_tex_coord;
+  vec3 position = in_position * ubo.position_scale.xyz + ubo.position_offset.xyz;
+  gl_Position = ubo.proj * ubo.view * instances.models[gl_InstanceIndex] * ubo.model * vec4(position, 1.0);
+  frag_tex_coord = in_tex_coord * ubo.tex_coord_transform.xy + ubo.tex_coord_transform.zw;
 }
@@ -0,0 +1,153 @@
+#ifndef STARTUP_GRAPH_H
+#define STARTUP_GRAPH_H
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "thread_pool.h"
+
+// -------------
+// STARTUP GRAPH
+// -------------
+// initialization is mostly a chain, every step needs the one before it (no
+// swap chain without a device, no pipeline without a render pass). the asset
+// work is not: parsing the model needs nothing from Vulkan and decoding the
+// texture only needs somewhere to put the pixels. those are launched as tasks
+// on worker threads while the main thread carries on with the chain, which
+// joins a task right before the first step that uses its result:
+//
+//   main:    instance -> device -> swap chain -> pipelines -> ... -> join -> vertex buffer
+//   worker:  prepare_model ------------------------------------------^
+//
+// step and launch record when every step ran and on which thread,
+// print_timeline draws it. with parallel off, launch runs the task on the
+// spot, so the same code gives the serial timeline to compare against
+
+
+// width of the bars in the timeline
+const int STARTUP_TIMELINE_WIDTH = 40;
+
+
+struct StartupTask {
+  std::string name;
+  std::shared_future<void> done;
+};
+
+
+class StartupGraph {
+public:
+  explicit StartupGraph(bool parallel, uint32_t worker_count = 2) :
+      parallel(parallel), start_time(std::chrono::high_resolution_clock::now()) {
+    if (parallel) {
+      workers.init(worker_count);
+    }
+  }
+
+
+  // runs fn on the calling thread
+  void step(const std::string& name, const std::function<void()>& fn) {
+    size_t entry = begin(name, "main");
+    fn();
+    end(entry);
+  }
+
+
+  // runs fn on a worker, exceptions are rethrown by join
+  StartupTask launch(const std::string& name, std::function<void()> fn) {
+    const char* thread = parallel ? "worker" : "main";
+    auto task = std::make_shared<std::packaged_task<void()>>([this, name, thread, fn] {
+      size_t entry = begin(name, thread);
+      fn();
+      end(entry);
+    });
+
+    StartupTask handle;
+    handle.name = name;
+    handle.done = task->get_future().share();
+    if (parallel) {
+      workers.submit([task] { (*task)(); });
+    } else {
+      (*task)();
+    }
+    return handle;
+  }
+
+
+  // blocks until task has finished, the time spent waiting shows up in the
+  // timeline
+  void join(const StartupTask& task) {
+    if (task.done.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+      size_t entry = begin("waiting for " + task.name, "main");
+      task.done.wait();
+      end(entry);
+    }
+    task.done.get();
+  }
+
+
+  void print_timeline(std::ostream& out) {
+    std::lock_guard<std::mutex> lock(mutex);
+    double total = 0.0;
+    for (const auto& entry : entries) total = std::max(total, entry.end);
+    total = std::max(total, 1e-3);
+
+    out << "startup: " << std::fixed << std::setprecision(1) << total << " ms ("
+        << (parallel ? "parallel" : "serial") << ")" << std::endl;
+    for (const auto& entry : entries) {
+      int first = static_cast<int>(entry.start / total * STARTUP_TIMELINE_WIDTH);
+      int last  = std::max(first + 1, static_cast<int>(entry.end / total * STARTUP_TIMELINE_WIDTH + 0.5));
+      std::string bar(STARTUP_TIMELINE_WIDTH, ' ');
+      for (int i = first; i < std::min(last, STARTUP_TIMELINE_WIDTH); i++) bar[i] = '#';
+
+      out << "  " << std::left << std::setw(30) << entry.name << std::setw(7) << entry.thread << std::right
+          << std::setw(8) << entry.start << std::setw(8) << entry.end - entry.start << " ms |" << bar << "|"
+          << std::endl;
+    }
+    out << std::defaultfloat;
+  }
+
+
+private:
+  struct Entry {
+    std::string name;
+    const char* thread;
+    // ms since the graph was created
+    double start;
+    double end;
+  };
+
+  bool parallel;
+  std::chrono::high_resolution_clock::time_point start_time;
+  std::mutex mutex;
+  std::vector<Entry> entries;
+  ThreadPool workers;
+
+
+  double now() const {
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start_time).count();
+  }
+
+
+  size_t begin(const std::string& name, const char* thread) {
+    std::lock_guard<std::mutex> lock(mutex);
+    double time = now();
+    entries.push_back(Entry{name, thread, time, time});
+    return entries.size() - 1;
+  }
+
+
+  void end(size_t entry) {
+    std::lock_guard<std::mutex> lock(mutex);
+    entries[entry].end = now();
+  }
+};
+
+#endif
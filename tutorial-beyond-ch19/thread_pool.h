@@ -0,0 +1,151 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// -----------
+// THREAD POOL
+// -----------
+// a fixed set of worker threads pulling tasks off a single queue. threads are
+// started once and then sleep on a condition variable, creating a std::thread
+// per task would cost more than most of the tasks themselves
+//
+// wait() blocks until every submitted task has finished and rethrows the
+// first exception a task threw. it must not be called from inside a task
+
+
+class ThreadPool {
+public:
+  ThreadPool() = default;
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  ~ThreadPool() {
+    destroy();
+  }
+
+
+  // 0 picks one worker per hardware thread
+  void init(uint32_t thread_count = 0) {
+    if (thread_count == 0) {
+      thread_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    stopping = false;
+    for (uint32_t i = 0; i < thread_count; i++) {
+      workers.push_back(std::thread(&ThreadPool::worker_loop, this));
+    }
+  }
+
+
+  uint32_t size() const {
+    return static_cast<uint32_t>(workers.size());
+  }
+
+
+  void submit(std::function<void()> task) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      tasks.push_back(std::move(task));
+      pending++;
+    }
+    task_available.notify_one();
+  }
+
+
+  void wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    all_done.wait(lock, [this] { return pending == 0; });
+
+    if (error) {
+      std::exception_ptr e = error;
+      error = nullptr;
+      std::rethrow_exception(e);
+    }
+  }
+
+
+  // splits [0, count) into partition_count contiguous ranges and runs
+  // fn(partition, begin, end) for each of them, returns once all are done.
+  // every partition index is handed to exactly one task, so per partition
+  // state (a command pool, a scratch buffer, ...) is never shared
+  template <typename F>
+  void parallel_for(size_t count, uint32_t partition_count, F fn) {
+    partition_count = std::max(1u, partition_count);
+    size_t per_partition = (count + partition_count - 1) / partition_count;
+
+    for (uint32_t p = 0; p < partition_count; p++) {
+      size_t begin = std::min(count, p * per_partition);
+      size_t end   = std::min(count, begin + per_partition);
+      submit([fn, p, begin, end] { fn(p, begin, end); });
+    }
+    wait();
+  }
+
+
+  void destroy() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    task_available.notify_all();
+
+    for (auto& worker : workers) {
+      worker.join();
+    }
+    workers.clear();
+  }
+
+
+private:
+  std::vector<std::thread> workers;
+  std::deque<std::function<void()>> tasks;
+  size_t pending = 0;
+  bool stopping  = false;
+  std::exception_ptr error;
+
+  std::mutex mutex;
+  std::condition_variable task_available;
+  std::condition_variable all_done;
+
+
+  void worker_loop() {
+    for (;;) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        task_available.wait(lock, [this] { return stopping || !tasks.empty(); });
+        if (stopping && tasks.empty()) {
+          return;
+        }
+        task = std::move(tasks.front());
+        tasks.pop_front();
+      }
+
+      try {
+        task();
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!error) error = std::current_exception();
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending--;
+        if (pending == 0) {
+          all_done.notify_all();
+        }
+      }
+    }
+  }
+};
+
+#endif
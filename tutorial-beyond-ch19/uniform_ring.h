@@ -0,0 +1,102 @@
+#ifndef UNIFORM_RING_H
+#define UNIFORM_RING_H
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+// -------------------
+// UNIFORM RING BUFFER
+// -------------------
+// one big host visible + host coherent buffer that stays mapped for the life
+// of the application. it is split into equally sized regions, one for each
+// frame the GPU may still be reading from, and writing a uniform is only a
+// pointer bump plus a memcpy into the region of the current frame
+//
+// the offset handed back is what gets passed as the dynamic offset when
+// binding a VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC descriptor, so a single
+// descriptor set can address every uniform that was written
+
+
+struct UniformSlice {
+  uint32_t offset;
+  void* data;
+};
+
+
+class UniformRing {
+public:
+  void init(void* mapped, VkDeviceSize region_size, uint32_t region_count, VkDeviceSize alignment) {
+    this->mapped       = static_cast<char*>(mapped);
+    this->region_size  = region_size;
+    this->region_count = region_count;
+    this->alignment    = alignment;
+    region_begin = 0;
+    head         = 0;
+  }
+
+
+  // everything previously written to this region must no longer be in use by
+  // the GPU
+  void begin_region(uint32_t region) {
+    if (region >= region_count) {
+      throw std::out_of_range("uniform ring region out of range!");
+    }
+    region_begin = region * region_size;
+    head         = region_begin;
+  }
+
+
+  // size rounded up to the offset alignment, the stride between uniforms that
+  // are written as one array (see allocate)
+  VkDeviceSize aligned_size(VkDeviceSize size) const {
+    return (size + alignment - 1) / alignment * alignment;
+  }
+
+
+  // one contiguous range, e.g. count * aligned_size(sizeof(T)) bytes that
+  // several threads fill in parallel, each writing its own elements
+  UniformSlice allocate(VkDeviceSize size) {
+    VkDeviceSize offset = (head + alignment - 1) / alignment * alignment;
+    if (offset + size > region_begin + region_size) {
+      throw std::runtime_error("uniform ring region overflow!");
+    }
+    head = offset + size;
+
+    UniformSlice slice;
+    slice.offset = static_cast<uint32_t>(offset);
+    slice.data   = mapped + offset;
+    return slice;
+  }
+
+
+  template <typename T>
+  uint32_t push(const T& value) {
+    UniformSlice slice = allocate(sizeof(T));
+    memcpy(slice.data, &value, sizeof(T));
+    return slice.offset;
+  }
+
+
+  uint32_t region_offset(uint32_t region) const {
+    return static_cast<uint32_t>(region * region_size);
+  }
+
+
+  VkDeviceSize size() const {
+    return region_size * region_count;
+  }
+
+
+private:
+  char* mapped = nullptr;
+  VkDeviceSize region_size  = 0;
+  uint32_t region_count     = 0;
+  VkDeviceSize alignment    = 1;
+  VkDeviceSize region_begin = 0;
+  VkDeviceSize head         = 0;
+};
+
+#endif
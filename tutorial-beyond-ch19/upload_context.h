@@ -0,0 +1,307 @@
+#ifndef UPLOAD_CONTEXT_H
+#define UPLOAD_CONTEXT_H
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+#include "gpu_timeline.h"
+#include "memory_allocator.h"
+
+// --------------
+// UPLOAD CONTEXT
+// --------------
+// batches buffer copies and image layout transitions into one command buffer
+// and submits them without waiting. the batch is a submission on the
+// GpuTimeline, and the staging buffers it read from are only destroyed once
+// the timeline has reached it (see collect)
+//
+// if the device has a queue family that can do transfers but no graphics
+// (usually a DMA engine) the copies run there. resources created with
+// VK_SHARING_MODE_EXCLUSIVE then need a queue family ownership transfer:
+//   -a "release" barrier recorded on the transfer queue
+//   -a matching "acquire" barrier recorded on the graphics queue
+// the graphics side batch waits on a semaphore signaled by the transfer side.
+// since the acquire barriers are submitted to the graphics queue before any
+// frame, every later submission on that queue is ordered after them, so
+// rendering can start while the copies are still running
+
+
+class UploadContext {
+public:
+  // the graphics side is submitted through timeline, which owns the
+  // graphics queue
+  void init(VkDevice device, MemoryAllocator* allocator, GpuTimeline* timeline,
+      uint32_t graphics_family, uint32_t transfer_family, VkQueue transfer_queue) {
+    this->device          = device;
+    this->allocator       = allocator;
+    this->timeline        = timeline;
+    this->graphics_family = graphics_family;
+    this->transfer_family = transfer_family;
+    this->transfer_queue  = transfer_queue;
+
+    graphics_pool = create_pool(graphics_family);
+    transfer_pool = has_dedicated_transfer() ? create_pool(transfer_family) : graphics_pool;
+  }
+
+
+  bool has_dedicated_transfer() const {
+    return transfer_family != graphics_family;
+  }
+
+
+  // commands that only need the transfer stage (copies, transitions into
+  // TRANSFER_DST_OPTIMAL)
+  VkCommandBuffer transfer_commands() {
+    if (!has_dedicated_transfer()) return graphics_commands();
+
+    if (current.transfer_commands == VK_NULL_HANDLE) {
+      current.transfer_commands = begin(transfer_pool);
+    }
+    return current.transfer_commands;
+  }
+
+
+  // commands that need a graphics queue (blits, depth/fragment stages)
+  VkCommandBuffer graphics_commands() {
+    if (current.graphics_commands == VK_NULL_HANDLE) {
+      current.graphics_commands = begin(graphics_pool);
+    }
+    return current.graphics_commands;
+  }
+
+
+  // makes the result of transfer_commands visible to the graphics queue
+  // src_stage/srcAccessMask describe the transfer side writes, dst_stage and
+  // dstAccessMask the graphics side reads
+  void hand_over_buffer(const VkBufferMemoryBarrier& barrier,
+      VkPipelineStageFlags src_stage, VkPipelineStageFlags dst_stage) {
+    if (!has_dedicated_transfer()) {
+      vkCmdPipelineBarrier(graphics_commands(), src_stage, dst_stage, 0,
+          0, nullptr, 1, &barrier, 0, nullptr);
+      return;
+    }
+
+    VkBufferMemoryBarrier release = barrier;
+    release.srcQueueFamilyIndex = transfer_family;
+    release.dstQueueFamilyIndex = graphics_family;
+    release.dstAccessMask = 0;
+    vkCmdPipelineBarrier(transfer_commands(), src_stage, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+        0, nullptr, 1, &release, 0, nullptr);
+
+    VkBufferMemoryBarrier acquire = barrier;
+    acquire.srcQueueFamilyIndex = transfer_family;
+    acquire.dstQueueFamilyIndex = graphics_family;
+    acquire.srcAccessMask = 0;
+    vkCmdPipelineBarrier(graphics_commands(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dst_stage, 0,
+        0, nullptr, 1, &acquire, 0, nullptr);
+  }
+
+
+  // same as hand_over_buffer, the layout change (if any) is part of the
+  // ownership transfer and must be identical on both sides
+  void hand_over_image(const VkImageMemoryBarrier& barrier,
+      VkPipelineStageFlags src_stage, VkPipelineStageFlags dst_stage) {
+    if (!has_dedicated_transfer()) {
+      vkCmdPipelineBarrier(graphics_commands(), src_stage, dst_stage, 0,
+          0, nullptr, 0, nullptr, 1, &barrier);
+      return;
+    }
+
+    VkImageMemoryBarrier release = barrier;
+    release.srcQueueFamilyIndex = transfer_family;
+    release.dstQueueFamilyIndex = graphics_family;
+    release.dstAccessMask = 0;
+    vkCmdPipelineBarrier(transfer_commands(), src_stage, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+        0, nullptr, 0, nullptr, 1, &release);
+
+    VkImageMemoryBarrier acquire = barrier;
+    acquire.srcQueueFamilyIndex = transfer_family;
+    acquire.dstQueueFamilyIndex = graphics_family;
+    acquire.srcAccessMask = 0;
+    vkCmdPipelineBarrier(graphics_commands(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dst_stage, 0,
+        0, nullptr, 0, nullptr, 1, &acquire);
+  }
+
+
+  // the staging buffer is destroyed once the current batch has completed
+  void retire(VkBuffer buffer, const Allocation& memory) {
+    current.staging_buffers.push_back(buffer);
+    current.staging_memory.push_back(memory);
+  }
+
+
+  // for anything else the recorded commands use (temporary views, pipelines,
+  // descriptor sets, ...), called once the current batch has completed
+  void defer(std::function<void()> release) {
+    current.deferred.push_back(std::move(release));
+  }
+
+
+  // submits everything recorded since the last submit, does not wait
+  void submit() {
+    if (current.transfer_commands == VK_NULL_HANDLE && current.graphics_commands == VK_NULL_HANDLE) {
+      return;
+    }
+
+    if (current.transfer_commands != VK_NULL_HANDLE) {
+      vkEndCommandBuffer(current.transfer_commands);
+
+      VkSemaphoreCreateInfo semaphore_info = {};
+      semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+      if (vkCreateSemaphore(device, &semaphore_info, nullptr, &current.semaphore) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create upload semaphore!");
+      }
+
+      VkSubmitInfo submit_info = {};
+      submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+      submit_info.commandBufferCount   = 1;
+      submit_info.pCommandBuffers      = &current.transfer_commands;
+      submit_info.signalSemaphoreCount = 1;
+      submit_info.pSignalSemaphores    = &current.semaphore;
+
+      if (vkQueueSubmit(transfer_queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS) {
+        throw std::runtime_error("failed to submit upload commands!");
+      }
+    }
+
+    // the graphics side always gets a submission (even an empty one) so its
+    // timeline value covers the transfer side as well via the semaphore wait
+    VkCommandBuffer graphics = graphics_commands();
+    vkEndCommandBuffer(graphics);
+
+    VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    VkSubmitInfo submit_info = {};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    if (current.semaphore != VK_NULL_HANDLE) {
+      submit_info.waitSemaphoreCount = 1;
+      submit_info.pWaitSemaphores    = &current.semaphore;
+      submit_info.pWaitDstStageMask  = &wait_stage;
+    }
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers    = &graphics;
+
+    if (timeline->submit(submit_info) != VK_SUCCESS) {
+      throw std::runtime_error("failed to submit upload commands!");
+    }
+    current.value = timeline->submitted();
+
+    in_flight.push_back(current);
+    current = Batch();
+  }
+
+
+  // releases command buffers and staging memory of every finished batch,
+  // returns true once nothing is in flight anymore
+  bool collect() {
+    uint64_t completed = timeline->completed();
+    size_t finished = 0;
+    while (finished < in_flight.size() && in_flight[finished].value <= completed) {
+      release(in_flight[finished++]);
+    }
+    in_flight.erase(in_flight.begin(), in_flight.begin() + finished);
+    return in_flight.empty();
+  }
+
+
+  void wait() {
+    submit();
+    if (!in_flight.empty()) {
+      timeline->wait(in_flight.back().value);
+    }
+    collect();
+  }
+
+
+  void destroy() {
+    wait();
+    if (transfer_pool != graphics_pool) {
+      vkDestroyCommandPool(device, transfer_pool, nullptr);
+    }
+    vkDestroyCommandPool(device, graphics_pool, nullptr);
+  }
+
+
+private:
+  struct Batch {
+    VkCommandBuffer transfer_commands = VK_NULL_HANDLE;
+    VkCommandBuffer graphics_commands = VK_NULL_HANDLE;
+    VkSemaphore semaphore = VK_NULL_HANDLE;
+    // set by submit, see GpuTimeline
+    uint64_t value = 0;
+    std::vector<VkBuffer> staging_buffers;
+    std::vector<Allocation> staging_memory;
+    std::vector<std::function<void()>> deferred;
+  };
+
+  VkDevice device = VK_NULL_HANDLE;
+  MemoryAllocator* allocator = nullptr;
+  GpuTimeline* timeline = nullptr;
+
+  uint32_t graphics_family = 0;
+  uint32_t transfer_family = 0;
+  VkQueue transfer_queue = VK_NULL_HANDLE;
+  VkCommandPool graphics_pool = VK_NULL_HANDLE;
+  VkCommandPool transfer_pool = VK_NULL_HANDLE;
+
+  Batch current;
+  std::vector<Batch> in_flight;
+
+
+  VkCommandPool create_pool(uint32_t family) {
+    VkCommandPoolCreateInfo pool_info = {};
+    pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    pool_info.queueFamilyIndex = family;
+
+    VkCommandPool pool;
+    if (vkCreateCommandPool(device, &pool_info, nullptr, &pool) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create upload command pool!");
+    }
+    return pool;
+  }
+
+
+  VkCommandBuffer begin(VkCommandPool pool) {
+    VkCommandBufferAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    alloc_info.commandPool = pool;
+    alloc_info.commandBufferCount = 1;
+
+    VkCommandBuffer command_buffer;
+    if (vkAllocateCommandBuffers(device, &alloc_info, &command_buffer) != VK_SUCCESS) {
+      throw std::runtime_error("failed to allocate upload command buffer!");
+    }
+
+    VkCommandBufferBeginInfo begin_info = {};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    vkBeginCommandBuffer(command_buffer, &begin_info);
+    return command_buffer;
+  }
+
+
+  void release(Batch& batch) {
+    for (size_t i = 0; i < batch.staging_buffers.size(); i++) {
+      vkDestroyBuffer(device, batch.staging_buffers[i], nullptr);
+      allocator->free(batch.staging_memory[i]);
+    }
+    for (auto& release : batch.deferred) {
+      release();
+    }
+    if (batch.transfer_commands != VK_NULL_HANDLE) {
+      vkFreeCommandBuffers(device, transfer_pool, 1, &batch.transfer_commands);
+    }
+    vkFreeCommandBuffers(device, graphics_pool, 1, &batch.graphics_commands);
+    if (batch.semaphore != VK_NULL_HANDLE) {
+      vkDestroySemaphore(device, batch.semaphore, nullptr);
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,219 @@
+#ifndef VERTEX_DEDUP_H
+#define VERTEX_DEDUP_H
+
+#include <cstdint>
+#include <vector>
+
+#include "thread_pool.h"
+
+// --------------------
+// VERTEX DEDUPLICATION
+// --------------------
+// every face corner of an OBJ file references a position and a texture
+// coordinate by index, and every face around a vertex repeats the same pair.
+// the pairs are packed into 64-bit keys (vertex_key), deduplication gives
+// every distinct key one vertex:
+//   -indices[corner]: the vertex of every corner
+//   -first_corners[vertex]: the first corner of every vertex, where its
+//    attributes come from
+// vertices are numbered in order of first appearance, the order the corners
+// are drawn in
+//
+// the table is a flat array of {key, vertex} slots with linear probing, kept
+// at most half full. a corner costs one hash and one walk over consecutive
+// slots that ends at its key or at the empty slot it is inserted into,
+// usually within the first cache line
+//
+// deduplicate_vertices_parallel gives exactly the same result on a ThreadPool:
+//   -the corners are sorted into partitions by hash, equal keys always land
+//    in the same partition and keep their order within it
+//   -every partition is deduplicated on its own, which finds the first corner
+//    of every vertex
+//   -a prefix sum over the first corners numbers the vertices
+//   -every other corner takes the number of its first corner
+
+
+inline uint64_t vertex_key(uint32_t position_index, uint32_t tex_coord_index) {
+  return (static_cast<uint64_t>(position_index) << 32) | tex_coord_index;
+}
+
+
+// the finalizer of MurmurHash3, every key bit affects every hash bit. the
+// packed indices are small and sequential, the table and the partitions use
+// the low and the high bits of the hash respectively
+inline uint64_t hash_vertex_key(uint64_t key) {
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdull;
+  key ^= key >> 33;
+  key *= 0xc4ceb9fe1a85ec53ull;
+  key ^= key >> 33;
+  return key;
+}
+
+
+class VertexKeyTable {
+public:
+  void init(size_t expected_keys) {
+    size_t capacity = 16;
+    while (capacity < expected_keys * 2) capacity *= 2;
+    slots.assign(capacity, Slot{0, EMPTY});
+    used = 0;
+  }
+
+
+  // the value stored for key, value is stored first if key is new
+  uint32_t insert(uint64_t key, uint64_t hash, uint32_t value) {
+    size_t mask = slots.size() - 1;
+    for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+      Slot& slot = slots[i];
+      if (slot.value == EMPTY) {
+        slot.key   = key;
+        slot.value = value;
+        if (++used * 2 > slots.size()) grow();
+        return value;
+      }
+      if (slot.key == key) {
+        return slot.value;
+      }
+    }
+  }
+
+
+private:
+  static const uint32_t EMPTY = ~0u;
+
+  struct Slot {
+    uint64_t key;
+    uint32_t value;
+  };
+
+  std::vector<Slot> slots;
+  size_t used = 0;
+
+
+  void grow() {
+    std::vector<Slot> old(slots.size() * 2, Slot{0, EMPTY});
+    old.swap(slots);
+
+    size_t mask = slots.size() - 1;
+    for (const Slot& slot : old) {
+      if (slot.value == EMPTY) continue;
+      size_t i = hash_vertex_key(slot.key) & mask;
+      while (slots[i].value != EMPTY) i = (i + 1) & mask;
+      slots[i] = slot;
+    }
+  }
+};
+
+
+// a closed mesh has about six corners per vertex, the table starts out sized
+// for that and grows if there are more
+const size_t VERTEX_DEDUP_CORNERS_PER_VERTEX = 6;
+
+
+inline void deduplicate_vertices(const std::vector<uint64_t>& keys, std::vector<uint32_t>& indices,
+    std::vector<uint32_t>& first_corners) {
+  indices.resize(keys.size());
+  first_corners.clear();
+
+  VertexKeyTable table;
+  table.init(keys.size() / VERTEX_DEDUP_CORNERS_PER_VERTEX);
+  for (size_t c = 0; c < keys.size(); c++) {
+    uint32_t next = static_cast<uint32_t>(first_corners.size());
+    uint32_t vertex = table.insert(keys[c], hash_vertex_key(keys[c]), next);
+    if (vertex == next) first_corners.push_back(static_cast<uint32_t>(c));
+    indices[c] = vertex;
+  }
+}
+
+
+// partitions per thread, more than one so a partition with many vertices
+// doesn't hold up the others
+const uint32_t VERTEX_DEDUP_PARTITIONS_PER_THREAD = 4;
+
+
+inline void deduplicate_vertices_parallel(ThreadPool& pool, const std::vector<uint64_t>& keys,
+    std::vector<uint32_t>& indices, std::vector<uint32_t>& first_corners) {
+  size_t corner_count = keys.size();
+  uint32_t chunk_count = pool.size();
+  if (chunk_count == 0) {
+    deduplicate_vertices(keys, indices, first_corners);
+    return;
+  }
+  uint32_t partition_bits = 0;
+  while ((1u << partition_bits) < chunk_count * VERTEX_DEDUP_PARTITIONS_PER_THREAD) partition_bits++;
+  uint32_t partition_count = 1u << partition_bits;
+  auto partition_of = [partition_bits](uint64_t key) {
+    return partition_bits == 0 ? 0 : static_cast<uint32_t>(hash_vertex_key(key) >> (64 - partition_bits));
+  };
+
+  // corners per chunk and partition, then where every chunk's corners of a
+  // partition start in partitioned: partition by partition, chunk by chunk
+  std::vector<size_t> offsets(chunk_count * partition_count, 0);
+  pool.parallel_for(corner_count, chunk_count, [&](uint32_t chunk, size_t begin, size_t end) {
+    size_t* counts = &offsets[chunk * partition_count];
+    for (size_t c = begin; c < end; c++) counts[partition_of(keys[c])]++;
+  });
+
+  std::vector<size_t> partition_starts(partition_count + 1, 0);
+  size_t offset = 0;
+  for (uint32_t p = 0; p < partition_count; p++) {
+    partition_starts[p] = offset;
+    for (uint32_t chunk = 0; chunk < chunk_count; chunk++) {
+      size_t count = offsets[chunk * partition_count + p];
+      offsets[chunk * partition_count + p] = offset;
+      offset += count;
+    }
+  }
+  partition_starts[partition_count] = offset;
+
+  std::vector<uint32_t> partitioned(corner_count);
+  pool.parallel_for(corner_count, chunk_count, [&](uint32_t chunk, size_t begin, size_t end) {
+    size_t* next = &offsets[chunk * partition_count];
+    for (size_t c = begin; c < end; c++) partitioned[next[partition_of(keys[c])]++] = static_cast<uint32_t>(c);
+  });
+
+  // the first corner with the same key, the corner itself for first corners
+  std::vector<uint32_t> owners(corner_count);
+  pool.parallel_for(partition_count, chunk_count, [&](uint32_t, size_t begin, size_t end) {
+    VertexKeyTable table;
+    for (size_t p = begin; p < end; p++) {
+      size_t first = partition_starts[p], last = partition_starts[p + 1];
+      table.init((last - first) / VERTEX_DEDUP_CORNERS_PER_VERTEX);
+      for (size_t i = first; i < last; i++) {
+        uint32_t c = partitioned[i];
+        owners[c] = table.insert(keys[c], hash_vertex_key(keys[c]), c);
+      }
+    }
+  });
+
+  std::vector<uint32_t> chunk_firsts(chunk_count + 1, 0);
+  pool.parallel_for(corner_count, chunk_count, [&](uint32_t chunk, size_t begin, size_t end) {
+    uint32_t count = 0;
+    for (size_t c = begin; c < end; c++) count += owners[c] == c;
+    chunk_firsts[chunk + 1] = count;
+  });
+  for (uint32_t chunk = 0; chunk < chunk_count; chunk++) chunk_firsts[chunk + 1] += chunk_firsts[chunk];
+
+  indices.resize(corner_count);
+  first_corners.resize(chunk_firsts[chunk_count]);
+  pool.parallel_for(corner_count, chunk_count, [&](uint32_t chunk, size_t begin, size_t end) {
+    uint32_t vertex = chunk_firsts[chunk];
+    for (size_t c = begin; c < end; c++) {
+      if (owners[c] == c) {
+        first_corners[vertex] = static_cast<uint32_t>(c);
+        indices[c] = vertex++;
+      }
+    }
+  });
+
+  // first corners come before the other corners of their vertex, but not
+  // necessarily in the same chunk, so this needs the pass above to be done
+  pool.parallel_for(corner_count, chunk_count, [&](uint32_t, size_t begin, size_t end) {
+    for (size_t c = begin; c < end; c++) {
+      if (owners[c] != c) indices[c] = indices[owners[c]];
+    }
+  });
+}
+
+#endif